@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# Generate mk_http.h, engine 2 as a single header: the public and inline
+# headers first, the implementation behind MK_HTTP_IMPLEMENTATION. Define
+# it in exactly one translation unit of the embedder before including the
+# header, the hot path is then visible to the compiler of that unit:
+#
+#   #define MK_HTTP_IMPLEMENTATION
+#   #include "mk_http.h"
+#
+# The header can come after any system header. It only needs POSIX.1-2008
+# declarations: the default gnu modes have them, a strict -std=c11 build
+# adds -D_POSIX_C_SOURCE=200809L.
+#
+# Usage: ./amalgamate.sh [output], mk_http.h by default.
+
+set -e
+
+cd "$(dirname "$0")"
+OUT=${1:-mk_http.h}
+
+HEADERS="mk_http_status.h mk_http_parser2.h mk_http_chars.h mk_http_scan.h
+         mk_http_events.h mk_http_hash.h mk_http_stats.h mk_http_timing.h
+         mk_http_response.h mk_http_websocket.h"
+SOURCES="mk_http_parser2.c mk_http_response.c mk_http_stats.c
+         mk_http_timing.c mk_http_websocket.c"
+
+# Drop the license header and local includes, the amalgamation carries
+# each of them once. It must not need feature macros such as _GNU_SOURCE:
+# the embedder may include system headers before it, where defining them
+# has no effect.
+strip() {
+    echo "/* ---- $1 ---- */"
+    sed -e '1,18d' \
+        -e '/^#include "/d' \
+        -e '/^#define _GNU_SOURCE$/d' "$1"
+}
+
+{
+    sed -n '1,18p' mk_http_parser2.h
+    cat <<'HEAD'
+
+/*
+ * Amalgamated engine 2, generated by amalgamate.sh, do not edit. See the
+ * script for how to build the implementation.
+ */
+
+#ifndef MK_HTTP_AMALGAMATED_H
+#define MK_HTTP_AMALGAMATED_H
+HEAD
+    for f in $HEADERS; do
+        strip $f
+    done
+    echo
+    echo "#ifdef MK_HTTP_IMPLEMENTATION"
+    for f in $SOURCES; do
+        strip $f
+    done
+    echo "#endif // MK_HTTP_IMPLEMENTATION"
+    echo
+    echo "#endif // MK_HTTP_AMALGAMATED_H"
+} > "$OUT.tmp"
+
+mv "$OUT.tmp" "$OUT"
@@ -0,0 +1,513 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/* memmem() of the amalgamated build, see mk_http.h */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * BENCH_AMALGAMATED builds the parser from the generated mk_http.h in
+ * this unit, so the gain of inlining over the objects build shows up.
+ */
+#ifdef BENCH_AMALGAMATED
+#define MK_HTTP_IMPLEMENTATION
+#include "mk_http.h"
+#define BENCH_BUILD "amalgamated"
+#else
+#include "mk_http_parser2.h"
+#include "mk_http_chars.h"
+#include "mk_http_events.h"
+#include "mk_http_timing.h"
+#include "mk_http_websocket.h"
+#define BENCH_BUILD "objects"
+#endif
+#include "mk_http_router.h"
+#include "mk_http_multipart.h"
+#include "mk_http_cookie.h"
+#include "mk_http_log.h"
+
+#define BENCH_ITERATIONS 200000
+#define BENCH_ROUNDS     5
+#define BENCH_ROUTES     10000
+#define BENCH_UPLOAD     4096
+#define BENCH_COOKIES    48
+
+struct bench_case {
+    const char *name;
+    char *request;
+};
+
+static char b_small[] =
+    "GET / HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "\r\n";
+
+static char b_browser[] =
+    "GET /static/css/site.css?v=20141002 HTTP/1.1\r\n"
+    "Host: www.example.com:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:33.0) Gecko/20100101 Firefox/33.0\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Referer: http://www.example.com/index.html\r\n"
+    "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark; lang=en\r\n"
+    "Connection: keep-alive\r\n"
+    "If-Modified-Since: Thu, 02 Oct 2014 10:00:00 GMT\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "\r\n";
+
+static char b_upgrade[] =
+    "GET /chat HTTP/1.1\r\n"
+    "Host: server.example.com\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "\r\n";
+
+static char b_post[] =
+    "POST /form HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Content-Length: 27\r\n"
+    "\r\n"
+    "name=monkey&value=parser+42";
+
+static struct bench_case bench_cases[] = {
+    { "small",   b_small   },
+    { "browser", b_browser },
+    { "post",    b_post    },
+    { NULL,      NULL      }
+};
+
+static double bench_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Parsers under test, each parses one request and returns 0 on success */
+
+static struct mk_request bench_req;
+
+static int bench_request(char *buf, size_t len)
+{
+    if (mk_http_parser(&bench_req, buf, len) != 0 ||
+            bench_req.state != MK_RESPONSE_NEW) {
+        return -1;
+    }
+    return 0;
+}
+
+static int bench_on_header(void *data, int id,
+        const char *name, size_t name_len,
+        const char *value, size_t value_len)
+{
+    (void) id;
+    (void) name;
+    (void) name_len;
+    (void) value;
+    (void) value_len;
+    (*(int *) data)++;
+    return 0;
+}
+
+static const struct mk_http_callbacks bench_cb = {
+    .on_header = bench_on_header,
+};
+
+MK_HTTP_PARSER_CALLBACKS(bench_events_parse, bench_cb)
+
+static int bench_events(char *buf, size_t len)
+{
+    int headers = 0;
+
+    return bench_events_parse(&headers, buf, len) == (int) len ? 0 : -1;
+}
+
+/*
+ * Router over BENCH_ROUTES routes, a third of each kind, the paths below
+ * hit the last routes added.
+ */
+static char r_static[] = "/api/v1/group9999/items";
+static char r_param[]  = "/users/9997/profile/1234567";
+static char r_suffix[] = "/static/9998/css/site/main.css";
+
+static struct bench_case route_cases[] = {
+    { "static", r_static },
+    { "param",  r_param  },
+    { "suffix", r_suffix },
+    { NULL,     NULL     }
+};
+
+static struct mk_route_table *bench_table;
+
+static int bench_routes_init()
+{
+    int i;
+    char pattern[64];
+
+    bench_table = mk_route_table_create();
+    if (!bench_table) {
+        return -1;
+    }
+    for (i = 0; i < BENCH_ROUTES; i++) {
+        switch (i % 3) {
+        case 0:
+            snprintf(pattern, sizeof(pattern), "/api/v1/group%i/items", i);
+            break;
+        case 1:
+            snprintf(pattern, sizeof(pattern), "/users/%i/profile/:id", i);
+            break;
+        default:
+            snprintf(pattern, sizeof(pattern), "/static/%i/*", i);
+            break;
+        }
+        if (mk_route_table_add(bench_table, pattern, i)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int bench_route(char *buf, size_t len)
+{
+    mk_pointer path = { buf, len };
+    struct mk_route_match match;
+
+    return mk_route_table_match(bench_table, path, &match) < 0 ? -1 : 0;
+}
+
+/* Reconnect storm: parse the upgrade and write the 101 */
+static struct bench_case upgrade_cases[] = {
+    { "handshake", b_upgrade },
+    { NULL,        NULL      }
+};
+
+static int bench_websocket(char *buf, size_t len)
+{
+    char out[256];
+
+    if (mk_http_parser(&bench_req, buf, len) != 0 ||
+            !(bench_req.request.connection & MK_CONN_WEBSOCKET)) {
+        return -1;
+    }
+    return mk_websocket_response(&bench_req.request, NULL,
+                                 out, sizeof(out)) < 0 ? -1 : 0;
+}
+
+/*
+ * Multipart body with one BENCH_UPLOAD bytes file part, the data has a
+ * CR every 64 bytes to keep the delimiter search honest.
+ */
+static char m_upload[BENCH_UPLOAD + 256];
+
+static struct bench_case upload_cases[] = {
+    { "upload", m_upload },
+    { NULL,     NULL     }
+};
+
+static const struct mk_multipart_callbacks bench_mp_cb = { NULL };
+static mk_pointer bench_boundary = { "----monkeyBoundary7MA4YWxkTrZu0gW", 33 };
+
+static void bench_upload_init()
+{
+    int i, len;
+
+    len = snprintf(m_upload, sizeof(m_upload),
+                   "--%s\r\nContent-Disposition: form-data; name=\"file\"; "
+                   "filename=\"a.bin\"\r\n\r\n", bench_boundary.data);
+    for (i = 0; i < BENCH_UPLOAD; i++) {
+        m_upload[len + i] = (i % 64 == 63) ? '\r' : 'a' + i % 26;
+    }
+    snprintf(m_upload + len + i, sizeof(m_upload) - len - i,
+             "\r\n--%s--\r\n", bench_boundary.data);
+}
+
+static int bench_multipart(char *buf, size_t len)
+{
+    struct mk_multipart mp;
+
+    mk_multipart_init(&mp, bench_boundary, &bench_mp_cb, NULL);
+    return mk_multipart_feed(&mp, buf, len) == MK_HTTP_OK ? 0 : -1;
+}
+
+/*
+ * Request with a ~2 KB Cookie header, the session middleware case: the
+ * jar is set up and asked for two cookies, one near each end.
+ */
+static char c_jar[4096];
+
+static struct bench_case cookie_cases[] = {
+    { "jar", c_jar },
+    { NULL,  NULL  }
+};
+
+static struct mk_request bench_cookie_req;
+
+static int bench_cookie_init()
+{
+    int i, len;
+
+    len = snprintf(c_jar, sizeof(c_jar), "GET / HTTP/1.1\r\nHost: a\r\nCookie: ");
+    for (i = 0; i < BENCH_COOKIES; i++) {
+        len += snprintf(c_jar + len, sizeof(c_jar) - len,
+                        "%s%s%02i=0123456789abcdef0123456789abcdef",
+                        i ? "; " : "",
+                        i == 1 ? "sid" : i == BENCH_COOKIES - 2 ? "csrf" : "c", i);
+    }
+    snprintf(c_jar + len, sizeof(c_jar) - len, "\r\n\r\n");
+
+    return mk_http_parser(&bench_cookie_req, c_jar, strlen(c_jar));
+}
+
+static int bench_cookie(char *buf, size_t len)
+{
+    struct mk_cookie_jar jar;
+    mk_pointer sid, csrf;
+    char name[8];
+
+    (void) buf;
+    (void) len;
+
+    mk_cookie_jar_init(&jar, &bench_cookie_req.request);
+    snprintf(name, sizeof(name), "csrf%02i", BENCH_COOKIES - 2);
+    if (mk_cookie_get(&jar, "sid01", 5, &sid) ||
+            mk_cookie_get(&jar, name, strlen(name), &csrf)) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Combined format access log line for the browser request, against the
+ * snprintf() over copied fields it replaces. Both batch into a buffer
+ * written to /dev/null.
+ */
+static struct bench_case log_cases[] = {
+    { "combined", b_browser },
+    { NULL,       NULL      }
+};
+
+static struct mk_request bench_log_req;
+static struct mk_log_format bench_log_fmt;
+static struct mk_log bench_log;
+
+static int bench_log_init()
+{
+    int fd;
+
+    fd = open("/dev/null", O_WRONLY);
+    if (fd == -1 || mk_log_compile(&bench_log_fmt, MK_LOG_COMBINED)) {
+        return -1;
+    }
+    mk_log_init(&bench_log, fd, 1);
+    return mk_http_parser(&bench_log_req, b_browser, strlen(b_browser));
+}
+
+static int bench_log_line(char *buf, size_t len)
+{
+    struct mk_log_entry entry = {
+        &bench_log_req.request, 200, 5120, { "192.168.1.20", 12 }
+    };
+
+    (void) buf;
+    (void) len;
+
+    return mk_log_append(&bench_log, &bench_log_fmt, &entry);
+}
+
+static void bench_log_field(char *out, size_t size, const char *p, size_t len)
+{
+    if (len >= size) {
+        len = size - 1;
+    }
+    memcpy(out, p, len);
+    out[len] = '\0';
+}
+
+static int bench_log_snprintf(char *buf, size_t len)
+{
+    const struct mk_request_info *info = &bench_log_req.request;
+    char method[16], uri[256], protocol[16], referer[256], agent[256];
+    char date[32];
+    const char *value;
+    size_t value_len;
+    struct tm tm;
+    time_t now;
+    int n;
+
+    (void) buf;
+    (void) len;
+
+    if (sizeof(bench_log.buf) - bench_log.len < MK_LOG_LINE_MAX &&
+            mk_log_flush(&bench_log)) {
+        return -1;
+    }
+    bench_log_field(method, sizeof(method), info->method.data, info->method.len);
+    bench_log_field(uri, sizeof(uri), info->uri.data, info->uri.len);
+    bench_log_field(protocol, sizeof(protocol), info->protocol.data,
+                    info->protocol.len);
+    strcpy(referer, "-");
+    if (!mk_http_request_header(info, "Referer", &value, &value_len)) {
+        bench_log_field(referer, sizeof(referer), value, value_len);
+    }
+    strcpy(agent, "-");
+    if (!mk_http_request_header(info, "User-Agent", &value, &value_len)) {
+        bench_log_field(agent, sizeof(agent), value, value_len);
+    }
+    now = time(NULL);
+    gmtime_r(&now, &tm);
+    strftime(date, sizeof(date), "[%d/%b/%Y:%H:%M:%S +0000]", &tm);
+
+    n = snprintf(bench_log.buf + bench_log.len, MK_LOG_LINE_MAX,
+                 "%s - - %s \"%s %s %s\" %i %lu \"%s\" \"%s\"\n",
+                 "192.168.1.20", date, method, uri, protocol, 200, 5120UL,
+                 referer, agent);
+    bench_log.len += n < MK_LOG_LINE_MAX ? n : MK_LOG_LINE_MAX - 1;
+    return 0;
+}
+
+/*
+ * One line per case, key=value pairs, so runs of different builds can be
+ * compared with plain text tools.
+ */
+static int bench_run(const char *mode, int (*parse)(char *, size_t),
+        struct bench_case *bc)
+{
+    int i, round;
+    size_t len;
+    double start, elapsed, best = 0;
+
+    len = strlen(bc->request);
+
+    memset(&bench_req, 0, sizeof(bench_req));
+    if (parse(bc->request, len)) {
+        printf("mode=%s case=%s error=parse\n", mode, bc->name);
+        return -1;
+    }
+
+    /* Keep the best round, the others mostly measure scheduler noise */
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        start = bench_now();
+        for (i = 0; i < BENCH_ITERATIONS; i++) {
+            parse(bc->request, len);
+        }
+        elapsed = bench_now() - start;
+        if (round == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    elapsed = best;
+
+    printf("engine=2 build=%s mode=%s strict=%i case=%s bytes=%zu "
+           "iterations=%i ns_per_req=%.1f mb_per_s=%.1f\n",
+           BENCH_BUILD, mode, MK_HTTP_STRICT, bc->name, len, BENCH_ITERATIONS,
+           elapsed * 1e9 / BENCH_ITERATIONS,
+           (double) len * BENCH_ITERATIONS / elapsed / (1024 * 1024));
+
+    return 0;
+}
+
+int main()
+{
+    int ret = 0;
+    struct bench_case *bc;
+#if MK_HTTP_TIMING
+    char out[1024];
+    static struct mk_http_timing timing;
+
+    mk_http_timing_enable(1);
+#endif
+
+    for (bc = bench_cases; bc->name != NULL; bc++) {
+        if (bench_run("request", bench_request, bc)) {
+            ret = 1;
+        }
+    }
+    for (bc = bench_cases; bc->name != NULL; bc++) {
+        if (bench_run("events", bench_events, bc)) {
+            ret = 1;
+        }
+    }
+
+    for (bc = upgrade_cases; bc->name != NULL; bc++) {
+        if (bench_run("websocket", bench_websocket, bc)) {
+            ret = 1;
+        }
+    }
+
+    if (bench_routes_init()) {
+        printf("mode=router error=init\n");
+        return 1;
+    }
+    for (bc = route_cases; bc->name != NULL; bc++) {
+        if (bench_run("router", bench_route, bc)) {
+            ret = 1;
+        }
+    }
+    mk_route_table_destroy(bench_table);
+
+    if (bench_cookie_init()) {
+        printf("mode=cookie error=init\n");
+        return 1;
+    }
+    for (bc = cookie_cases; bc->name != NULL; bc++) {
+        if (bench_run("cookie", bench_cookie, bc)) {
+            ret = 1;
+        }
+    }
+
+    bench_upload_init();
+    for (bc = upload_cases; bc->name != NULL; bc++) {
+        if (bench_run("multipart", bench_multipart, bc)) {
+            ret = 1;
+        }
+    }
+
+    if (bench_log_init()) {
+        printf("mode=log error=init\n");
+        return 1;
+    }
+    for (bc = log_cases; bc->name != NULL; bc++) {
+        if (bench_run("log", bench_log_line, bc) ||
+                bench_run("log-snprintf", bench_log_snprintf, bc)) {
+            ret = 1;
+        }
+    }
+    mk_log_flush(&bench_log);
+    close(bench_log.fd);
+
+#if MK_HTTP_TIMING
+    mk_http_timing_snapshot(&timing);
+    if (mk_http_timing_export(&timing, out, sizeof(out)) > 0) {
+        fputs(out, stdout);
+    }
+#endif
+
+    return ret;
+}
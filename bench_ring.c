@@ -0,0 +1,179 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "mk_http_parser2.h"
+#include "mk_http_ring.h"
+
+/*
+ * Handoff benchmark: a parent process parses a request once and pushes
+ * it through the ring, a forked worker maps the request back and looks
+ * a header up. Throughput streams requests, latency bounces one request
+ * back and forth over a second ring.
+ */
+
+#define RING_SLOTS      1024
+#define RING_SLOT_SIZE  2048
+#define RING_STREAM     1000000
+#define RING_PINGPONG   100000
+
+static char b_browser[] =
+    "GET /static/css/site.css?v=20141002 HTTP/1.1\r\n"
+    "Host: www.example.com:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:33.0) Gecko/20100101 Firefox/33.0\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Referer: http://www.example.com/index.html\r\n"
+    "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark; lang=en\r\n"
+    "Connection: keep-alive\r\n"
+    "If-Modified-Since: Thu, 02 Oct 2014 10:00:00 GMT\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "\r\n";
+
+static double bench_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Take one request off the ring, waiting for it */
+static int bench_consume(struct mk_ring *ring)
+{
+    uint32_t len;
+    uint64_t ticket;
+    size_t value_len;
+    const char *value;
+    struct mk_request_info info;
+    struct mk_request_wire *wire;
+    int ret;
+
+    while ((wire = mk_ring_peek(ring, &ticket, &len)) == NULL) {
+        sched_yield();
+    }
+    mk_request_wire_view(wire, &info);
+    ret = mk_http_request_header(&info, "Host", &value, &value_len);
+    mk_ring_release(ring, ticket);
+    return ret;
+}
+
+static void bench_produce(struct mk_ring *ring, struct mk_request_info *info)
+{
+    while (mk_ring_push_request(ring, info)) {
+        sched_yield();
+    }
+}
+
+static int bench_stream(struct mk_request_info *info, int flags)
+{
+    int i, status, errors = 0;
+    pid_t pid;
+    double start, elapsed;
+    struct mk_ring ring;
+
+    if (mk_ring_create(&ring, RING_SLOTS, RING_SLOT_SIZE, flags)) {
+        return -1;
+    }
+
+    start = bench_now();
+    pid = fork();
+    if (pid == 0) {
+        for (i = 0; i < RING_STREAM; i++) {
+            errors += bench_consume(&ring) != 0;
+        }
+        _exit(errors != 0);
+    }
+    for (i = 0; i < RING_STREAM; i++) {
+        bench_produce(&ring, info);
+    }
+    waitpid(pid, &status, 0);
+    elapsed = bench_now() - start;
+    mk_ring_detach(&ring);
+
+    printf("mode=ring test=stream spsc=%i requests=%i ns_per_req=%.1f "
+           "req_per_s=%.0f\n",
+           (flags & MK_RING_SPSC) != 0, RING_STREAM,
+           elapsed * 1e9 / RING_STREAM, RING_STREAM / elapsed);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+static int bench_pingpong(struct mk_request_info *info)
+{
+    int i, status, errors = 0;
+    pid_t pid;
+    double start, elapsed;
+    struct mk_ring ping, pong;
+
+    if (mk_ring_create(&ping, 2, RING_SLOT_SIZE, MK_RING_SPSC) ||
+            mk_ring_create(&pong, 2, RING_SLOT_SIZE, MK_RING_SPSC)) {
+        return -1;
+    }
+
+    pid = fork();
+    if (pid == 0) {
+        for (i = 0; i < RING_PINGPONG; i++) {
+            errors += bench_consume(&ping) != 0;
+            bench_produce(&pong, info);
+        }
+        _exit(errors != 0);
+    }
+
+    start = bench_now();
+    for (i = 0; i < RING_PINGPONG; i++) {
+        bench_produce(&ping, info);
+        errors += bench_consume(&pong) != 0;
+    }
+    elapsed = bench_now() - start;
+    waitpid(pid, &status, 0);
+    mk_ring_detach(&ping);
+    mk_ring_detach(&pong);
+
+    printf("mode=ring test=pingpong round_trips=%i ns_per_handoff=%.1f\n",
+           RING_PINGPONG, elapsed * 1e9 / RING_PINGPONG / 2);
+    return !errors && WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+int main()
+{
+    int ret = 0;
+    struct mk_request req;
+
+    memset(&req, 0, sizeof(req));
+    if (mk_http_parser(&req, b_browser, strlen(b_browser)) ||
+            req.state != MK_RESPONSE_NEW) {
+        printf("mode=ring error=parse\n");
+        return 1;
+    }
+
+    if (bench_stream(&req.request, MK_RING_SPSC) ||
+            bench_stream(&req.request, 0) ||
+            bench_pingpong(&req.request)) {
+        ret = 1;
+    }
+    return ret;
+}
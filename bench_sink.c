@@ -0,0 +1,228 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "mk_http_parser2.h"
+#include "mk_http_sink.h"
+
+/*
+ * Upload benchmark: a forked client posts a large body over loopback TCP,
+ * the parent parses the head and stores the body in a temporary file,
+ * either through the sink or with a read(2)/write(2) copy loop. Reports
+ * wall time and the CPU time the receiving side spent.
+ */
+
+#define UPLOAD_SIZE     (64UL << 20)
+#define UPLOAD_RUNS     5
+#define UPLOAD_CHUNK    (64 << 10)
+
+static double bench_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double bench_cpu()
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+        ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void bench_client(int port)
+{
+    static char chunk[UPLOAD_CHUNK];
+    char head[128];
+    unsigned long left = UPLOAD_SIZE;
+    struct sockaddr_in addr;
+    ssize_t n;
+    int fd, len;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+        _exit(1);
+    }
+
+    memset(chunk, 'u', sizeof(chunk));
+    len = snprintf(head, sizeof(head), "PUT /upload HTTP/1.1\r\nHost: a\r\n"
+                   "Content-Length: %lu\r\n\r\n", UPLOAD_SIZE);
+    if (write(fd, head, len) != len) {
+        _exit(1);
+    }
+    while (left > 0) {
+        n = write(fd, chunk, left < sizeof(chunk) ? left : sizeof(chunk));
+        if (n <= 0) {
+            _exit(1);
+        }
+        left -= n;
+    }
+    close(fd);
+    _exit(0);
+}
+
+/* Read until the head is complete and parse it */
+static int bench_head(int sock, struct mk_request *req, char *buf, size_t size)
+{
+    size_t len = 0;
+    ssize_t n;
+
+    while (len < size) {
+        n = read(sock, buf + len, size - len);
+        if (n <= 0) {
+            return -1;
+        }
+        len += n;
+        memset(req, 0, sizeof(*req));
+        if (mk_http_parser(req, buf, len) == 0 &&
+                req->state == MK_RESPONSE_STREAM) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int bench_sink(int sock, struct mk_request *req, int fd)
+{
+    struct mk_body_sink sink;
+    struct pollfd pfd = { .fd = sock, .events = POLLIN };
+    int ret;
+
+    if (mk_body_sink_init(&sink, &req->request, fd)) {
+        return -1;
+    }
+    while ((ret = mk_body_sink_feed(&sink, sock)) == MK_HTTP_PENDING) {
+        poll(&pfd, 1, -1);
+    }
+    mk_body_sink_release(&sink);
+    return ret;
+}
+
+static int bench_copy(int sock, struct mk_request *req, int fd)
+{
+    static char buf[UPLOAD_CHUNK];
+    unsigned long left;
+    ssize_t n;
+
+    if (write(fd, req->request.body.data, req->request.body.len) !=
+            (ssize_t) req->request.body.len) {
+        return -1;
+    }
+    left = req->request.content_length - req->request.body.len;
+    while (left > 0) {
+        n = read(sock, buf, left < sizeof(buf) ? left : sizeof(buf));
+        if (n <= 0 || write(fd, buf, n) != n) {
+            return -1;
+        }
+        left -= n;
+    }
+    return 0;
+}
+
+static int bench_run(int lfd, int port, const char *mode)
+{
+    char path[] = "/tmp/bench_sink_XXXXXX";
+    char head[1024];
+    struct mk_request req;
+    double best = 0, cpu = 0, t0, c0, t;
+    pid_t pid;
+    int i, fd, sock, ret;
+
+    for (i = 0; i < UPLOAD_RUNS; i++) {
+        fd = mkstemp(path);
+        if (fd == -1) {
+            return -1;
+        }
+        unlink(path);
+        strcpy(path + strlen(path) - 6, "XXXXXX");
+
+        pid = fork();
+        if (pid == 0) {
+            bench_client(port);
+        }
+        sock = accept(lfd, NULL, NULL);
+        t0 = bench_now();
+        c0 = bench_cpu();
+        ret = bench_head(sock, &req, head, sizeof(head));
+        if (ret == 0) {
+            ret = strcmp(mode, "sink") ? bench_copy(sock, &req, fd) :
+                bench_sink(sock, &req, fd);
+        }
+        t = bench_now() - t0;
+        cpu += bench_cpu() - c0;
+        close(sock);
+        close(fd);
+        waitpid(pid, NULL, 0);
+        if (ret) {
+            printf("mode=%s error=upload\n", mode);
+            return -1;
+        }
+        if (best == 0 || t < best) {
+            best = t;
+        }
+    }
+
+    printf("mode=%s bytes=%lu runs=%i best_ms=%.1f mb_per_s=%.0f "
+           "cpu_ms_per_run=%.1f\n", mode, UPLOAD_SIZE, UPLOAD_RUNS,
+           best * 1e3, UPLOAD_SIZE / best / (1 << 20), cpu * 1e3 / UPLOAD_RUNS);
+    return 0;
+}
+
+int main()
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int lfd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) ||
+            listen(lfd, 4) ||
+            getsockname(lfd, (struct sockaddr *) &addr, &len)) {
+        perror("listen");
+        return 1;
+    }
+
+    mk_http_body_sink_max(UPLOAD_SIZE);
+    if (bench_run(lfd, ntohs(addr.sin_port), "copy") ||
+            bench_run(lfd, ntohs(addr.sin_port), "sink")) {
+        return 1;
+    }
+    close(lfd);
+    return 0;
+}
@@ -0,0 +1,597 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "mk_http_parser2.h"
+#include "mk_http_timing.h"
+
+/*
+ * Load generator
+ * ==============
+ *
+ * Closed loop HTTP/1.1 client for the reference servers (server.c) over
+ * loopback. Every connection sends a batch of depth pipelined requests
+ * taken in turn from the corpus, reads the depth responses with
+ * mk_http_response_parser() and sends the next batch. Threads own their
+ * connections and an epoll instance each.
+ *
+ * The segmentation profile decides how a batch reaches the socket:
+ *
+ *   whole:    as few writes as the socket takes
+ *   random:   pieces of 1 to max bytes (-m), one per connection per turn
+ *   trickle:  one byte per write
+ *
+ * so the split and trickle profiles drive the server parser through its
+ * PENDING path. A gap (-g) between two pieces of a batch makes sure they
+ * arrive as separate reads.
+ *
+ * Latency runs from the first byte of a request leaving to the end of its
+ * response, trickling included. Responses other than 2xx count as errors.
+ * The result is one key=value line, the latencies in microseconds.
+ *
+ * The corpus is built in, or read from a file (-f) of raw requests back to
+ * back; a body is taken along when the request has a Content-Length.
+ */
+#define LG_PORT         8080
+#define LG_CONNECTIONS  64
+#define LG_DEPTH_MAX    256
+#define LG_CORPUS_MAX   1024
+#define LG_IN_SIZE      65536
+#define LG_SEGMENT_MAX  128
+#define LG_EVENTS       256
+
+enum lg_profile {
+    LG_WHOLE = 0,
+    LG_RANDOM,
+    LG_TRICKLE,
+};
+
+static const char *lg_profiles[] = { "whole", "random", "trickle" };
+
+struct lg_config {
+    int port;
+    int threads;
+    int connections;
+    int depth;
+    int profile;
+    int segment_max;
+    long gap_ns;
+    double duration;
+    const char *label;
+};
+
+struct lg_request {
+    const char *data;
+    size_t len;
+};
+
+struct lg_conn {
+    int fd;
+    unsigned int next;              /* next corpus entry */
+    unsigned int seed;
+
+    char *out;                      /* batch being sent */
+    size_t out_len;
+    size_t out_pos;
+    size_t marks[LG_DEPTH_MAX];     /* start of each request in out */
+    unsigned long start[LG_DEPTH_MAX];
+    int started;                    /* requests whose first byte left */
+    int received;                   /* responses of the batch read */
+    unsigned long next_write;       /* not before, gap between pieces */
+
+    char in[LG_IN_SIZE];
+    size_t in_len;
+};
+
+struct lg_thread {
+    pthread_t tid;
+    int epfd;
+    int count;
+    struct lg_conn *conns;
+
+    unsigned long requests;
+    unsigned long errors;
+    unsigned long reconnects;
+    unsigned long bytes;
+    struct mk_histogram latency;
+};
+
+static struct lg_config config;
+static struct lg_request corpus[LG_CORPUS_MAX];
+static int corpus_count;
+static int lg_stop;
+
+static char c_small[] =
+    "GET / HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "\r\n";
+
+static char c_browser[] =
+    "GET /static/css/site.css?v=20141002 HTTP/1.1\r\n"
+    "Host: www.example.com:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:33.0) Gecko/20100101 Firefox/33.0\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Referer: http://www.example.com/index.html\r\n"
+    "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark; lang=en\r\n"
+    "Connection: keep-alive\r\n"
+    "If-Modified-Since: Thu, 02 Oct 2014 10:00:00 GMT\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "\r\n";
+
+static char c_api[] =
+    "GET /api/v1/users/1234/orders?limit=20&offset=40 HTTP/1.1\r\n"
+    "Host: api.example.com\r\n"
+    "Accept: application/json\r\n"
+    "Authorization: Bearer 0123456789abcdef\r\n"
+    "\r\n";
+
+static char c_post[] =
+    "POST /api/v1/events HTTP/1.1\r\n"
+    "Host: api.example.com\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 27\r\n"
+    "\r\n"
+    "{\"event\":\"click\",\"id\":1234}";
+
+static unsigned long lg_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void lg_corpus_add(const char *data, size_t len)
+{
+    if (corpus_count < LG_CORPUS_MAX) {
+        corpus[corpus_count].data = data;
+        corpus[corpus_count].len = len;
+        corpus_count++;
+    }
+}
+
+/* Split a file of raw requests, the buffer is kept for the whole run */
+static int lg_corpus_load(const char *path)
+{
+    FILE *f;
+    long size;
+    char *buf, *p, *end, *head_end, *cl;
+    unsigned long body;
+
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    buf = malloc(size + 1);
+    if (buf == NULL || fread(buf, 1, size, f) != (size_t) size) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    buf[size] = '\0';
+
+    p = buf;
+    end = buf + size;
+    while (p < end) {
+        head_end = memmem(p, end - p, "\r\n\r\n", 4);
+        if (head_end == NULL) {
+            break;
+        }
+        head_end += 4;
+        body = 0;
+        cl = memmem(p, head_end - p, "\r\nContent-Length:", 17);
+        if (cl != NULL) {
+            body = strtoul(cl + 17, NULL, 10);
+        }
+        if (body > (unsigned long) (end - head_end)) {
+            break;
+        }
+        lg_corpus_add(p, head_end + body - p);
+        p = head_end + body;
+    }
+
+    if (corpus_count == 0) {
+        fprintf(stderr, "%s: no complete request\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int lg_connect(struct lg_conn *conn, int epfd)
+{
+    int fd, on = 1;
+    struct sockaddr_in addr;
+    struct epoll_event ev;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = conn;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        close(fd);
+        return -1;
+    }
+    conn->fd = fd;
+    conn->in_len = 0;
+    return 0;
+}
+
+/* Lay the next depth requests of the corpus out in conn->out */
+static void lg_batch(struct lg_conn *conn)
+{
+    int i;
+    const struct lg_request *r;
+
+    conn->out_len = 0;
+    for (i = 0; i < config.depth; i++) {
+        r = &corpus[conn->next++ % corpus_count];
+        conn->marks[i] = conn->out_len;
+        memcpy(conn->out + conn->out_len, r->data, r->len);
+        conn->out_len += r->len;
+    }
+    conn->out_pos = 0;
+    conn->started = 0;
+    conn->received = 0;
+    conn->next_write = 0;
+}
+
+/* Write the next piece of the batch, -1 when the connection failed */
+static int lg_write(struct lg_thread *t, struct lg_conn *conn,
+        unsigned long now)
+{
+    size_t len = conn->out_len - conn->out_pos;
+    ssize_t n;
+
+    if (config.profile == LG_TRICKLE) {
+        len = 1;
+    }
+    else if (config.profile == LG_RANDOM) {
+        n = 1 + rand_r(&conn->seed) % config.segment_max;
+        if ((size_t) n < len) {
+            len = n;
+        }
+    }
+
+    n = send(conn->fd, conn->out + conn->out_pos, len, MSG_NOSIGNAL);
+    if (n == -1) {
+        return errno == EAGAIN ? 0 : -1;
+    }
+
+    conn->out_pos += n;
+    while (conn->started < config.depth &&
+           conn->marks[conn->started] < conn->out_pos) {
+        conn->start[conn->started++] = now;
+    }
+    t->bytes += n;
+    if (config.gap_ns) {
+        conn->next_write = now + config.gap_ns;
+    }
+    return 0;
+}
+
+/* Read and parse responses, -1 when the connection has to be replaced */
+static int lg_read(struct lg_thread *t, struct lg_conn *conn)
+{
+    int ret;
+    size_t used;
+    ssize_t n;
+    unsigned long now;
+    struct mk_http_upstream res;
+
+    n = recv(conn->fd, conn->in + conn->in_len,
+             sizeof(conn->in) - conn->in_len, 0);
+    if (n == 0 || (n == -1 && errno != EAGAIN)) {
+        return -1;
+    }
+    if (n == -1) {
+        return 0;
+    }
+    conn->in_len += n;
+    now = lg_now();
+
+    while (conn->in_len > 0) {
+        ret = mk_http_response_parser(&res, conn->in, conn->in_len, 0);
+        if (ret == MK_HTTP_PENDING) {
+            if (conn->in_len == sizeof(conn->in)) {
+                t->errors++;
+                return -1;
+            }
+            break;
+        }
+        if (ret != MK_HTTP_OK || conn->received >= conn->started) {
+            t->errors++;
+            return -1;
+        }
+
+        mk_histogram_record(&t->latency, now - conn->start[conn->received]);
+        conn->received++;
+        t->requests++;
+        if (res.status < 200 || res.status > 299) {
+            t->errors++;
+        }
+
+        used = mk_http_request_end(&res.info) - conn->in;
+        memmove(conn->in, conn->in + used, conn->in_len - used);
+        conn->in_len -= used;
+        if (!(res.info.connection & MK_CONN_KEEP_ALIVE)) {
+            return -1;
+        }
+    }
+
+    if (conn->received == config.depth) {
+        lg_batch(conn);
+    }
+    return 0;
+}
+
+static void lg_replace(struct lg_thread *t, struct lg_conn *conn)
+{
+    epoll_ctl(t->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->fd = -1;
+    t->reconnects++;
+    if (!__atomic_load_n(&lg_stop, __ATOMIC_RELAXED) &&
+            lg_connect(conn, t->epfd) == 0) {
+        lg_batch(conn);
+    }
+}
+
+static void *lg_thread_run(void *data)
+{
+    int i, n, timeout;
+    unsigned long now, wait;
+    struct lg_thread *t = data;
+    struct lg_conn *conn;
+    struct epoll_event events[LG_EVENTS];
+
+    while (!__atomic_load_n(&lg_stop, __ATOMIC_RELAXED)) {
+        /* One piece per connection with something to send */
+        now = lg_now();
+        wait = 100000000UL;
+        for (i = 0; i < t->count; i++) {
+            conn = &t->conns[i];
+            if (conn->fd == -1 || conn->out_pos == conn->out_len) {
+                continue;
+            }
+            if (conn->next_write > now) {
+                if (conn->next_write - now < wait) {
+                    wait = conn->next_write - now;
+                }
+                continue;
+            }
+            if (lg_write(t, conn, now)) {
+                t->errors++;
+                lg_replace(t, conn);
+                continue;
+            }
+            if (conn->out_pos < conn->out_len) {
+                wait = 0;
+            }
+        }
+
+        timeout = wait == 0 ? 0 : (int) ((wait + 999999) / 1000000);
+        n = epoll_wait(t->epfd, events, LG_EVENTS, timeout);
+        for (i = 0; i < n; i++) {
+            conn = events[i].data.ptr;
+            if (lg_read(t, conn)) {
+                lg_replace(t, conn);
+            }
+        }
+    }
+    return NULL;
+}
+
+static int lg_thread_init(struct lg_thread *t, int count)
+{
+    int i;
+    size_t out_size = 0;
+
+    for (i = 0; i < corpus_count; i++) {
+        if (corpus[i].len > out_size) {
+            out_size = corpus[i].len;
+        }
+    }
+    out_size *= config.depth;
+
+    memset(t, 0, sizeof(*t));
+    t->count = count;
+    t->epfd = epoll_create1(0);
+    t->conns = calloc(count, sizeof(*t->conns));
+    if (t->epfd == -1 || t->conns == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        t->conns[i].seed = i + 1;
+        t->conns[i].next = i;
+        t->conns[i].out = malloc(out_size);
+        if (t->conns[i].out == NULL ||
+                lg_connect(&t->conns[i], t->epfd)) {
+            perror("connect");
+            return -1;
+        }
+        lg_batch(&t->conns[i]);
+    }
+    return 0;
+}
+
+static void lg_usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-p port] [-t threads] [-c connections] [-d depth]\n"
+            "       [-s whole|random|trickle] [-m max piece] [-g gap us]\n"
+            "       [-D seconds] [-f corpus] [-l label]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    int i, opt;
+    double elapsed;
+    unsigned long begin;
+    struct timespec ts;
+    struct lg_thread *threads;
+    struct lg_thread total;
+
+    config.port = LG_PORT;
+    config.threads = 1;
+    config.connections = LG_CONNECTIONS;
+    config.depth = 1;
+    config.profile = LG_WHOLE;
+    config.segment_max = LG_SEGMENT_MAX;
+    config.duration = 5;
+    config.label = "-";
+
+    while ((opt = getopt(argc, argv, "p:t:c:d:s:m:g:D:f:l:h")) != -1) {
+        switch (opt) {
+        case 'p':
+            config.port = atoi(optarg);
+            break;
+        case 't':
+            config.threads = atoi(optarg);
+            break;
+        case 'c':
+            config.connections = atoi(optarg);
+            break;
+        case 'd':
+            config.depth = atoi(optarg);
+            break;
+        case 's':
+            for (i = 0; i < 3 && strcmp(optarg, lg_profiles[i]); i++);
+            config.profile = i;
+            break;
+        case 'm':
+            config.segment_max = atoi(optarg);
+            break;
+        case 'g':
+            config.gap_ns = atol(optarg) * 1000;
+            break;
+        case 'D':
+            config.duration = atof(optarg);
+            break;
+        case 'f':
+            if (lg_corpus_load(optarg)) {
+                return 1;
+            }
+            break;
+        case 'l':
+            config.label = optarg;
+            break;
+        default:
+            lg_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.threads < 1 || config.connections < config.threads ||
+            config.depth < 1 || config.depth > LG_DEPTH_MAX ||
+            config.profile > LG_TRICKLE || config.segment_max < 1 ||
+            config.duration <= 0) {
+        lg_usage(argv[0]);
+        return 1;
+    }
+
+    if (corpus_count == 0) {
+        lg_corpus_add(c_small, sizeof(c_small) - 1);
+        lg_corpus_add(c_browser, sizeof(c_browser) - 1);
+        lg_corpus_add(c_api, sizeof(c_api) - 1);
+        lg_corpus_add(c_post, sizeof(c_post) - 1);
+    }
+
+    threads = calloc(config.threads, sizeof(*threads));
+    if (threads == NULL) {
+        return 1;
+    }
+    for (i = 0; i < config.threads; i++) {
+        if (lg_thread_init(&threads[i],
+                           config.connections / config.threads +
+                           (i < config.connections % config.threads))) {
+            return 1;
+        }
+    }
+
+    begin = lg_now();
+    for (i = 0; i < config.threads; i++) {
+        pthread_create(&threads[i].tid, NULL, lg_thread_run, &threads[i]);
+    }
+    ts.tv_sec = (time_t) config.duration;
+    ts.tv_nsec = (config.duration - ts.tv_sec) * 1e9;
+    nanosleep(&ts, NULL);
+    __atomic_store_n(&lg_stop, 1, __ATOMIC_RELAXED);
+
+    memset(&total, 0, sizeof(total));
+    for (i = 0; i < config.threads; i++) {
+        pthread_join(threads[i].tid, NULL);
+        total.requests += threads[i].requests;
+        total.errors += threads[i].errors;
+        total.reconnects += threads[i].reconnects;
+        total.bytes += threads[i].bytes;
+        mk_histogram_merge(&total.latency, &threads[i].latency);
+    }
+    elapsed = (lg_now() - begin) / 1e9;
+
+    printf("loadgen label=%s profile=%s threads=%i connections=%i depth=%i "
+           "duration=%.2f requests=%lu errors=%lu reconnects=%lu "
+           "rps=%.0f mb_per_s=%.1f p50_us=%.1f p90_us=%.1f p99_us=%.1f "
+           "p999_us=%.1f max_us=%.1f\n",
+           config.label, lg_profiles[config.profile], config.threads,
+           config.connections, config.depth, elapsed, total.requests,
+           total.errors, total.reconnects, total.requests / elapsed,
+           total.bytes / elapsed / 1e6,
+           mk_histogram_percentile(&total.latency, 50) / 1e3,
+           mk_histogram_percentile(&total.latency, 90) / 1e3,
+           mk_histogram_percentile(&total.latency, 99) / 1e3,
+           mk_histogram_percentile(&total.latency, 99.9) / 1e3,
+           total.latency.max / 1e3);
+    return 0;
+}
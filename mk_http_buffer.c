@@ -0,0 +1,200 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+
+#include "mk_http_buffer.h"
+
+#define MK_ENDBLOCK "\r\n\r\n"
+
+static inline size_t mk_buffer_class_size(int class)
+{
+    return (size_t) MK_BUFFER_MIN << (2 * class);
+}
+
+void mk_buffer_pool_init(struct mk_buffer_pool *pool, int keep)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->keep = keep;
+}
+
+void mk_buffer_pool_destroy(struct mk_buffer_pool *pool)
+{
+    int i;
+    void *slab;
+
+    for (i = 0; i < MK_BUFFER_CLASSES; i++) {
+        while ((slab = pool->free[i]) != NULL) {
+            pool->free[i] = *(void **) slab;
+            free(slab);
+        }
+        pool->count[i] = 0;
+    }
+}
+
+static char *mk_buffer_slab_get(struct mk_buffer_pool *pool, int class)
+{
+    void *slab = pool->free[class];
+
+    if (slab == NULL) {
+        return malloc(mk_buffer_class_size(class));
+    }
+    pool->free[class] = *(void **) slab;
+    pool->count[class]--;
+    return slab;
+}
+
+static void mk_buffer_slab_put(struct mk_buffer_pool *pool, int class,
+        char *slab)
+{
+    if (pool->count[class] >= pool->keep) {
+        free(slab);
+        return;
+    }
+    *(void **) slab = pool->free[class];
+    pool->free[class] = slab;
+    pool->count[class]++;
+}
+
+void mk_buffer_rebase(struct mk_request *sr, const char *from, size_t len,
+        char *to)
+{
+    unsigned int i;
+    struct mk_request_info *info;
+    mk_pointer *views[10];
+
+    for (; sr != NULL; sr = sr->next) {
+        info = &sr->request;
+        views[0] = &info->method;
+        views[1] = &info->protocol;
+        views[2] = &info->uri;
+        views[3] = &info->path;
+        views[4] = &info->query;
+        views[5] = &info->scheme;
+        views[6] = &info->host;
+        views[7] = &info->port;
+        views[8] = &info->headers;
+        views[9] = &info->body;
+
+        for (i = 0; i < sizeof(views) / sizeof(views[0]); i++) {
+            if (views[i]->data >= from && views[i]->data <= from + len) {
+                views[i]->data = to + (views[i]->data - from);
+            }
+        }
+    }
+}
+
+/* Move the unconsumed bytes to the start of slab */
+static void mk_buffer_move(struct mk_buffer *buf, char *slab,
+        struct mk_request *pending)
+{
+    size_t live = buf->end - buf->start;
+
+    memmove(slab, buf->data + buf->start, live);
+    mk_buffer_rebase(pending, buf->data + buf->start, live, slab);
+    buf->scanned -= buf->start;
+    buf->end = live;
+    buf->start = 0;
+}
+
+char *mk_buffer_reserve(struct mk_buffer *buf, size_t min, size_t *avail,
+        struct mk_request *pending)
+{
+    int class;
+    char *slab;
+    size_t need;
+
+    /* Enough room left at the end, nothing moves */
+    if (buf->data != NULL && buf->size - buf->end >= min) {
+        goto done;
+    }
+
+    need = buf->end - buf->start + min;
+    if (buf->data != NULL && buf->start > 0 && need <= buf->size) {
+        mk_buffer_move(buf, buf->data, pending);
+        goto done;
+    }
+
+    for (class = buf->class + 1; class < MK_BUFFER_CLASSES; class++) {
+        if (mk_buffer_class_size(class) >= need) {
+            break;
+        }
+    }
+    if (class == MK_BUFFER_CLASSES) {
+        return NULL;
+    }
+    slab = mk_buffer_slab_get(buf->pool, class);
+    if (slab == NULL) {
+        return NULL;
+    }
+
+    if (buf->data != NULL) {
+        mk_buffer_move(buf, slab, pending);
+        mk_buffer_slab_put(buf->pool, buf->class, buf->data);
+    }
+    buf->data = slab;
+    buf->size = mk_buffer_class_size(class);
+    buf->class = class;
+
+done:
+    *avail = buf->size - buf->end;
+    return buf->data + buf->end;
+}
+
+int mk_buffer_head_ready(struct mk_buffer *buf)
+{
+    size_t from;
+    char *p;
+
+    if (buf->end == buf->start) {
+        return 0;
+    }
+    from = buf->scanned > buf->start + 3 ? buf->scanned - 3 : buf->start;
+    p = memmem(buf->data + from, buf->end - from,
+               MK_ENDBLOCK, sizeof(MK_ENDBLOCK) - 1);
+    if (p == NULL) {
+        buf->scanned = buf->end;
+        return 0;
+    }
+    buf->scanned = p - buf->data;
+    return 1;
+}
+
+void mk_buffer_consume(struct mk_buffer *buf, size_t len)
+{
+    buf->start += len;
+    if (buf->start >= buf->end) {
+        /* Nothing left, an idle connection holds no slab */
+        mk_buffer_release(buf);
+        return;
+    }
+    if (buf->scanned < buf->start) {
+        buf->scanned = buf->start;
+    }
+}
+
+void mk_buffer_release(struct mk_buffer *buf)
+{
+    if (buf->data != NULL) {
+        mk_buffer_slab_put(buf->pool, buf->class, buf->data);
+    }
+    mk_buffer_init(buf, buf->pool);
+}
@@ -0,0 +1,134 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_BUFFER_H
+#define MK_HTTP_BUFFER_H
+
+#include <stddef.h>
+
+#include "mk_http_parser2.h"
+
+/*
+ * Receive buffers
+ * ===============
+ *
+ * A connection reads into a struct mk_buffer and the parser runs over its
+ * unconsumed bytes. Storage comes from a pool of slabs in three size
+ * classes, 4, 16 and 64 KB: a buffer takes the smallest slab on its first
+ * read and moves to a larger class only when a request does not fit. The
+ * slab goes back to the pool whenever the buffer is empty, so idle
+ * keep-alive connections need hold no memory and slabs are reused
+ * between connections.
+ *
+ * Consumed requests only move the start offset. The unconsumed tail is
+ * moved to the front of the slab when the free room at the end drops
+ * under the space the next read asks for, and not on every read, so a
+ * pipelined burst costs at most one move per slab filled. Moves and
+ * growth rebase the views of the requests passed in, the caller rebases
+ * anything else pointing into the buffer.
+ *
+ * The parser is stateless, a partial request is parsed again from its
+ * start on the next call. mk_buffer_head_ready() keeps the offset where
+ * the search for the end of the head stopped, so the reads of a large or
+ * trickling head are not parsed at all until it is complete.
+ *
+ * A pool belongs to one thread, it has no locking.
+ */
+#define MK_BUFFER_CLASSES   (3)
+#define MK_BUFFER_MIN       (4096)                  /* smallest class */
+#define MK_BUFFER_MAX       (MK_BUFFER_MIN << 4)    /* 64 KB */
+
+struct mk_buffer_pool {
+    void *free[MK_BUFFER_CLASSES];      /* slabs chained through their head */
+    int count[MK_BUFFER_CLASSES];
+    int keep;                           /* free slabs kept per class */
+};
+
+struct mk_buffer {
+    char *data;             /* NULL when no slab is held */
+    size_t size;
+    int class;
+    size_t start;           /* first byte not consumed */
+    size_t end;             /* end of the bytes read */
+    size_t scanned;         /* end of head search resumes here */
+    struct mk_buffer_pool *pool;
+};
+
+void mk_buffer_pool_init(struct mk_buffer_pool *pool, int keep);
+void mk_buffer_pool_destroy(struct mk_buffer_pool *pool);
+
+static inline void mk_buffer_init(struct mk_buffer *buf,
+        struct mk_buffer_pool *pool)
+{
+    buf->data = NULL;
+    buf->size = 0;
+    buf->class = -1;
+    buf->start = 0;
+    buf->end = 0;
+    buf->scanned = 0;
+    buf->pool = pool;
+}
+
+/*
+ * Make room for at least min bytes after the data, compacting or growing
+ * the buffer and rebasing the chain of requests in pending (may be NULL).
+ * Returns where to read to and the room available in avail, NULL when a
+ * buffer of the largest class is full or no slab could be allocated.
+ */
+char *mk_buffer_reserve(struct mk_buffer *buf, size_t min, size_t *avail,
+        struct mk_request *pending);
+
+/* Account n bytes read at the pointer mk_buffer_reserve() returned */
+static inline void mk_buffer_commit(struct mk_buffer *buf, size_t n)
+{
+    buf->end += n;
+}
+
+/* Bytes not consumed yet, what the parser is given */
+static inline char *mk_buffer_data(const struct mk_buffer *buf)
+{
+    return buf->data + buf->start;
+}
+
+static inline size_t mk_buffer_len(const struct mk_buffer *buf)
+{
+    return buf->end - buf->start;
+}
+
+/*
+ * Whether the unconsumed bytes hold a complete request head, scanning only
+ * the bytes not searched by a previous call.
+ */
+int mk_buffer_head_ready(struct mk_buffer *buf);
+
+/*
+ * Consume len bytes of parsed requests, up to mk_http_request_end() of the
+ * last one handled. When no byte is left the slab goes back to the pool,
+ * views into the consumed bytes must not be used afterwards.
+ */
+void mk_buffer_consume(struct mk_buffer *buf, size_t len);
+
+/* Return the slab to the pool, dropping the bytes left if any */
+void mk_buffer_release(struct mk_buffer *buf);
+
+/* Move the views of a request chain that pointed into [from, from + len) */
+void mk_buffer_rebase(struct mk_request *sr, const char *from, size_t len,
+        char *to);
+
+#endif // MK_HTTP_BUFFER_H
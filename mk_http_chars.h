@@ -0,0 +1,381 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_CHARS_H
+#define MK_HTTP_CHARS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+/*
+ * Grammar validation mode
+ * =======================
+ *
+ * MK_HTTP_STRICT=1 (default): method, header names and header values are
+ * checked against the RFC 9110/9112 character classes while scanning.
+ *
+ * MK_HTTP_STRICT=0: only delimiters are looked for, as before.
+ *
+ * The checks run 16 bytes at a time with SSE2; building with SSSE3
+ * (-mssse3) lets tokens be classified with shuffles, which keeps strict
+ * mode close to the cost of the lenient scan.
+ */
+#ifndef MK_HTTP_STRICT
+#define MK_HTTP_STRICT 1
+#endif
+
+/*
+ * Character classes as 256-bit bitmaps, one bit per octet value. Bit
+ * (c & 63) of word (c >> 6) is set when the octet belongs to the class.
+ */
+
+/* tchar: "!#$%&'*+-.^_`|~" / DIGIT / ALPHA */
+static const uint64_t mk_char_tchar[4] = {
+    0x03ff6cfa00000000ULL, 0x57ffffffc7fffffeULL,
+    0x0000000000000000ULL, 0x0000000000000000ULL
+};
+
+/* field-vchar / SP / HTAB: VCHAR, obs-text and inner whitespace */
+static const uint64_t mk_char_field_value[4] = {
+    0xffffffff00000200ULL, 0x7fffffffffffffffULL,
+    0xffffffffffffffffULL, 0xffffffffffffffffULL
+};
+
+/* request-target: VCHAR, no whitespace, no controls */
+static const uint64_t mk_char_target[4] = {
+    0xfffffffe00000000ULL, 0x7fffffffffffffffULL,
+    0x0000000000000000ULL, 0x0000000000000000ULL
+};
+
+/* printed as is in a log line: VCHAR and SP but '"' and '\' */
+static const uint64_t mk_char_log_safe[4] = {
+    0xfffffffb00000000ULL, 0x7fffffffefffffffULL,
+    0x0000000000000000ULL, 0x0000000000000000ULL
+};
+
+static inline int mk_char_is(const uint64_t *class, unsigned char c)
+{
+    return (class[c >> 6] >> (c & 63)) & 1;
+}
+
+/* Return the first byte in [p, end) not belonging to class */
+static inline const char *mk_char_span(const uint64_t *class,
+        const char *p, const char *end)
+{
+    while (p < end && mk_char_is(class, (unsigned char) *p)) {
+        p++;
+    }
+    return p;
+}
+
+/*
+ * Word-at-a-time helpers, eight bytes per step. Both may report false
+ * positives on bytes following a real match, never false negatives, so a
+ * hit always falls back to the bitmap for the exact byte.
+ */
+#define MK_CHAR_ONES      0x0101010101010101ULL
+#define MK_CHAR_HIGHS     0x8080808080808080ULL
+#define mk_char_has_zero(w)     (((w) - MK_CHAR_ONES) & ~(w) & MK_CHAR_HIGHS)
+#define mk_char_has_less(w, n)  (((w) - MK_CHAR_ONES * (n)) & ~(w) & MK_CHAR_HIGHS)
+
+/*
+ * Span a header value: skip whole blocks holding no control byte (< 0x20
+ * or DEL), resolve everything else through the bitmap. The scan stops at
+ * the CR ending the line or at the first invalid byte, so locating the end
+ * of the value and validating it is a single pass.
+ */
+static inline const char *mk_char_span_value(const char *p, const char *end)
+{
+    uint64_t w;
+#ifdef __SSE2__
+    __m128i v, v2;
+    const __m128i ctl = _mm_set1_epi8(0x1f);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    unsigned int mask;
+#endif
+
+    for (;;) {
+#ifdef __SSE2__
+        while (end - p >= 32) {
+            v = _mm_loadu_si128((const __m128i *) p);
+            v2 = _mm_loadu_si128((const __m128i *) (p + 16));
+            mask = _mm_movemask_epi8(
+                    _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, ctl), v),
+                                 _mm_cmpeq_epi8(v, del))) |
+                   (unsigned int) _mm_movemask_epi8(
+                    _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v2, ctl), v2),
+                                 _mm_cmpeq_epi8(v2, del))) << 16;
+            if (mask) {
+                p += __builtin_ctz(mask);
+                goto found;
+            }
+            p += 32;
+        }
+        if (end - p >= 16) {
+            v = _mm_loadu_si128((const __m128i *) p);
+            mask = _mm_movemask_epi8(
+                    _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, ctl), v),
+                                 _mm_cmpeq_epi8(v, del)));
+            if (mask) {
+                p += __builtin_ctz(mask);
+                goto found;
+            }
+            p += 16;
+        }
+#endif
+        while (end - p >= 8) {
+            memcpy(&w, p, sizeof(w));
+            if (mk_char_has_less(w, 0x20) ||
+                    mk_char_has_zero(w ^ (MK_CHAR_ONES * 0x7f))) {
+                break;
+            }
+            p += 8;
+        }
+#ifdef __SSE2__
+found:
+#endif
+        if (p == end || !mk_char_is(mk_char_field_value, (unsigned char) *p)) {
+            return p;
+        }
+        p++;
+    }
+}
+
+/*
+ * Span a token (tchar), 16 bytes per step. With SSSE3 each byte is looked
+ * up by nibble in two shuffle tables: the low nibble selects the set of
+ * valid high nibbles, a byte is a tchar when its high nibble is in it.
+ * Plain SSE2 tests VCHAR as a signed range and then the delimiters
+ * "(),/:;<=>?@[\]{} it excludes.
+ */
+static inline const char *mk_char_span_tchar(const char *p, const char *end)
+{
+#if defined(__SSSE3__)
+    const __m128i lo_set = _mm_setr_epi8(
+            0xe8, 0xfc, 0xf8, 0xfc, 0xfc, 0xfc, 0xfc, 0xfc,
+            0xf8, 0xf8, 0xf4, 0x54, 0xd0, 0x54, 0xf4, 0x70);
+    const __m128i hi_bit = _mm_setr_epi8(
+            0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+            0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    __m128i v, lo, hi;
+    int mask;
+
+    while (end - p >= 16) {
+        v = _mm_loadu_si128((const __m128i *) p);
+        lo = _mm_shuffle_epi8(lo_set, _mm_and_si128(v, nibble));
+        hi = _mm_shuffle_epi8(hi_bit,
+                              _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi),
+                                                _mm_setzero_si128()));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#elif defined(__SSE2__)
+    __m128i v, bad;
+    int mask;
+
+    while (end - p >= 16) {
+        v = _mm_loadu_si128((const __m128i *) p);
+        /* outside 0x21-0x7e, bytes over 0x7f are negative */
+        bad = _mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(0x21)),
+                           _mm_cmpgt_epi8(v, _mm_set1_epi8(0x7e)));
+        /* ( ) and : ; < = > ? @ and [ \ ] */
+        bad = _mm_or_si128(bad, _mm_and_si128(
+                  _mm_cmpgt_epi8(v, _mm_set1_epi8(0x27)),
+                  _mm_cmplt_epi8(v, _mm_set1_epi8(0x2a))));
+        bad = _mm_or_si128(bad, _mm_and_si128(
+                  _mm_cmpgt_epi8(v, _mm_set1_epi8(0x39)),
+                  _mm_cmplt_epi8(v, _mm_set1_epi8(0x41))));
+        bad = _mm_or_si128(bad, _mm_and_si128(
+                  _mm_cmpgt_epi8(v, _mm_set1_epi8(0x5a)),
+                  _mm_cmplt_epi8(v, _mm_set1_epi8(0x5e))));
+        bad = _mm_or_si128(bad, _mm_or_si128(
+                  _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                               _mm_cmpeq_epi8(v, _mm_set1_epi8(','))),
+                  _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('/')),
+                               _mm_cmpeq_epi8(v, _mm_set1_epi8('{')))));
+        bad = _mm_or_si128(bad, _mm_cmpeq_epi8(v, _mm_set1_epi8('}')));
+        mask = _mm_movemask_epi8(bad);
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    return mk_char_span(mk_char_tchar, p, end);
+}
+
+/* Span a request-target, any VCHAR, a block at a time */
+static inline const char *mk_char_span_target(const char *p, const char *end)
+{
+    uint64_t w;
+#ifdef __SSE2__
+    __m128i v;
+    int mask;
+
+    while (end - p >= 16) {
+        v = _mm_loadu_si128((const __m128i *) p);
+        mask = _mm_movemask_epi8(
+                _mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(0x21)),
+                             _mm_cmpgt_epi8(v, _mm_set1_epi8(0x7e))));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (end - p >= 8) {
+        memcpy(&w, p, sizeof(w));
+        if ((w & MK_CHAR_HIGHS) || mk_char_has_less(w, 0x21) ||
+                mk_char_has_zero(w ^ (MK_CHAR_ONES * 0x7f))) {
+            break;
+        }
+        p += 8;
+    }
+    return mk_char_span(mk_char_target, p, end);
+}
+
+/*
+ * Span a header line: the field-name as a token, then from the ':' after
+ * it the field value, see mk_char_span_value(). The block holding the ':'
+ * is classified once for both. *name_end is the first byte past the
+ * name; when it is not a ':' it is also the return value.
+ */
+static inline const char *mk_char_span_field(const char *p, const char *end,
+        const char **name_end)
+{
+#if defined(__SSSE3__)
+    const __m128i lo_set = _mm_setr_epi8(
+            0xe8, 0xfc, 0xf8, 0xfc, 0xfc, 0xfc, 0xfc, 0xfc,
+            0xf8, 0xf8, 0xf4, 0x54, 0xd0, 0x54, 0xf4, 0x70);
+    const __m128i hi_bit = _mm_setr_epi8(
+            0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+            0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    __m128i v, lo, hi;
+    int mask, k;
+
+    while (end - p >= 16) {
+        v = _mm_loadu_si128((const __m128i *) p);
+        lo = _mm_shuffle_epi8(lo_set, _mm_and_si128(v, nibble));
+        hi = _mm_shuffle_epi8(hi_bit,
+                              _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi),
+                                                _mm_setzero_si128()));
+        if (mask == 0) {
+            p += 16;
+            continue;
+        }
+
+        k = __builtin_ctz(mask);
+        *name_end = p + k;
+        if (p[k] != ':') {
+            return p + k;
+        }
+        /* Controls and DEL after the ':' in the same block */
+        mask = _mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1f)), v),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)))) >> (k + 1);
+        if (mask == 0) {
+            return mk_char_span_value(p + 16, end);
+        }
+        p += k + 1 + __builtin_ctz(mask);
+        if (*p != '\t') {
+            return p;
+        }
+        return mk_char_span_value(p + 1, end);
+    }
+#endif
+    *name_end = mk_char_span_tchar(p, end);
+    if (*name_end == end || **name_end != ':') {
+        return *name_end;
+    }
+    return mk_char_span_value(*name_end + 1, end);
+}
+
+/*
+ * Span bytes a log line takes as is, see mk_char_log_safe. Request fields
+ * rarely need escaping, so whole blocks are checked first.
+ */
+static inline const char *mk_char_span_log(const char *p, const char *end)
+{
+    uint64_t w;
+
+    while (end - p >= 8) {
+        memcpy(&w, p, sizeof(w));
+        if ((w & MK_CHAR_HIGHS) || mk_char_has_less(w, 0x20) ||
+                mk_char_has_zero(w ^ (MK_CHAR_ONES * 0x7f)) ||
+                mk_char_has_zero(w ^ (MK_CHAR_ONES * '"')) ||
+                mk_char_has_zero(w ^ (MK_CHAR_ONES * '\\'))) {
+            break;
+        }
+        p += 8;
+    }
+    return mk_char_span(mk_char_log_safe, p, end);
+}
+
+/*
+ * First '%' or '+' in [p, end), end when the bytes need no decoding. Form
+ * data is mostly plain, so this runs over whole blocks and the decoder
+ * does not touch a field until it finds something.
+ */
+static inline const char *mk_char_find_escape(const char *p, const char *end)
+{
+    uint64_t w;
+#ifdef __SSE2__
+    __m128i v;
+    const __m128i pct = _mm_set1_epi8('%');
+    const __m128i plus = _mm_set1_epi8('+');
+    int mask;
+
+    while (end - p >= 16) {
+        v = _mm_loadu_si128((const __m128i *) p);
+        mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, pct),
+                                              _mm_cmpeq_epi8(v, plus)));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (end - p >= 8) {
+        memcpy(&w, p, sizeof(w));
+        if (mk_char_has_zero(w ^ (MK_CHAR_ONES * '%')) ||
+                mk_char_has_zero(w ^ (MK_CHAR_ONES * '+'))) {
+            break;
+        }
+        p += 8;
+    }
+    while (p < end && *p != '%' && *p != '+') {
+        p++;
+    }
+    return p;
+}
+
+#endif // MK_HTTP_CHARS_H
@@ -0,0 +1,150 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string.h>
+
+#include "mk_http_cookie.h"
+#include "mk_http_hash.h"
+
+#define MK_COOKIE_HEADER_MAX  (65535)
+
+static inline int cookie_ows(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+/*
+ * Find the slot of name. Returns the slot holding it, or the free slot
+ * where it would go.
+ */
+static unsigned int cookie_slot(const struct mk_cookie_jar *jar,
+        const char *name, size_t len, uint64_t hash)
+{
+    const struct mk_cookie *c;
+    unsigned int slot = hash & (MK_COOKIE_SLOTS - 1);
+    uint16_t tag = hash >> 48;
+    int i;
+
+    while (jar->slots[slot] != 0) {
+        i = jar->slots[slot] - 1;
+        c = &jar->cookies[i];
+        if (jar->tags[i] == tag && c->name_len == len &&
+                !memcmp(jar->header + c->name, name, len)) {
+            break;
+        }
+        slot = (slot + 1) & (MK_COOKIE_SLOTS - 1);
+    }
+    return slot;
+}
+
+/* cookie-pair *( ";" SP cookie-pair ), tolerant about whitespace */
+static void cookie_split(struct mk_cookie_jar *jar)
+{
+    const char *value, *p, *end, *pair_end, *eq, *name_end, *v, *v_end;
+    size_t len;
+    uint64_t hash;
+    unsigned int slot;
+    struct mk_cookie *c;
+
+    jar->count = 0;
+    memset(jar->slots, 0, sizeof(jar->slots));
+
+    if (mk_http_request_header(jar->info, "Cookie", &value, &len) != 0 ||
+            len > MK_COOKIE_HEADER_MAX) {
+        return;
+    }
+    jar->header = value;
+
+    p = value;
+    end = value + len;
+    while (p < end && jar->count < MK_COOKIE_MAX) {
+        while (p < end && (cookie_ows(*p) || *p == ';')) {
+            p++;
+        }
+        pair_end = memchr(p, ';', end - p);
+        if (pair_end == NULL) {
+            pair_end = end;
+        }
+
+        eq = memchr(p, '=', pair_end - p);
+        if (eq == NULL) {
+            p = pair_end;
+            continue;
+        }
+        for (name_end = eq; name_end > p && cookie_ows(name_end[-1]); name_end--);
+        if (name_end == p) {
+            p = pair_end;
+            continue;
+        }
+
+        for (v = eq + 1; v < pair_end && cookie_ows(*v); v++);
+        for (v_end = pair_end; v_end > v && cookie_ows(v_end[-1]); v_end--);
+        if (v_end - v >= 2 && *v == '"' && v_end[-1] == '"') {
+            v++;
+            v_end--;
+        }
+
+        hash = mk_hash64(p, name_end - p, 0);
+        slot = cookie_slot(jar, p, name_end - p, hash);
+        if (jar->slots[slot] == 0) {
+            c = &jar->cookies[jar->count];
+            c->name = p - value;
+            c->name_len = name_end - p;
+            c->value = v - value;
+            c->value_len = v_end - v;
+            jar->tags[jar->count] = hash >> 48;
+            jar->slots[slot] = ++jar->count;
+        }
+        p = pair_end;
+    }
+}
+
+int mk_cookie_get(struct mk_cookie_jar *jar, const char *name, size_t len,
+        mk_pointer *value)
+{
+    const struct mk_cookie *c;
+    unsigned int slot;
+
+    if (jar->count < 0) {
+        cookie_split(jar);
+    }
+    if (jar->count == 0) {
+        return -1;
+    }
+
+    slot = cookie_slot(jar, name, len, mk_hash64(name, len, 0));
+    if (jar->slots[slot] == 0) {
+        return -1;
+    }
+
+    c = &jar->cookies[jar->slots[slot] - 1];
+    if (value != NULL) {
+        value->data = (char *) jar->header + c->value;
+        value->len = c->value_len;
+    }
+    return 0;
+}
+
+int mk_cookie_count(struct mk_cookie_jar *jar)
+{
+    if (jar->count < 0) {
+        cookie_split(jar);
+    }
+    return jar->count;
+}
@@ -0,0 +1,78 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_COOKIE_H
+#define MK_HTTP_COOKIE_H
+
+#include <stdint.h>
+
+#include "mk_http_parser2.h"
+
+/*
+ * Cookie jar
+ * ==========
+ *
+ * Lazy view of the Cookie header of a parsed request. Setting it up costs
+ * nothing: the header is looked up and split on the first access only,
+ * into an index of (name, value) ranges held in the jar itself, so it
+ * lives wherever the caller keeps per request state. Later lookups hash
+ * the name and compare one cookie, the header bytes are not scanned
+ * again.
+ *
+ * Ranges are 16-bit offsets into the header value, a Cookie header over
+ * 64 KB is treated as empty. A name repeated keeps its first value, the
+ * most specific one per RFC 6265, and cookies past MK_COOKIE_MAX are
+ * ignored. Quotes around a value are dropped, nothing is decoded.
+ */
+#define MK_COOKIE_MAX    (64)
+#define MK_COOKIE_SLOTS  (128)     /* power of two, twice the cookies */
+
+struct mk_cookie {
+    uint16_t name;          /* offsets and lengths in the header value */
+    uint16_t name_len;
+    uint16_t value;
+    uint16_t value_len;
+};
+
+struct mk_cookie_jar {
+    const struct mk_request_info *info;
+    const char *header;             /* Cookie value once split */
+    int count;                      /* -1 until the first access */
+
+    uint16_t tags[MK_COOKIE_MAX];   /* high hash bits of each name */
+    struct mk_cookie cookies[MK_COOKIE_MAX];
+    unsigned char slots[MK_COOKIE_SLOTS];   /* cookie index + 1, 0 if free */
+};
+
+static inline void mk_cookie_jar_init(struct mk_cookie_jar *jar,
+        const struct mk_request_info *info)
+{
+    jar->info = info;
+    jar->header = NULL;
+    jar->count = -1;
+}
+
+/* Value of cookie name, returns 0 when found, -1 otherwise */
+int mk_cookie_get(struct mk_cookie_jar *jar, const char *name, size_t len,
+        mk_pointer *value);
+
+/* Number of distinct cookies */
+int mk_cookie_count(struct mk_cookie_jar *jar);
+
+#endif // MK_HTTP_COOKIE_H
@@ -0,0 +1,82 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_DEBUG_H
+#define MK_HTTP_DEBUG_H
+
+#include <stdio.h>
+
+#include "mk_http_parser.h"
+
+/* Field tracing of engine 1, only built into the standalone tests */
+
+static inline void p_field(mk_http_request_t *req, char *buffer)
+{
+    int i;
+
+    printf("'");
+    for (i = req->start; i < req->end; i++) {
+        printf("%c", buffer[i]);
+    }
+    printf("'");
+
+}
+
+static inline int eval_field(mk_http_request_t *req, char *buffer)
+{
+    if (req->level == REQ_LEVEL_FIRST) {
+        printf("[ \033[35mfirst level\033[0m ] ");
+    }
+    else {
+        printf("[   \033[36mheaders\033[0m   ] ");
+    }
+
+    printf(" ");
+    switch (req->status) {
+    case MK_ST_REQ_METHOD:
+        printf("MK_ST_REQ_METHOD       : ");
+        break;
+    case MK_ST_REQ_URI:
+        printf("MK_ST_REQ_URI          : ");
+        break;
+    case MK_ST_REQ_QUERY_STRING:
+        printf("MK_ST_REQ_QUERY_STRING : ");
+        break;
+    case MK_ST_REQ_PROT_VERSION:
+        printf("MK_ST_REQ_PROT_VERSION : ");
+        break;
+    case MK_ST_HEADER_KEY:
+        printf("MK_ST_HEADER_KEY       : ");
+        break;
+    case MK_ST_HEADER_VAL_STARTS:
+        printf("MK_ST_HEADER_VAL_STARTS: ");
+        break;
+    default:
+        printf("\033[31mUNKNOWN UNKNOWN\033[0m       : ");
+        break;
+    };
+
+
+    p_field(req, buffer);
+    printf("\n");
+
+    return 0;
+}
+
+#endif // MK_HTTP_DEBUG_H
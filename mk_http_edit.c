@@ -0,0 +1,253 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "mk_http_edit.h"
+#include "mk_http_scan.h"
+
+#define MK_CRLF "\r\n"
+
+/* Lines never straddle the gap, it always sits on a line boundary */
+static inline char *ed_phys(struct mk_header_editor *ed, size_t off)
+{
+    return ed->buf + (off < ed->gap_start ? off : off + ed->gap_len);
+}
+
+static inline size_t ed_logical(struct mk_header_editor *ed, char *p)
+{
+    if (p < ed->buf + ed->gap_start) {
+        return p - ed->buf;
+    }
+    return p - ed->buf - ed->gap_len;
+}
+
+static void ed_move_gap(struct mk_header_editor *ed, size_t pos)
+{
+    if (ed->gap_len == 0) {
+        /* nothing to carry, the common case after a longer value */
+    }
+    else if (pos < ed->gap_start) {
+        memmove(ed->buf + pos + ed->gap_len, ed->buf + pos,
+                ed->gap_start - pos);
+    }
+    else if (pos > ed->gap_start) {
+        memmove(ed->buf + ed->gap_start,
+                ed->buf + ed->gap_start + ed->gap_len,
+                pos - ed->gap_start);
+    }
+    ed->gap_start = pos;
+}
+
+/* Find the first line named name starting at or after the line at from */
+static int ed_find(struct mk_header_editor *ed,
+        const char *name, size_t name_len, size_t from,
+        size_t *start, size_t *len)
+{
+    int seg;
+    size_t lo, hi;
+    char *p, *end, *eol, *next;
+
+    for (seg = 0; seg < 2; seg++) {
+        lo = seg == 0 ? 0 : ed->gap_start;
+        hi = seg == 0 ? ed->gap_start : ed->len;
+        if (from > lo) {
+            lo = from;
+        }
+        if (lo >= hi) {
+            continue;
+        }
+
+        p = ed_phys(ed, lo);
+        end = p + (hi - lo);
+        while (p < end) {
+            eol = memchr(p, '\n', end - p);
+            next = eol ? eol + 1 : end;
+            if ((size_t) (next - p) > name_len && p[name_len] == ':' &&
+                    !strncasecmp(p, name, name_len)) {
+                *start = ed_logical(ed, p);
+                *len = next - p;
+                return 0;
+            }
+            p = next;
+        }
+    }
+
+    return -1;
+}
+
+static char *ed_write_line(char *p,
+        const char *name, size_t name_len,
+        const char *value, size_t value_len)
+{
+    memcpy(p, name, name_len);
+    p += name_len;
+    *p++ = ':';
+    *p++ = ' ';
+    memcpy(p, value, value_len);
+    p += value_len;
+    memcpy(p, MK_CRLF, 2);
+    return p + 2;
+}
+
+/*
+ * Replace the line [pos, pos + old_len) by "name: value\r\n", or drop it
+ * when name is NULL, keeping the quick header offsets in line. A quick
+ * header written here is the one the index points to.
+ */
+static int ed_put(struct mk_header_editor *ed, size_t pos, size_t old_len,
+        const char *name, size_t name_len,
+        const char *value, size_t value_len)
+{
+    int i, id;
+    long delta;
+    size_t new_len, extra, tail;
+    struct mk_quick_header *q;
+
+    /* Room for the blank line is kept for the commit */
+    new_len = name ? name_len + value_len + 4 : 0;
+    if (ed->len - old_len + new_len > ed->size - (sizeof(MK_CRLF) - 1)) {
+        return -1;
+    }
+
+    for (i = 0; i < MK_QUICK_HEADER_COUNT; i++) {
+        q = &ed->info->quick_headers[i];
+        if (q->value_len && q->value_index >= pos &&
+                q->value_index < pos + old_len) {
+            q->value_index = 0;
+            q->value_len = 0;
+        }
+    }
+
+    if (new_len > 0 && new_len == old_len) {
+        ed_write_line(ed_phys(ed, pos), name, name_len, value, value_len);
+    }
+    else {
+        ed_move_gap(ed, pos + old_len);
+        ed->gap_start = pos;
+        ed->gap_len += old_len;
+        if (new_len > ed->gap_len) {
+            /* Open only the room missing, the lines after it move once */
+            extra = new_len - ed->gap_len;
+            tail = ed->len - (pos + old_len);
+            memmove(ed->buf + pos + ed->gap_len + extra,
+                    ed->buf + pos + ed->gap_len, tail);
+            ed->gap_len += extra;
+        }
+        if (name) {
+            ed_write_line(ed->buf + pos, name, name_len, value, value_len);
+        }
+        ed->gap_start += new_len;
+        ed->gap_len -= new_len;
+        ed->len = ed->len + new_len - old_len;
+
+        delta = (long) new_len - (long) old_len;
+        for (i = 0; i < MK_QUICK_HEADER_COUNT; i++) {
+            q = &ed->info->quick_headers[i];
+            if (q->value_len && q->value_index >= pos + old_len) {
+                q->value_index += delta;
+            }
+        }
+    }
+
+    if (name) {
+        id = mk_http_scan_header_id(name, name_len);
+        if (id >= 0) {
+            ed->info->quick_headers[id].value_index = pos + name_len + 2;
+            ed->info->quick_headers[id].value_len = value_len;
+        }
+    }
+    return 0;
+}
+
+int mk_header_editor_init(struct mk_header_editor *ed,
+        struct mk_request_info *info,
+        char *buf, size_t size)
+{
+    size_t len = info->headers.len;
+
+    if (size < len + sizeof(MK_CRLF) - 1) {
+        return -1;
+    }
+    if (buf != info->headers.data) {
+        memmove(buf, info->headers.data, len);
+        info->headers.data = buf;
+    }
+
+    ed->info = info;
+    ed->buf = buf;
+    ed->size = size;
+    ed->len = len;
+    ed->gap_start = len;
+    ed->gap_len = 0;
+    return 0;
+}
+
+int mk_header_set(struct mk_header_editor *ed,
+        const char *name, size_t name_len,
+        const char *value, size_t value_len)
+{
+    size_t start, len;
+
+    if (ed_find(ed, name, name_len, 0, &start, &len)) {
+        return mk_header_append(ed, name, name_len, value, value_len);
+    }
+    if (ed_put(ed, start, len, name, name_len, value, value_len)) {
+        return -1;
+    }
+
+    /* A repeat would be read back instead of the new value */
+    start += name_len + value_len + 4;
+    while (!ed_find(ed, name, name_len, start, &start, &len)) {
+        ed_put(ed, start, len, NULL, 0, NULL, 0);
+    }
+    return 0;
+}
+
+int mk_header_append(struct mk_header_editor *ed,
+        const char *name, size_t name_len,
+        const char *value, size_t value_len)
+{
+    return ed_put(ed, ed->len, 0, name, name_len, value, value_len);
+}
+
+int mk_header_remove(struct mk_header_editor *ed,
+        const char *name, size_t name_len)
+{
+    int count = 0;
+    size_t start = 0, len;
+
+    while (!ed_find(ed, name, name_len, start, &start, &len)) {
+        ed_put(ed, start, len, NULL, 0, NULL, 0);
+        count++;
+    }
+    return count;
+}
+
+int mk_header_editor_commit(struct mk_header_editor *ed)
+{
+    ed_move_gap(ed, ed->len);
+    memcpy(ed->buf + ed->len, MK_CRLF, sizeof(MK_CRLF) - 1);
+
+    ed->info->headers.data = ed->buf;
+    ed->info->headers.len = ed->len;
+    return 0;
+}
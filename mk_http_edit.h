@@ -0,0 +1,82 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_EDIT_H
+#define MK_HTTP_EDIT_H
+
+#include "mk_http_parser2.h"
+
+/*
+ * Header editor
+ * =============
+ *
+ * Edits the header block of a parsed request in place. The block lives in
+ * an edit area with a gap, which only holds the room edits left behind: a
+ * shorter line or a removal turns its bytes into gap, a longer line takes
+ * from the gap and moves the lines after it once, by the room still
+ * missing. An edit moves the gap to the line it touches, so a run of edits
+ * close to each other costs the size of the changes. Replacing a value by
+ * one of the same length is written in place, and a single longer value
+ * costs one move of the lines after it, the commit then has no gap to
+ * close.
+ *
+ * The edit area is either the connection buffer itself, when the bytes
+ * after the header block are free (no body, nothing pipelined), or any
+ * caller buffer the block is copied to once. Offsets in quick_headers are
+ * kept valid across edits; info->headers can be read again, through the
+ * parser lookups, after mk_header_editor_commit() closed the gap.
+ */
+struct mk_header_editor {
+    struct mk_request_info *info;
+    char *buf;
+    size_t size;
+
+    size_t len;         /* bytes of header lines */
+    size_t gap_start;
+    size_t gap_len;
+};
+
+int mk_header_editor_init(struct mk_header_editor *ed,
+        struct mk_request_info *info,
+        char *buf, size_t size);
+
+/*
+ * Replace the first header named name and remove its repeats, append it
+ * when missing.
+ */
+int mk_header_set(struct mk_header_editor *ed,
+        const char *name, size_t name_len,
+        const char *value, size_t value_len);
+
+/* Add a header after the existing ones */
+int mk_header_append(struct mk_header_editor *ed,
+        const char *name, size_t name_len,
+        const char *value, size_t value_len);
+
+/* Remove every header named name, returns how many were removed */
+int mk_header_remove(struct mk_header_editor *ed,
+        const char *name, size_t name_len);
+
+/*
+ * Close the gap and terminate the block with a blank line, info->headers
+ * then points to the edited block. Editing can go on afterwards.
+ */
+int mk_header_editor_commit(struct mk_header_editor *ed);
+
+#endif // MK_HTTP_EDIT_H
@@ -0,0 +1,181 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_EVENTS_H
+#define MK_HTTP_EVENTS_H
+
+#include <limits.h>
+
+#include "mk_http_parser2.h"
+#include "mk_http_scan.h"
+
+/*
+ * Callback parsing
+ * ================
+ *
+ * Drives the scanner over one request and reports each piece through a
+ * hook instead of filling a struct mk_request_info, so nothing is stored
+ * per request. Every hook is optional and a non zero return stops the
+ * parser, which then returns MK_HTTP_STOPPED.
+ *
+ * On_uri gets the request-target as sent, whatever its form. On_header
+ * gets the quick header id of the name (MK_HEADER_OTHER when not
+ * indexed) and the value without surrounding whitespace. On_body gets the
+ * part of the Content-Length body present in the buffer. The body is
+ * framed by a single Content-Length: a request carrying Transfer-Encoding,
+ * or an empty, repeated or overflowing Content-Length, is MK_HTTP_ERROR.
+ *
+ * The parser returns the length of the request once it is complete, so a
+ * pipelined request starts right after it, or MK_HTTP_PENDING and
+ * MK_HTTP_ERROR. Like mk_http_parser() it does not keep state between
+ * calls: after MK_HTTP_PENDING, the next call starts over and the hooks see
+ * the same pieces again.
+ */
+struct mk_http_callbacks {
+    int (*on_method)(void *data, const char *method, size_t len);
+    int (*on_uri)(void *data, const char *uri, size_t len);
+    int (*on_header)(void *data, int name_id,
+                     const char *name, size_t name_len,
+                     const char *value, size_t value_len);
+    int (*on_headers_complete)(void *data);
+    int (*on_body)(void *data, const char *body, size_t len);
+};
+
+/* Generic entry point, hooks are called through the pointers */
+int mk_http_parser_events(const struct mk_http_callbacks *cb, void *data,
+        char *buffer, size_t length);
+
+/*
+ * Define a parser specialized for a constant callbacks table:
+ *
+ *     static const struct mk_http_callbacks filter_cb = { ... };
+ *     MK_HTTP_PARSER_CALLBACKS(filter_parse, filter_cb)
+ *
+ * filter_parse(data, buffer, length) then calls the hooks directly, they
+ * can be inlined and the unset ones disappear.
+ */
+#define MK_HTTP_PARSER_CALLBACKS(name, callbacks)                       \
+    static int name(void *data, char *buffer, size_t length)            \
+    {                                                                   \
+        return mk_http_events_run(&(callbacks), data, buffer, length);  \
+    }
+
+#define mk_http_event(cb, hook, ...)                                    \
+    ((cb)->hook != NULL && (cb)->hook(__VA_ARGS__) != 0)
+
+static inline __attribute__((always_inline))
+int mk_http_events_run(const struct mk_http_callbacks *cb, void *data,
+        char *buffer, size_t length)
+{
+    char *end = buffer + length;
+    char *p, *colon, *eol, *value, *value_end, *digit;
+    mk_pointer method, uri, protocol;
+    unsigned long content_length = 0;
+    size_t body_len;
+    int id, framed = 0;
+
+    if (memchr(buffer, '\n', length) == NULL) {
+        return MK_HTTP_PENDING;
+    }
+
+    p = mk_http_scan_request_line(buffer, end, &method, &uri, &protocol);
+    if (p == NULL) {
+        return MK_HTTP_ERROR;
+    }
+    if (mk_http_event(cb, on_method, data, method.data, method.len) ||
+            mk_http_event(cb, on_uri, data, uri.data, uri.len)) {
+        return MK_HTTP_STOPPED;
+    }
+
+    for (;;) {
+        if (mk_http_scan_header_line(p, end, &colon, &eol)) {
+            return MK_HTTP_ERROR;
+        }
+        if (eol == NULL) {
+            return MK_HTTP_PENDING;
+        }
+
+        if (colon == NULL) {
+            /* Only the blank line ending the block has no colon */
+            if (eol - p > 1 || (eol - p == 1 && *p != '\r')) {
+                return MK_HTTP_ERROR;
+            }
+            p = eol + 1;
+            break;
+        }
+
+        value = colon + 1;
+        value_end = eol;
+        while (value < value_end && (*value == ' ' || *value == '\t')) {
+            value++;
+        }
+        while (value_end > value &&
+               (value_end[-1] == '\r' || value_end[-1] == ' ' ||
+                value_end[-1] == '\t')) {
+            value_end--;
+        }
+
+        id = mk_http_scan_header_id(p, colon - p);
+        if (id == MK_HEADER_CONTENT_LENGTH) {
+            if (framed || value == value_end) {
+                return MK_HTTP_ERROR;
+            }
+            framed = 1;
+            for (digit = value; digit < value_end; digit++) {
+                if (!isdigit((unsigned char) *digit) ||
+                        content_length > (ULONG_MAX - 9) / 10) {
+                    return MK_HTTP_ERROR;
+                }
+                content_length = content_length * 10 + (*digit - '0');
+            }
+        }
+        else if (id == MK_HEADER_TRANSFER_ENCODING) {
+            /* A chunked body would be taken for the next request */
+            return MK_HTTP_ERROR;
+        }
+
+        if (mk_http_event(cb, on_header, data, id, p, colon - p,
+                          value, value_end - value)) {
+            return MK_HTTP_STOPPED;
+        }
+        p = eol + 1;
+    }
+
+    if (mk_http_event(cb, on_headers_complete, data)) {
+        return MK_HTTP_STOPPED;
+    }
+
+    if (content_length > 0) {
+        body_len = end - p;
+        if (body_len > content_length) {
+            body_len = content_length;
+        }
+        if (body_len > 0 && mk_http_event(cb, on_body, data, p, body_len)) {
+            return MK_HTTP_STOPPED;
+        }
+        if (body_len < content_length) {
+            return MK_HTTP_PENDING;
+        }
+        p += content_length;
+    }
+
+    return p - buffer;
+}
+
+#endif // MK_HTTP_EVENTS_H
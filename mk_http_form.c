@@ -0,0 +1,229 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string.h>
+#include <strings.h>
+
+#include "mk_http_form.h"
+#include "mk_http_chars.h"
+#include "mk_http_hash.h"
+
+#define MK_FORM_CONTENT_TYPE "application/x-www-form-urlencoded"
+
+static inline int form_hex(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/*
+ * Decode '+' and %XX of [p, end) to out and return the end of the output,
+ * NULL on a malformed escape. The output is never longer than the input,
+ * so out may be the input itself.
+ */
+static char *form_unescape(char *out, const char *p, const char *end)
+{
+    const char *run;
+    int hi, lo;
+
+    while (p < end) {
+        if (*p == '+') {
+            *out++ = ' ';
+            p++;
+        }
+        else if (*p == '%') {
+            if (end - p < 3 ||
+                    (hi = form_hex(p[1])) < 0 || (lo = form_hex(p[2])) < 0) {
+                return NULL;
+            }
+            *out++ = (hi << 4) | lo;
+            p += 3;
+        }
+        else {
+            run = mk_char_find_escape(p, end);
+            memmove(out, p, run - p);
+            out += run - p;
+            p = run;
+        }
+    }
+    return out;
+}
+
+int mk_form_decode(mk_pointer *s)
+{
+    char *p, *out, *end;
+
+    end = s->data + s->len;
+    p = (char *) mk_char_find_escape(s->data, end);
+    if (p == end) {
+        return 0;
+    }
+
+    out = form_unescape(p, p, end);
+    if (out == NULL) {
+        return -1;
+    }
+    s->len = out - s->data;
+    return 0;
+}
+
+/*
+ * Point s at the decoded field: unchanged when it has no escapes, else
+ * copied to the scratch area at *cur, which must have room for s->len.
+ */
+static int form_field(mk_pointer *s, char **cur, char *limit)
+{
+    char *end = s->data + s->len, *out;
+
+    if (mk_char_find_escape(s->data, end) == end) {
+        return 0;
+    }
+    if (s->len > (size_t) (limit - *cur)) {
+        return -1;
+    }
+
+    out = form_unescape(*cur, s->data, end);
+    if (out == NULL) {
+        return -1;
+    }
+    s->data = *cur;
+    s->len = out - *cur;
+    *cur = out;
+    return 0;
+}
+
+static inline uint32_t form_hash(const char *name, size_t len)
+{
+    return (uint32_t) mk_hash64(name, len, 0);
+}
+
+/* Index field i, chaining it behind an earlier field of the same name */
+static void form_index(struct mk_form *form, int i)
+{
+    struct mk_form_field *f = &form->fields[i], *first;
+    unsigned int slot = f->hash & (MK_FORM_SLOTS - 1);
+
+    while (form->slots[slot] != 0) {
+        first = &form->fields[form->slots[slot] - 1];
+        if (first->hash == f->hash && first->name.len == f->name.len &&
+                !memcmp(first->name.data, f->name.data, f->name.len)) {
+            while (first->next >= 0) {
+                first = &form->fields[first->next];
+            }
+            first->next = i;
+            return;
+        }
+        slot = (slot + 1) & (MK_FORM_SLOTS - 1);
+    }
+    form->slots[slot] = i + 1;
+}
+
+int mk_form_parse(struct mk_form *form, const char *data, size_t len,
+        char *buf, size_t size)
+{
+    char *p = (char *) data, *end = p + len, *amp, *eq;
+    char *cur = buf, *limit = buf + size;
+    struct mk_form_field *f;
+
+    form->count = 0;
+    memset(form->slots, 0, sizeof(form->slots));
+
+    while (p < end) {
+        amp = memchr(p, '&', end - p);
+        if (amp == NULL) {
+            amp = end;
+        }
+        if (amp == p) {
+            p++;
+            continue;
+        }
+        if (form->count == MK_FORM_FIELDS_MAX) {
+            return -1;
+        }
+
+        f = &form->fields[form->count];
+        eq = memchr(p, '=', amp - p);
+        f->name.data = p;
+        if (eq != NULL) {
+            f->name.len = eq - p;
+            f->value.data = eq + 1;
+            f->value.len = amp - eq - 1;
+        }
+        else {
+            f->name.len = amp - p;
+            f->value.data = amp;
+            f->value.len = 0;
+        }
+        if (form_field(&f->name, &cur, limit) ||
+                form_field(&f->value, &cur, limit)) {
+            return -1;
+        }
+        f->hash = form_hash(f->name.data, f->name.len);
+        f->next = -1;
+        form_index(form, form->count++);
+
+        p = amp + 1;
+    }
+
+    return form->count;
+}
+
+int mk_form_query(struct mk_form *form, const struct mk_request_info *info,
+        char *buf, size_t size)
+{
+    return mk_form_parse(form, info->query.data, info->query.len, buf, size);
+}
+
+int mk_form_body(struct mk_form *form, const struct mk_request_info *info,
+        char *buf, size_t size)
+{
+    const char *value;
+    size_t len, n = sizeof(MK_FORM_CONTENT_TYPE) - 1;
+
+    if (mk_http_request_header(info, "Content-Type", &value, &len) != 0 ||
+            len < n || strncasecmp(value, MK_FORM_CONTENT_TYPE, n) != 0 ||
+            (len > n && value[n] != ';' && value[n] != ' ')) {
+        return -1;
+    }
+    return mk_form_parse(form, info->body.data, info->body.len, buf, size);
+}
+
+const struct mk_form_field *mk_form_get(const struct mk_form *form,
+        const char *name, size_t len)
+{
+    const struct mk_form_field *f;
+    uint32_t hash = form_hash(name, len);
+    unsigned int slot = hash & (MK_FORM_SLOTS - 1);
+
+    while (form->slots[slot] != 0) {
+        f = &form->fields[form->slots[slot] - 1];
+        if (f->hash == hash && f->name.len == len &&
+                !memcmp(f->name.data, name, len)) {
+            return f;
+        }
+        slot = (slot + 1) & (MK_FORM_SLOTS - 1);
+    }
+    return NULL;
+}
@@ -0,0 +1,90 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_FORM_H
+#define MK_HTTP_FORM_H
+
+#include <stdint.h>
+
+#include "mk_http_parser2.h"
+
+/*
+ * Form decoding
+ * =============
+ *
+ * Splits application/x-www-form-urlencoded data, the query string of a
+ * request or a POST body, into name/value pairs. Both go through the same
+ * code. The request bytes are left as they are: the proxy, the access log
+ * and engine 2's re-parse still need them. A name or value with no escapes
+ * keeps pointing into the request, one with '+' or %XX is decoded into the
+ * caller's scratch buffer, so nothing is allocated. The decoded text is
+ * never longer than the raw one, a buffer of the input's length always
+ * fits; a smaller one may run out, which fails the parse.
+ *
+ * The fields are indexed by name in a small open addressing table, a
+ * lookup hashes the name once and compares at most a few fields. Repeated
+ * names are chained in order through field->next.
+ *
+ * Parsing returns the number of fields, -1 on a malformed escape, a full
+ * scratch buffer, more than MK_FORM_FIELDS_MAX fields or, for the body,
+ * another Content-Type.
+ */
+#define MK_FORM_FIELDS_MAX (32)
+#define MK_FORM_SLOTS      (64)    /* power of two, twice the fields */
+
+struct mk_form_field {
+    mk_pointer name;
+    mk_pointer value;       /* empty for a name without '=' */
+    uint32_t hash;
+    int next;               /* next field with the same name, -1 if none */
+};
+
+struct mk_form {
+    int count;
+    struct mk_form_field fields[MK_FORM_FIELDS_MAX];
+    unsigned char slots[MK_FORM_SLOTS];    /* field index + 1, 0 if free */
+};
+
+/* Decode '+' and %XX in place, -1 on a malformed escape */
+int mk_form_decode(mk_pointer *s);
+
+/* Fields of data, escaped ones decoded into buf, which must not overlap it */
+int mk_form_parse(struct mk_form *form, const char *data, size_t len,
+        char *buf, size_t size);
+
+/* Fields of info->query */
+int mk_form_query(struct mk_form *form, const struct mk_request_info *info,
+        char *buf, size_t size);
+
+/* Fields of an application/x-www-form-urlencoded body */
+int mk_form_body(struct mk_form *form, const struct mk_request_info *info,
+        char *buf, size_t size);
+
+/* First field named name, NULL when there is none */
+const struct mk_form_field *mk_form_get(const struct mk_form *form,
+        const char *name, size_t len);
+
+/* Next field with the same name as field, NULL after the last one */
+static inline const struct mk_form_field *mk_form_next(
+        const struct mk_form *form, const struct mk_form_field *field)
+{
+    return field->next < 0 ? NULL : &form->fields[field->next];
+}
+
+#endif // MK_HTTP_FORM_H
@@ -0,0 +1,96 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_HASH_H
+#define MK_HTTP_HASH_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * 64-bit hash
+ * ===========
+ *
+ * wyhash style: 16 bytes per step, each folded in with one 64x64->128
+ * multiply. It is fast on short keys like paths and header values. It is
+ * not meant to resist hash flooding unless the seed is kept secret.
+ */
+
+#define MK_HASH_P0 0xa0761d6478bd642fULL
+#define MK_HASH_P1 0xe7037ed1a0b428dbULL
+#define MK_HASH_P2 0x8ebc6af09c88c6e3ULL
+
+static inline uint64_t mk_hash_mum(uint64_t a, uint64_t b)
+{
+    __uint128_t r = (__uint128_t) a * b;
+
+    return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+static inline uint64_t mk_hash_read64(const unsigned char *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t mk_hash_read32(const unsigned char *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t mk_hash64(const void *data, size_t len, uint64_t seed)
+{
+    const unsigned char *p = data;
+    size_t total = len;
+    uint64_t a, b;
+
+    seed ^= MK_HASH_P0;
+    while (len > 16) {
+        seed = mk_hash_mum(mk_hash_read64(p) ^ MK_HASH_P1,
+                           mk_hash_read64(p + 8) ^ seed);
+        p += 16;
+        len -= 16;
+    }
+
+    if (len > 8) {
+        a = mk_hash_read64(p);
+        b = mk_hash_read64(p + len - 8);
+    }
+    else if (len >= 4) {
+        a = mk_hash_read32(p);
+        b = mk_hash_read32(p + len - 4);
+    }
+    else if (len > 0) {
+        a = ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8) | p[len - 1];
+        b = 0;
+    }
+    else {
+        a = b = 0;
+    }
+
+    return mk_hash_mum(MK_HASH_P1 ^ total,
+                       mk_hash_mum(a ^ MK_HASH_P1, b ^ seed));
+}
+
+#endif // MK_HTTP_HASH_H
@@ -0,0 +1,346 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mk_http_log.h"
+#include "mk_http_scan.h"
+#include "mk_http_chars.h"
+
+static const char mk_log_hex[] = "0123456789abcdef";
+
+/* Map the character after '%' to its field, -1 if unknown */
+static int mk_log_directive(char c)
+{
+    switch (c) {
+    case 'h': return MK_LOG_REMOTE;
+    case 'l':
+    case 'u': return MK_LOG_DASH;
+    case 't': return MK_LOG_TIME;
+    case 'r': return MK_LOG_REQUEST_LINE;
+    case 'm': return MK_LOG_METHOD;
+    case 'U': return MK_LOG_PATH;
+    case 'q': return MK_LOG_QUERY;
+    case 'H': return MK_LOG_PROTOCOL;
+    case 's': return MK_LOG_STATUS;
+    case 'b': return MK_LOG_BYTES;
+    case 'B': return MK_LOG_BYTES_ZERO;
+    }
+    return -1;
+}
+
+static int mk_log_op_add(struct mk_log_format *fmt, int field,
+        size_t offset, size_t len)
+{
+    struct mk_log_op *op;
+
+    if (fmt->count == MK_LOG_OPS_MAX) {
+        return -1;
+    }
+    op = &fmt->ops[fmt->count++];
+    op->field = field;
+    op->header = MK_HEADER_OTHER;
+    op->offset = offset;
+    op->len = len;
+    return 0;
+}
+
+int mk_log_compile(struct mk_log_format *fmt, const char *format)
+{
+    size_t len, i, start;
+    char *p, *end;
+    int field;
+
+    len = strlen(format);
+    if (len >= MK_LOG_FORMAT_MAX) {
+        return -1;
+    }
+    memcpy(fmt->text, format, len + 1);
+    fmt->count = 0;
+
+    /*
+     * Literal runs stay where they are in text, header names are cut out
+     * by overwriting the '}' with a NUL for mk_http_header_lookup().
+     */
+    p = fmt->text;
+    i = 0;
+    start = 0;
+    while (i < len) {
+        if (p[i] != '%') {
+            i++;
+            continue;
+        }
+        if (i + 1 == len) {
+            return -1;
+        }
+        if (p[i + 1] == '%') {
+            /* The first '%' ends the run, the second starts the next one */
+            if (mk_log_op_add(fmt, MK_LOG_TEXT, start, i + 1 - start)) {
+                return -1;
+            }
+            i += 2;
+            start = i;
+            continue;
+        }
+        if (i > start && mk_log_op_add(fmt, MK_LOG_TEXT, start, i - start)) {
+            return -1;
+        }
+
+        i++;
+        if (p[i] == '{') {
+            end = memchr(p + i, '}', len - i);
+            if (end == NULL || end == p + i + 1 || end[1] != 'i' ||
+                    mk_log_op_add(fmt, MK_LOG_HEADER, i + 1,
+                                  end - (p + i + 1))) {
+                return -1;
+            }
+            *end = '\0';
+            fmt->ops[fmt->count - 1].header =
+                mk_http_scan_header_id(p + i + 1, end - (p + i + 1));
+            i = end + 2 - p;
+        }
+        else {
+            if (p[i] == '>' && p[i + 1] == 's') {
+                i++;
+            }
+            field = mk_log_directive(p[i]);
+            if (field == -1 || mk_log_op_add(fmt, field, 0, 0)) {
+                return -1;
+            }
+            i++;
+        }
+        start = i;
+    }
+    if (i > start && mk_log_op_add(fmt, MK_LOG_TEXT, start, i - start)) {
+        return -1;
+    }
+    return 0;
+}
+
+void mk_log_init(struct mk_log *log, int fd, int interval)
+{
+    log->fd = fd;
+    log->interval = interval;
+    log->first = 0;
+    log->date_time = 0;
+    log->date_len = 0;
+    log->len = 0;
+}
+
+int mk_log_flush(struct mk_log *log)
+{
+    const char *p = log->buf;
+    size_t len = log->len;
+    ssize_t n;
+
+    log->len = 0;
+    while (len > 0) {
+        n = write(log->fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int mk_log_tick(struct mk_log *log)
+{
+    if (log->len == 0 || time(NULL) - log->first < log->interval) {
+        return 0;
+    }
+    return mk_log_flush(log);
+}
+
+/* Copy a request field, escaping what could break the line */
+static char *mk_log_copy(char *d, char *end, const char *s, size_t len)
+{
+    const char *s_end = s + len;
+    const char *safe;
+    size_t n;
+
+    while (s < s_end) {
+        safe = mk_char_span_log(s, s_end);
+        n = safe - s;
+        if (n > (size_t) (end - d)) {
+            n = end - d;
+        }
+        memcpy(d, s, n);
+        d += n;
+        if (safe == s_end || end - d < 4) {
+            break;
+        }
+        d[0] = '\\';
+        d[1] = 'x';
+        d[2] = mk_log_hex[(unsigned char) *safe >> 4];
+        d[3] = mk_log_hex[*safe & 0xf];
+        d += 4;
+        s = safe + 1;
+    }
+    return d;
+}
+
+static char *mk_log_text(char *d, char *end, const char *s, size_t len)
+{
+    if (len > (size_t) (end - d)) {
+        len = end - d;
+    }
+    memcpy(d, s, len);
+    return d + len;
+}
+
+static char *mk_log_number(char *d, char *end, unsigned long v)
+{
+    char tmp[20];
+    int i = sizeof(tmp);
+
+    do {
+        tmp[--i] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    return mk_log_text(d, end, tmp + i, sizeof(tmp) - i);
+}
+
+/* %t, formatted once per second */
+static char *mk_log_date(struct mk_log *log, char *d, char *end, time_t now)
+{
+    struct tm tm;
+
+    if (now != log->date_time) {
+        gmtime_r(&now, &tm);
+        log->date_len = strftime(log->date, sizeof(log->date),
+                                 "[%d/%b/%Y:%H:%M:%S +0000]", &tm);
+        log->date_time = now;
+    }
+    return mk_log_text(d, end, log->date, log->date_len);
+}
+
+static char *mk_log_header(const struct mk_log_format *fmt,
+        const struct mk_log_op *op, const struct mk_request_info *info,
+        char *d, char *end)
+{
+    const char *value;
+    size_t len;
+
+    if (op->header != MK_HEADER_OTHER) {
+        len = info->quick_headers[(int) op->header].value_len;
+        value = info->headers.data +
+            info->quick_headers[(int) op->header].value_index;
+    }
+    else if (mk_http_header_lookup(info, fmt->text + op->offset,
+                                   &value, &len)) {
+        len = 0;
+    }
+    if (len == 0) {
+        return mk_log_text(d, end, "-", 1);
+    }
+    return mk_log_copy(d, end, value, len);
+}
+
+int mk_log_append(struct mk_log *log, const struct mk_log_format *fmt,
+        const struct mk_log_entry *entry)
+{
+    const struct mk_request_info *info = entry->info;
+    const struct mk_log_op *op;
+    time_t now;
+    char *d, *end;
+    int i, ret = 0;
+
+    if (sizeof(log->buf) - log->len < MK_LOG_LINE_MAX) {
+        ret = mk_log_flush(log);
+    }
+    now = time(NULL);
+    if (log->len == 0) {
+        log->first = now;
+    }
+
+    d = log->buf + log->len;
+    end = d + MK_LOG_LINE_MAX - 1;
+    for (i = 0; i < fmt->count; i++) {
+        op = &fmt->ops[i];
+        switch (op->field) {
+        case MK_LOG_TEXT:
+            d = mk_log_text(d, end, fmt->text + op->offset, op->len);
+            break;
+        case MK_LOG_REMOTE:
+            if (entry->remote.len == 0) {
+                d = mk_log_text(d, end, "-", 1);
+                break;
+            }
+            d = mk_log_copy(d, end, entry->remote.data, entry->remote.len);
+            break;
+        case MK_LOG_DASH:
+            d = mk_log_text(d, end, "-", 1);
+            break;
+        case MK_LOG_TIME:
+            d = mk_log_date(log, d, end, now);
+            break;
+        case MK_LOG_REQUEST_LINE:
+            d = mk_log_copy(d, end, info->method.data, info->method.len);
+            d = mk_log_text(d, end, " ", 1);
+            d = mk_log_copy(d, end, info->uri.data, info->uri.len);
+            d = mk_log_text(d, end, " ", 1);
+            d = mk_log_copy(d, end, info->protocol.data, info->protocol.len);
+            break;
+        case MK_LOG_METHOD:
+            d = mk_log_copy(d, end, info->method.data, info->method.len);
+            break;
+        case MK_LOG_PATH:
+            d = mk_log_copy(d, end, info->path.data, info->path.len);
+            break;
+        case MK_LOG_QUERY:
+            if (info->query.len > 0) {
+                d = mk_log_text(d, end, "?", 1);
+                d = mk_log_copy(d, end, info->query.data, info->query.len);
+            }
+            break;
+        case MK_LOG_PROTOCOL:
+            d = mk_log_copy(d, end, info->protocol.data, info->protocol.len);
+            break;
+        case MK_LOG_STATUS:
+            d = mk_log_number(d, end, entry->status);
+            break;
+        case MK_LOG_BYTES:
+            if (entry->bytes == 0) {
+                d = mk_log_text(d, end, "-", 1);
+                break;
+            }
+            /* fall through */
+        case MK_LOG_BYTES_ZERO:
+            d = mk_log_number(d, end, entry->bytes);
+            break;
+        case MK_LOG_HEADER:
+            d = mk_log_header(fmt, op, info, d, end);
+            break;
+        }
+    }
+    *d++ = '\n';
+    log->len = d - log->buf;
+
+    if (now - log->first >= log->interval && mk_log_flush(log)) {
+        ret = -1;
+    }
+    return ret;
+}
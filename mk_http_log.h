@@ -0,0 +1,141 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_LOG_H
+#define MK_HTTP_LOG_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "mk_http_parser2.h"
+
+/*
+ * Access log
+ * ==========
+ *
+ * mk_log_compile() turns an Apache style format string into a list of
+ * field references, done once at start up. mk_log_append() runs it for a
+ * request, copying straight from the views of the parsed request into the
+ * log buffer: nothing is allocated and no intermediate string is built.
+ * Lines are written out with one write(2) per batch, when the buffer is
+ * short of room for another line or when the oldest buffered line is
+ * interval seconds old. Appends check the age as requests come in; a
+ * server going idle must call mk_log_tick() from its event loop timer,
+ * or the last lines wait for the next request. mk_log_flush() writes
+ * whatever is left.
+ *
+ * A log buffer is not locked, each thread owns one and several of them
+ * can share the descriptor: every batch holds whole lines, so with
+ * O_APPEND lines of different threads do not interleave.
+ *
+ * Directives:
+ *
+ *   %h          remote address, from the entry
+ *   %l %u       "-", identd and user are not supported
+ *   %t          time the line is written, [19/Oct/2026:10:00:00 +0000]
+ *   %r          request line
+ *   %m %U %q %H method, path, query with its '?' and protocol
+ *   %s %>s      status
+ *   %b %B       response body bytes, "-" or 0 when there is none
+ *   %{Name}i    request header, "-" when missing
+ *   %%          a '%'
+ *
+ * Bytes of the request other than VCHAR and SP, plus '"' and '\', are
+ * written as \xHH, so a field cannot break the line format. A line over
+ * MK_LOG_LINE_MAX is cut short.
+ */
+#define MK_LOG_FORMAT_MAX   (256)
+#define MK_LOG_OPS_MAX      (32)
+#define MK_LOG_LINE_MAX     (4096)
+#define MK_LOG_BUFFER_SIZE  (64 * 1024)
+
+#define MK_LOG_COMBINED \
+    "%h %l %u %t \"%r\" %>s %b \"%{Referer}i\" \"%{User-Agent}i\""
+
+enum mk_log_field {
+    MK_LOG_TEXT = 0,        /* literal run of the format */
+    MK_LOG_REMOTE,
+    MK_LOG_DASH,
+    MK_LOG_TIME,
+    MK_LOG_REQUEST_LINE,
+    MK_LOG_METHOD,
+    MK_LOG_PATH,
+    MK_LOG_QUERY,
+    MK_LOG_PROTOCOL,
+    MK_LOG_STATUS,
+    MK_LOG_BYTES,           /* %b */
+    MK_LOG_BYTES_ZERO,      /* %B */
+    MK_LOG_HEADER,
+};
+
+struct mk_log_op {
+    uint8_t field;          /* enum mk_log_field */
+    int8_t header;          /* quick header id, MK_HEADER_OTHER if none */
+    uint16_t offset;        /* text or header name in mk_log_format.text */
+    uint16_t len;
+};
+
+struct mk_log_format {
+    int count;
+    struct mk_log_op ops[MK_LOG_OPS_MAX];
+    char text[MK_LOG_FORMAT_MAX];
+};
+
+/* What the request does not carry */
+struct mk_log_entry {
+    const struct mk_request_info *info;
+    int status;
+    unsigned long bytes;
+    mk_pointer remote;
+};
+
+struct mk_log {
+    int fd;
+    int interval;           /* seconds a line may wait in the buffer */
+    time_t first;           /* when the oldest buffered line was added */
+    time_t date_time;       /* second the cached %t is for */
+    int date_len;
+    char date[32];
+    size_t len;
+    char buf[MK_LOG_BUFFER_SIZE];
+};
+
+/* Returns 0 on success, -1 on an unknown directive or a format too long */
+int mk_log_compile(struct mk_log_format *fmt, const char *format);
+
+void mk_log_init(struct mk_log *log, int fd, int interval);
+
+/*
+ * Add the line for a request. Returns 0 on success, -1 when a batch
+ * could not be written; its lines are dropped.
+ */
+int mk_log_append(struct mk_log *log, const struct mk_log_format *fmt,
+        const struct mk_log_entry *entry);
+
+int mk_log_flush(struct mk_log *log);
+
+/*
+ * Write the batch out if its oldest line is interval seconds old. Meant
+ * for the event loop timer, once a second is enough; an empty buffer
+ * costs a compare. Returns 0 on success, -1 when the batch could not be
+ * written.
+ */
+int mk_log_tick(struct mk_log *log);
+
+#endif // MK_HTTP_LOG_H
@@ -0,0 +1,443 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+#include "mk_http_multipart.h"
+#include "mk_http_scan.h"
+
+enum {
+    MP_PREAMBLE = 0,
+    MP_DELIM_END,       /* right after a delimiter */
+    MP_CLOSE,           /* first '-' of the close delimiter seen */
+    MP_PADDING,         /* transport padding before CRLF */
+    MP_LF,
+    MP_HEADERS,
+    MP_BODY,
+    MP_DONE,
+    MP_ERROR
+};
+
+#define mp_event(mp, hook, ...)                                         \
+    ((mp)->cb->hook != NULL && (mp)->cb->hook(__VA_ARGS__) != 0)
+
+/* bchars of RFC 2046, the last one can not be a space */
+static int mp_boundary_valid(mk_pointer b)
+{
+    unsigned long i;
+
+    if (b.len == 0 || b.len > MK_MULTIPART_BOUNDARY_MAX ||
+            b.data[b.len - 1] == ' ') {
+        return 0;
+    }
+    for (i = 0; i < b.len; i++) {
+        if (!isalnum((unsigned char) b.data[i]) &&
+                !strchr("'()+_,-./:=? ", b.data[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Next "; key=value" parameter of a header value, the value can be a
+ * quoted-string, returned without the quotes and still escaped. Returns
+ * the position after the parameter, NULL when there is none left.
+ */
+static char *mp_param(char *p, char *end, mk_pointer *key, mk_pointer *value)
+{
+    char *k;
+
+    p = memchr(p, ';', end - p);
+    if (p == NULL) {
+        return NULL;
+    }
+    for (p++; p < end && (*p == ' ' || *p == '\t'); p++);
+
+    for (k = p; p < end && *p != '=' && *p != ';'; p++);
+    key->data = k;
+    key->len = p - k;
+    while (key->len > 0 && (k[key->len - 1] == ' ' || k[key->len - 1] == '\t')) {
+        key->len--;
+    }
+    value->data = p;
+    value->len = 0;
+    if (p == end || *p == ';') {
+        return p;
+    }
+
+    for (p++; p < end && (*p == ' ' || *p == '\t'); p++);
+    if (p < end && *p == '"') {
+        value->data = ++p;
+        for (; p < end && *p != '"'; p++) {
+            if (*p == '\\' && p + 1 < end) {
+                p++;
+            }
+        }
+        value->len = p - value->data;
+        return p < end ? p + 1 : p;
+    }
+
+    value->data = p;
+    for (; p < end && *p != ';' && *p != ' ' && *p != '\t'; p++);
+    value->len = p - value->data;
+    return p;
+}
+
+static int mp_key_is(mk_pointer key, const char *name)
+{
+    return key.len == strlen(name) && !strncasecmp(key.data, name, key.len);
+}
+
+int mk_multipart_boundary(const struct mk_request_info *info,
+        mk_pointer *boundary)
+{
+    const char *value;
+    size_t len;
+    char *p, *end;
+    mk_pointer key, param;
+
+    if (mk_http_request_header(info, "Content-Type", &value, &len) != 0 ||
+            len < 10 || strncasecmp(value, "multipart/", 10) != 0) {
+        return -1;
+    }
+
+    p = (char *) value;
+    end = p + len;
+    while ((p = mp_param(p, end, &key, &param)) != NULL) {
+        if (mp_key_is(key, "boundary")) {
+            if (!mp_boundary_valid(param)) {
+                return -1;
+            }
+            *boundary = param;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int mk_multipart_init(struct mk_multipart *mp, mk_pointer boundary,
+        const struct mk_multipart_callbacks *cb, void *data)
+{
+    size_t i;
+
+    if (!mp_boundary_valid(boundary)) {
+        return -1;
+    }
+
+    memset(mp, 0, sizeof(*mp) - sizeof(mp->headers));
+    mp->cb = cb;
+    mp->data = data;
+    mp->state = MP_PREAMBLE;
+
+    memcpy(mp->delim, "\r\n--", 4);
+    memcpy(mp->delim + 4, boundary.data, boundary.len);
+    mp->delim_len = boundary.len + 4;
+
+    memset(mp->shift, mp->delim_len, sizeof(mp->shift));
+    for (i = 0; i < mp->delim_len - 1; i++) {
+        mp->shift[(unsigned char) mp->delim[i]] = mp->delim_len - 1 - i;
+    }
+
+    /*
+     * The first delimiter may start the body without the CRLF, act as if
+     * the CRLF was at the end of a previous chunk.
+     */
+    mp->keep = 2;
+    return 0;
+}
+
+/* Horspool search of the delimiter in [p, end) */
+static char *mp_find(struct mk_multipart *mp, char *p, char *end)
+{
+    size_t m = mp->delim_len;
+    char last = mp->delim[m - 1];
+    char c;
+
+    while ((size_t) (end - p) >= m) {
+        c = p[m - 1];
+        if (c == last && !memcmp(p, mp->delim, m - 1)) {
+            return p;
+        }
+        p += mp->shift[(unsigned char) c];
+    }
+    return NULL;
+}
+
+/* Preamble bytes are dropped, part bytes go to on_data */
+static int mp_emit(struct mk_multipart *mp, const char *buf, size_t len)
+{
+    if (mp->state != MP_BODY || len == 0) {
+        return 0;
+    }
+    return mp_event(mp, on_data, mp->data, buf, len);
+}
+
+/*
+ * Consume data until the next delimiter. Returns 1 with *pp after the
+ * delimiter when found, 0 when the chunk is exhausted, MK_HTTP_STOPPED.
+ *
+ * The boundary has no CR, so a delimiter can only start at a CR: when
+ * the chunk ends within a possible delimiter those bytes are held back,
+ * and as they match the delimiter they are given back from mp->delim
+ * if the next chunk proves them to be data.
+ */
+static int mp_body(struct mk_multipart *mp, char **pp, char *end)
+{
+    char *p = *pp, *hit, *cr;
+    size_t need, n;
+
+    if (mp->keep > 0) {
+        need = mp->delim_len - mp->keep;
+        n = (size_t) (end - p) < need ? (size_t) (end - p) : need;
+        if (!memcmp(p, mp->delim + mp->keep, n)) {
+            if (n < need) {
+                mp->keep += n;
+                *pp = end;
+                return 0;
+            }
+            mp->keep = 0;
+            *pp = p + n;
+            return 1;
+        }
+        if (mp_emit(mp, mp->delim, mp->keep)) {
+            return MK_HTTP_STOPPED;
+        }
+        mp->keep = 0;
+    }
+
+    hit = mp_find(mp, p, end);
+    if (hit != NULL) {
+        if (mp_emit(mp, p, hit - p)) {
+            return MK_HTTP_STOPPED;
+        }
+        *pp = hit + mp->delim_len;
+        return 1;
+    }
+
+    n = (size_t) (end - p) < mp->delim_len - 1 ?
+        (size_t) (end - p) : mp->delim_len - 1;
+    cr = memrchr(end - n, '\r', n);
+    if (cr != NULL && !memcmp(cr, mp->delim, end - cr)) {
+        mp->keep = end - cr;
+        end = cr;
+    }
+    if (mp_emit(mp, p, end - p)) {
+        return MK_HTTP_STOPPED;
+    }
+    *pp = end + mp->keep;
+    return 0;
+}
+
+static void mp_disposition(char *p, char *end, struct mk_multipart_part *part)
+{
+    mk_pointer key, value;
+
+    while ((p = mp_param(p, end, &key, &value)) != NULL) {
+        if (mp_key_is(key, "name")) {
+            part->name = value;
+        }
+        else if (mp_key_is(key, "filename")) {
+            part->filename = value;
+        }
+    }
+}
+
+/*
+ * Scan the header block of a part in [p, end) with the request scanner.
+ * Returns 1 with *next after the blank line once complete, 0 when more
+ * is needed, -1 on malformed headers.
+ */
+static int mp_scan_headers(char *p, char *end, struct mk_multipart_part *part,
+        char **next)
+{
+    char *start = p, *colon, *eol, *value, *value_end;
+
+    memset(part, 0, sizeof(*part));
+
+    for (;;) {
+        if (mk_http_scan_header_line(p, end, &colon, &eol)) {
+            return -1;
+        }
+        if (eol == NULL) {
+            return 0;
+        }
+
+        if (colon == NULL) {
+            if (eol - p > 1 || (eol - p == 1 && *p != '\r')) {
+                return -1;
+            }
+            part->headers.data = start;
+            part->headers.len = p - start;
+            *next = eol + 1;
+            return 1;
+        }
+
+        value = colon + 1;
+        value_end = eol;
+        while (value < value_end && (*value == ' ' || *value == '\t')) {
+            value++;
+        }
+        while (value_end > value &&
+               (value_end[-1] == '\r' || value_end[-1] == ' ' ||
+                value_end[-1] == '\t')) {
+            value_end--;
+        }
+
+        if (colon - p == 19 && !strncasecmp(p, "Content-Disposition", 19)) {
+            mp_disposition(value, value_end, part);
+        }
+        else if (colon - p == 12 && !strncasecmp(p, "Content-Type", 12)) {
+            part->content_type.data = value;
+            part->content_type.len = value_end - value;
+        }
+        p = eol + 1;
+    }
+}
+
+/*
+ * Part headers are scanned in place when the chunk holds all of them,
+ * otherwise they are gathered in mp->headers first.
+ */
+static int mp_headers(struct mk_multipart *mp, char **pp, char *end)
+{
+    char *p = *pp, *next;
+    size_t n, held = mp->headers_len;
+    struct mk_multipart_part part;
+    int ret;
+
+    if (held == 0) {
+        ret = mp_scan_headers(p, end, &part, &next);
+        if (ret == 0) {
+            n = end - p;
+            if (n >= sizeof(mp->headers)) {
+                return MK_HTTP_ERROR;
+            }
+            memcpy(mp->headers, p, n);
+            mp->headers_len = n;
+            *pp = end;
+            return 0;
+        }
+    }
+    else {
+        n = sizeof(mp->headers) - held;
+        if ((size_t) (end - p) < n) {
+            n = end - p;
+        }
+        memcpy(mp->headers + held, p, n);
+        ret = mp_scan_headers(mp->headers, mp->headers + held + n,
+                              &part, &next);
+        if (ret == 0) {
+            if (held + n == sizeof(mp->headers)) {
+                return MK_HTTP_ERROR;
+            }
+            mp->headers_len += n;
+            *pp = end;
+            return 0;
+        }
+        next = p + (next - (mp->headers + held));
+        mp->headers_len = 0;
+    }
+
+    if (ret < 0) {
+        return MK_HTTP_ERROR;
+    }
+
+    *pp = next;
+    mp->state = MP_BODY;
+    if (mp_event(mp, on_part, mp->data, &part)) {
+        return MK_HTTP_STOPPED;
+    }
+    return 0;
+}
+
+int mk_multipart_feed(struct mk_multipart *mp, char *buf, size_t len)
+{
+    char *p = buf, *end = buf + len;
+    int ret = 0;
+
+    while (p < end && ret == 0) {
+        switch (mp->state) {
+        case MP_PREAMBLE:
+        case MP_BODY:
+            ret = mp_body(mp, &p, end);
+            if (ret == 1) {
+                ret = 0;
+                if (mp->state == MP_BODY && mp_event(mp, on_part_end, mp->data)) {
+                    ret = MK_HTTP_STOPPED;
+                }
+                mp->state = MP_DELIM_END;
+            }
+            break;
+        case MP_DELIM_END:
+            if (*p == '-') {
+                mp->state = MP_CLOSE;
+            }
+            else if (*p == ' ' || *p == '\t') {
+                mp->state = MP_PADDING;
+            }
+            else if (*p == '\r') {
+                mp->state = MP_LF;
+            }
+            else {
+                ret = MK_HTTP_ERROR;
+            }
+            p++;
+            break;
+        case MP_CLOSE:
+            if (*p++ != '-') {
+                ret = MK_HTTP_ERROR;
+            }
+            mp->state = MP_DONE;
+            break;
+        case MP_PADDING:
+            if (*p == '\r') {
+                mp->state = MP_LF;
+            }
+            else if (*p != ' ' && *p != '\t') {
+                ret = MK_HTTP_ERROR;
+            }
+            p++;
+            break;
+        case MP_LF:
+            if (*p++ != '\n') {
+                ret = MK_HTTP_ERROR;
+            }
+            mp->state = MP_HEADERS;
+            break;
+        case MP_HEADERS:
+            ret = mp_headers(mp, &p, end);
+            break;
+        case MP_DONE:
+            return MK_HTTP_OK;
+        default:
+            return MK_HTTP_ERROR;
+        }
+    }
+
+    if (ret != 0) {
+        mp->state = MP_ERROR;
+        return ret;
+    }
+    return mp->state == MP_DONE ? MK_HTTP_OK : MK_HTTP_PENDING;
+}
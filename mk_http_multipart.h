@@ -0,0 +1,92 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_MULTIPART_H
+#define MK_HTTP_MULTIPART_H
+
+#include "mk_http_parser2.h"
+
+/*
+ * Multipart bodies
+ * ================
+ *
+ * Streaming parser for multipart/form-data (RFC 7578) bodies. The body
+ * is fed in chunks of any size as it arrives, nothing has to be kept
+ * between calls: the delimiter is searched with Boyer-Moore-Horspool and
+ * part data is handed to on_data as ranges of the chunk being fed, so an
+ * upload is never copied whatever its size. Only the header lines of a
+ * part that straddle two chunks are copied, up to
+ * MK_MULTIPART_HEADERS_MAX bytes.
+ *
+ * On_part gets the headers of a part once they are complete, they are
+ * checked with the request header scanner and stay valid during the call
+ * only. On_data may be called several times per part, on_part_end when
+ * the delimiter closing the part is found. Every hook is optional and a
+ * non zero return stops the parser.
+ *
+ * mk_multipart_feed() returns MK_HTTP_OK once the close delimiter went
+ * by (the epilogue is ignored), MK_HTTP_PENDING while more is expected,
+ * MK_HTTP_ERROR or MK_HTTP_STOPPED. The parser can not be resumed after
+ * the last two.
+ */
+#define MK_MULTIPART_BOUNDARY_MAX  (70)       /* RFC 2046 */
+#define MK_MULTIPART_HEADERS_MAX   (2048)
+
+struct mk_multipart_part {
+    mk_pointer headers;         /* header lines, blank line excluded */
+    mk_pointer name;            /* Content-Disposition name */
+    mk_pointer filename;        /* data is NULL without a filename */
+    mk_pointer content_type;
+};
+
+struct mk_multipart_callbacks {
+    int (*on_part)(void *data, const struct mk_multipart_part *part);
+    int (*on_data)(void *data, const char *buf, size_t len);
+    int (*on_part_end)(void *data);
+};
+
+struct mk_multipart {
+    const struct mk_multipart_callbacks *cb;
+    void *data;
+    int state;
+
+    /* "\r\n--" boundary and its Horspool shift table */
+    char delim[MK_MULTIPART_BOUNDARY_MAX + 4];
+    size_t delim_len;
+    unsigned char shift[256];
+    size_t keep;                /* delimiter bytes matched by the last chunk */
+
+    size_t headers_len;
+    char headers[MK_MULTIPART_HEADERS_MAX];
+};
+
+/*
+ * Boundary parameter of a multipart Content-Type, the value points into
+ * the request headers. Returns -1 when the body is not multipart or the
+ * boundary is invalid.
+ */
+int mk_multipart_boundary(const struct mk_request_info *info,
+        mk_pointer *boundary);
+
+int mk_multipart_init(struct mk_multipart *mp, mk_pointer boundary,
+        const struct mk_multipart_callbacks *cb, void *data);
+
+int mk_multipart_feed(struct mk_multipart *mp, char *buf, size_t len);
+
+#endif // MK_HTTP_MULTIPART_H
@@ -21,6 +21,13 @@
 #include <stdlib.h>
 
 #include "mk_http_parser.h"
+#include "mk_http_chars.h"
+
+#ifdef HTTP_STANDALONE
+#include "mk_http_debug.h"
+#else
+#define eval_field(req, buffer) do {} while (0)
+#endif
 
 #define mark_end()    req->end   = i; eval_field(req, buffer)
 #define parse_next()  req->start = i + 1; continue
@@ -118,6 +125,13 @@ int mk_http_parser(mk_http_request_t *req, char *buffer, int len)
                     req->status = MK_ST_HEADER_VALUE;
                     parse_next();
                 }
+#if MK_HTTP_STRICT
+                /* CR and LF still pass here, the block end is seen as a key */
+                else if (!mk_char_is(mk_char_tchar, buffer[i]) &&
+                         buffer[i] != '\r' && buffer[i] != '\n') {
+                    return MK_HTTP_ERROR;
+                }
+#endif
             }
             else if (req->status == MK_ST_HEADER_VALUE) {
                 if (buffer[i] != ' ') {
@@ -138,6 +152,11 @@ int mk_http_parser(mk_http_request_t *req, char *buffer, int len)
                     }
                     parse_next();
                 }
+#if MK_HTTP_STRICT
+                else if (!mk_char_is(mk_char_field_value, buffer[i])) {
+                    return MK_HTTP_ERROR;
+                }
+#endif
                 continue;
             }
             else if (req->status == MK_ST_HEADER_END) {
@@ -24,12 +24,23 @@
 #include <errno.h>
 
 #include "mk_http_parser2.h"
+#include "mk_http_response.h"
+#include "mk_http_scan.h"
+#include "mk_http_websocket.h"
+#include "mk_http_events.h"
+#include "mk_http_stats.h"
+#include "mk_http_timing.h"
+#include "mk_http_hash.h"
 
 #define mark_end()    req->end   = i; eval_field(req, buffer)
 #define parse_next()  req->start = i + 1; continue
 #define field_len()   (req->end - req->start)
 
+#ifdef TRACE
 #define MK_TRACE(M, ...) printf(M "\n", ##__VA_ARGS__)
+#else
+#define MK_TRACE(M, ...) do {} while (0)
+#endif
 
 #define MK_ENDBLOCK "\r\n\r\n"
 
@@ -70,62 +81,6 @@ enum mk_http_protocol {
 #define HTTP_PROTOCOL_10_STR "HTTP/1.0"
 #define HTTP_PROTOCOL_11_STR "HTTP/1.1"
 
-/* Client Errors */
-#define MK_CLIENT_BAD_REQUEST			400
-#define MK_CLIENT_UNAUTH			401
-#define MK_CLIENT_PAYMENT_REQ   		402     /* Wtf?! :-) */
-#define MK_CLIENT_FORBIDDEN			403
-#define MK_CLIENT_NOT_FOUND			404
-#define MK_CLIENT_METHOD_NOT_ALLOWED		405
-#define MK_CLIENT_NOT_ACCEPTABLE		406
-#define MK_CLIENT_PROXY_AUTH			407
-#define MK_CLIENT_REQUEST_TIMEOUT		408
-#define MK_CLIENT_CONFLICT			409
-#define MK_CLIENT_GONE				410
-#define MK_CLIENT_LENGTH_REQUIRED		411
-#define MK_CLIENT_PRECOND_FAILED		412
-#define MK_CLIENT_REQUEST_ENTITY_TOO_LARGE	413
-#define MK_CLIENT_REQUEST_URI_TOO_LONG		414
-#define MK_CLIENT_UNSUPPORTED_MEDIA		415
-#define MK_CLIENT_REQUESTED_RANGE_NOT_SATISF    416
-
-/* Server Errors */
-#define MK_SERVER_INTERNAL_ERROR		500
-#define MK_SERVER_NOT_IMPLEMENTED		501
-#define MK_SERVER_BAD_GATEWAY			502
-#define MK_SERVER_SERVICE_UNAV			503
-#define MK_SERVER_GATEWAY_TIMEOUT		504
-#define MK_SERVER_HTTP_VERSION_UNSUP		505
-
-static const char *mk_quick_headers[MK_QUICK_HEADER_COUNT] = {
-    "Host",
-    "Accept-Encoding",
-    "Last-Modified",
-    "If-Modified-Since",
-    "Range",
-    "Content-Length"
-};
-
-static int mk_http_quick_header_index(const char * restrict key)
-{
-    unsigned int i;
-    char c = toupper(key[0]);
-
-    for (i = 0; i < MK_QUICK_HEADER_COUNT; i++) {
-        if (mk_quick_headers[i] == NULL) {
-            continue;
-        }
-        else if (c != mk_quick_headers[i][0]) {
-            continue;
-        }
-        else if (!strcasecmp(key, mk_quick_headers[i])) {
-            return i;
-        }
-    }
-
-    return -1;
-}
-
 static enum mk_http_method mk_http_method_check(mk_pointer method)
 {
     if (method.len == sizeof(HTTP_METHOD_GET_STR) - 1 &&
@@ -167,10 +122,138 @@ static enum mk_http_protocol mk_http_protocol_check(mk_pointer protocol)
     return HTTP_PROTOCOL_UNKNOWN;
 }
 
+/*
+ * The path is used undecoded: the request is parsed again from the buffer
+ * on every call, decoding it in place would decode it twice. The router
+ * decodes it into a scratch buffer, see mk_router_match() and
+ * mk_http_path_dot_escaped().
+ */
 static char *url_decode(mk_pointer uri)
 {
-    // TODO: Implement
-    return uri.data;
+    (void) uri;
+    return NULL;
+}
+
+/*
+ * Content-Length value, trailing whitespace aside only digits. At most 18
+ * of them, so the value cannot overflow.
+ */
+static int mk_http_length_parse(const char *value, size_t len,
+        unsigned long *length)
+{
+    size_t i;
+
+    while (len > 0 && (value[len - 1] == ' ' || value[len - 1] == '\t')) {
+        len--;
+    }
+    if (len == 0 || len > 18) {
+        return -1;
+    }
+    *length = 0;
+    for (i = 0; i < len; i++) {
+        if (!isdigit((unsigned char) value[i])) {
+            return -1;
+        }
+        *length = *length * 10 + (value[i] - '0');
+    }
+    return 0;
+}
+
+#define mk_http_method_is(method, str)                                  \
+    ((method).len == sizeof(str) - 1 &&                                 \
+     !strncmp((method).data, str, sizeof(str) - 1))
+
+/*
+ * authority = host [ ":" port ], host being a reg-name, an IPv4 address or
+ * an IP literal in brackets. Userinfo is refused, RFC 9110 4.2.4.
+ */
+static int mk_http_authority_parse(char *p, char *end,
+        struct mk_request_info *info, char **next)
+{
+    char *host = p, *port;
+    unsigned long value = 0;
+
+    if (p < end && *p == '[') {
+        p = memchr(p, ']', end - p);
+        if (p == NULL) {
+            return -1;
+        }
+        p++;
+    }
+    else {
+        while (p < end && *p != ':' && *p != '/' && *p != '?') {
+            if (*p == '@') {
+                return -1;
+            }
+            p++;
+        }
+    }
+    if (p == host) {
+        return -1;
+    }
+    info->host.data = host;
+    info->host.len = p - host;
+
+    if (p < end && *p == ':') {
+        for (port = ++p; p < end && isdigit((unsigned char) *p); p++) {
+            value = value * 10 + (*p - '0');
+        }
+        if (p == port || p - port > 5 || value > 65535) {
+            return -1;
+        }
+        info->port.data = port;
+        info->port.len = p - port;
+    }
+
+    *next = p;
+    return 0;
+}
+
+/* Classify the request-target, splitting the proxy forms */
+static int mk_http_target_process(struct mk_request_info *info)
+{
+    char *p = info->uri.data, *end = p + info->uri.len, *next;
+
+    if (mk_http_method_is(info->method, "CONNECT")) {
+        if (mk_http_authority_parse(p, end, info, &next) ||
+                next != end || info->port.len == 0) {
+            return -1;
+        }
+        info->target = MK_TARGET_AUTHORITY;
+        return 0;
+    }
+
+    if (*p == '/') {
+        info->target = MK_TARGET_ORIGIN;
+        return 0;
+    }
+
+    if (info->uri.len == 1 && *p == '*') {
+        if (!mk_http_method_is(info->method, "OPTIONS")) {
+            return -1;
+        }
+        info->target = MK_TARGET_ASTERISK;
+        return 0;
+    }
+
+    /* scheme "://" authority path-abempty [ "?" query ] */
+    if (!isalpha((unsigned char) *p)) {
+        return -1;
+    }
+    for (p++; p < end && (isalnum((unsigned char) *p) ||
+                          *p == '+' || *p == '-' || *p == '.'); p++);
+    if (end - p < 3 || memcmp(p, "://", 3)) {
+        return -1;
+    }
+    info->scheme.data = info->uri.data;
+    info->scheme.len = p - info->uri.data;
+
+    if (mk_http_authority_parse(p + 3, end, info, &next) ||
+            (next < end && *next != '/' && *next != '?')) {
+        return -1;
+    }
+    info->target = MK_TARGET_ABSOLUTE;
+    return 0;
 }
 
 static void parse_uri(mk_pointer uri, struct mk_request_info *info)
@@ -180,9 +263,25 @@ static void parse_uri(mk_pointer uri, struct mk_request_info *info)
     mk_pointer path;
     char *tmp;
 
+    switch (info->target) {
+    case MK_TARGET_ABSOLUTE:
+        tmp = mk_http_authority_end(info);
+        uri.len -= tmp - uri.data;
+        uri.data = tmp;
+        break;
+    case MK_TARGET_AUTHORITY:
+        uri.len = 0;
+        break;
+    case MK_TARGET_ASTERISK:
+        info->path = uri;
+        info->query.data = NULL;
+        info->query.len = 0;
+        return;
+    }
+
     for (i = 0; i < uri.len && uri.data[i] != '?'; i++);
     endPath = i;
-    if (i == '?') {
+    if (i < uri.len) {
         endQuery = uri.len;
     }
 
@@ -212,79 +311,51 @@ int mk_http_request_header(const struct mk_request_info *info,
         const char **value,
         size_t *value_len)
 {
-    char *d, *p;
-    off_t rem;
+    return mk_http_header_lookup(info, key, value, value_len);
+}
+
+int mk_http_request_host(const struct mk_request_info *info,
+        const char **host,
+        size_t *host_len)
+{
+    const char *value, *p;
     size_t len;
-    int quick_index;
-
-    quick_index = mk_http_quick_header_index(key);
-    if (quick_index >= 0) {
-        if (info->quick_headers[quick_index].value_len != 0) {
-            if (value != NULL) {
-                *value = info->headers.data +
-                    info->quick_headers[quick_index].value_index;
-            }
-            if (value_len != NULL) {
-                *value_len = info->quick_headers[quick_index].value_len;
-            }
-            return 0;
-        }
-        else {
-            return -1;
-        }
-    }
 
-    d = info->headers.data;
-    len = strlen(key);
+    if (info->target == MK_TARGET_ABSOLUTE ||
+            info->target == MK_TARGET_AUTHORITY) {
+        *host = info->host.data;
+        *host_len = info->host.len;
+        return 0;
+    }
 
-    do {
-        rem = info->headers.len - (d - info->headers.data);
-        p = memchr(d, ':', rem);
-        if (!p) {
-            break;
-        }
-        else if ((size_t)(p - d) == len) {
-            if (!strncasecmp(p - len, key, len)) {
-                for (; *p && (*p == ' '  || *p == ':'); p++);
-                if (value != NULL) {
-                    *value = p;
-                }
-                if (value_len != NULL) {
-                    rem = info->headers.len - (p - info->headers.data);
-                    d = memchr(p, '\n', rem);
-                    if (!d) {
-                            d = info->headers.data + info->headers.len;
-                    }
-                    if (d[-1] == '\r') {
-                        *value_len = d - p - 1;
-                    }
-                    else {
-                        *value_len = d - p;
-                    }
-                }
-                return 0;
-            }
-        }
-        rem = info->headers.len - (p - info->headers.data);
-        d = memchr(p, '\n', rem);
-        if (d) {
-            d++;
+    if (mk_http_header_lookup(info, "Host", &value, &len)) {
+        return -1;
+    }
+    if (len > 0 && value[0] == '[') {
+        p = memchr(value, ']', len);
+        p = p ? p + 1 : value + len;
+    }
+    else {
+        p = memchr(value, ':', len);
+        if (p == NULL) {
+            p = value + len;
         }
-    } while (p && d);
-
-    return -1;
+    }
+    *host = value;
+    *host_len = p - value;
+    return 0;
 }
 
 int http_request_info(struct mk_request *sr, struct mk_request_info *info)
 {
     const char *hostname;
     size_t hostname_len;
+    unsigned long start;
 
     if (sr->request.vhost == NULL) {
         MK_TRACE("Get vhost entry.");
 
-        if (!mk_http_request_header(&sr->request, "Host",
-                    &hostname, &hostname_len)) {
+        if (!mk_http_request_host(&sr->request, &hostname, &hostname_len)) {
             /*
              * TODO: Lookup vhost
             sr->request.vhost = mk_config_host_find(&config->host_list,
@@ -295,7 +366,9 @@ int http_request_info(struct mk_request *sr, struct mk_request_info *info)
     }
 
     if (sr->request.path.data == NULL && sr->request.uri.data != NULL) {
+        start = mk_http_timing_start();
         parse_uri(sr->request.uri, &sr->request);
+        mk_http_timing_end(MK_PHASE_URI, start);
     }
 
     *info = sr->request;
@@ -305,6 +378,7 @@ int http_request_info(struct mk_request *sr, struct mk_request_info *info)
 static void mk_http_premature_abort(struct mk_request *req, int status_code)
 {
     req->response.http_status = status_code;
+    req->response.error_page = mk_response_error(status_code);
 }
 
 static void mk_response_set_status(struct mk_request *req, int status_code)
@@ -312,53 +386,137 @@ static void mk_response_set_status(struct mk_request *req, int status_code)
     req->response.http_status = status_code;
 }
 
-static int mk_http_headers_process(struct mk_request_info *info)
+static const struct mk_request_key_policy *mk_http_key;
+
+void mk_http_key_policy(const struct mk_request_key_policy *policy)
 {
-    unsigned int i;
-    const char *key[MK_QUICK_HEADER_COUNT];
+    __atomic_store_n(&mk_http_key, policy, __ATOMIC_RELEASE);
+}
+
+static unsigned long mk_http_sink_max;
+
+void mk_http_body_sink_max(unsigned long max)
+{
+    __atomic_store_n(&mk_http_sink_max, max, __ATOMIC_RELAXED);
+}
+
+/* Largest Content-Length accepted, buffered or streamed */
+static inline unsigned long mk_http_body_limit()
+{
+    unsigned long max = __atomic_load_n(&mk_http_sink_max, __ATOMIC_RELAXED);
+
+    return max > MK_HTTP_BODY_MAX ? max : MK_HTTP_BODY_MAX;
+}
+
+/*
+ * Fold a header listed in the policy into info->key. Each name hashes
+ * with its own seed and the results are summed, so the order headers
+ * arrive in does not matter.
+ */
+static void mk_http_key_header(const struct mk_request_key_policy *policy,
+        struct mk_request_info *info, char *name, char *colon, char *eol)
+{
+    int i;
+    size_t name_len = colon - name;
+    char *value = colon + 1, *value_end = eol;
+
+    for (i = 0; i < policy->vary_count; i++) {
+        if (policy->vary[i].len == name_len &&
+                !strncasecmp(policy->vary[i].data, name, name_len)) {
+            break;
+        }
+    }
+    if (i == policy->vary_count) {
+        return;
+    }
+
+    while (value < value_end && (*value == ' ' || *value == '\t')) {
+        value++;
+    }
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t' ||
+                                 value_end[-1] == '\r' || value_end[-1] == '\n')) {
+        value_end--;
+    }
+    info->key += mk_hash64(value, value_end - value,
+                           policy->seed ^ (MK_HASH_P2 * (i + 1)));
+}
+
+/* Chain the fixed components into the folded headers */
+static void mk_http_key_final(const struct mk_request_key_policy *policy,
+        struct mk_request_info *info)
+{
+    uint64_t h = policy->seed;
+    const char *host = NULL;
+    size_t host_len = 0;
+
+    if (policy->fields & MK_KEY_METHOD) {
+        h = mk_hash64(info->method.data, info->method.len, h);
+    }
+    if (policy->fields & MK_KEY_HOST) {
+        /* the target authority replaces Host, RFC 9112 3.2.2 */
+        if (info->target == MK_TARGET_ABSOLUTE) {
+            host = info->host.data;
+            host_len = mk_http_authority_end(info) - host;
+        }
+        else {
+            mk_http_header_lookup(info, "Host", &host, &host_len);
+        }
+        h = mk_hash64(host, host_len, h);
+    }
+    if (policy->fields & MK_KEY_PATH) {
+        h = mk_hash64(info->path.data, info->path.len, h);
+    }
+    if (policy->fields & MK_KEY_QUERY) {
+        h = mk_hash64(info->query.data, info->query.len, h);
+    }
+    info->key = mk_hash_mum(h ^ MK_HASH_P2, info->key ^ MK_HASH_P1);
+}
+
+static int mk_http_headers_process(struct mk_request_info *info,
+        const struct mk_request_key_policy *policy)
+{
+    int i;
     char *d = info->headers.data, *p, *q;
+    char *end = info->headers.data + info->headers.len;
     off_t rem;
-    size_t len[MK_QUICK_HEADER_COUNT];
-    size_t length;
 
     MK_TRACE("[http] Process headers.");
 
-    for (i = 0; i < MK_QUICK_HEADER_COUNT; i++) {
-        key[i] = mk_quick_headers[i] ? mk_quick_headers[i] : "";
-        len[i] = strlen(key[i]);
-    }
-
     do {
-        rem = info->headers.len - (d - info->headers.data);
-        q = memchr(d, '\n', rem);
-        p = q ? memchr(d, ':', q - d) : NULL;
+        if (mk_http_scan_header_line(d, end, &p, &q)) {
+            MK_TRACE("[http] Invalid header line.");
+            return -1;
+        }
         if (!p) {
             info->headers.len = d - info->headers.data;
             MK_TRACE("[http] Header length is: %zd", info->headers.len);
             MK_TRACE("'''\n%.*s\n'''", (int)info->headers.len, info->headers.data);
             continue;
         }
-        length = (p - d);
-        for (i = 0; i < MK_QUICK_HEADER_COUNT; i++) {
-            if (length != len[i]) {
-                continue;
+        if (policy && policy->vary_count) {
+            mk_http_key_header(policy, info, d, p, q ? q : end);
+        }
+        i = mk_http_scan_header_id(d, p - d);
+        if (i == MK_HEADER_CONTENT_LENGTH &&
+                info->quick_headers[i].value_index != 0) {
+            /* Two lengths, which one frames the body is anyone's guess */
+            MK_TRACE("[http] Repeated Content-Length.");
+            return -1;
+        }
+        if (i >= 0) {
+            MK_TRACE("[http] Quick header %i set", i);
+            for (; *p && (*p == ' '  || *p == ':'); p++);
+            info->quick_headers[i].value_index = p - info->headers.data;
+            rem = info->headers.len - (p - info->headers.data);
+            d = memchr(p, '\n', rem);
+            if (!d) {
+                d = info->headers.data + info->headers.len;
             }
-            if (!strncasecmp(p - len[i], key[i], len[i])) {
-                MK_TRACE("[http] Quick header '%s' set", key[i]);
-                for (; *p && (*p == ' '  || *p == ':'); p++);
-                info->quick_headers[i].value_index = p - info->headers.data;
-                rem = info->headers.len - (p - info->headers.data);
-                d = memchr(p, '\n', rem);
-                if (!d) {
-                    d = info->headers.data + info->headers.len;
-                }
-                if (d[-1] == '\r') {
-                    info->quick_headers[i].value_len = d - p - 1;
-                }
-                else {
-                    info->quick_headers[i].value_len = d - p;
-                }
-                break;
+            if (d[-1] == '\r') {
+                info->quick_headers[i].value_len = d - p - 1;
+            }
+            else {
+                info->quick_headers[i].value_len = d - p;
             }
         }
 
@@ -372,66 +530,213 @@ static int mk_http_headers_process(struct mk_request_info *info)
     return 0;
 }
 
-static int mk_http_header_parse(mk_pointer request, struct mk_request_info *info)
+/* Whether a comma separated header value lists token, protocol/version too */
+static int mk_http_token_list_has(const char *value, size_t len,
+        const char *token, size_t token_len)
 {
-    unsigned int method_len = 0, uri_len = 0, protocol_len = 0, headers_len = 0;
-    char *method, *uri, *protocol, *headers, *tmp;
+    const char *p, *end = value + len, *start;
 
-    method = request.data;
-    tmp = memchr(method, ' ', request.len);
-    if (tmp == NULL) {
-        MK_TRACE("Error, first header can't be parsed.");
-        return -1;
+    for (p = value; p < end; p++) {
+        if (*p == ' ' || *p == '\t' || *p == ',') {
+            continue;
+        }
+        start = p;
+        while (p < end && *p != ',' && *p != ' ' && *p != '\t' && *p != '/') {
+            p++;
+        }
+        if ((size_t) (p - start) == token_len &&
+                !strncasecmp(start, token, token_len)) {
+            return 1;
+        }
+        while (p < end && *p != ',') {
+            p++;
+        }
     }
-    method_len = tmp - method;
+    return 0;
+}
 
-    uri = tmp + 1;
-    if (*uri != '/') {
-        MK_TRACE("Error, first header can't be parsed.");
+/*
+ * Opening handshake of RFC 6455 4.2.1. A bad Sec-WebSocket-Version
+ * should get 426 with the supported versions, 400 covers it here.
+ */
+static int mk_http_websocket_check(struct mk_request_info *info)
+{
+    const char *value;
+    size_t len;
+
+    if (mk_http_method_check(info->method) != HTTP_METHOD_GET ||
+            mk_http_protocol_check(info->protocol) != HTTP_PROTOCOL_11) {
         return -1;
     }
-    for (tmp = uri; tmp && *tmp != ' ' && *tmp != '\n'; tmp++);
-    if (*tmp != ' ') {
-        MK_TRACE("Error, first header can't be parsed.");
+    if (mk_http_header_lookup(info, "Sec-WebSocket-Version", &value, &len) ||
+            len != 2 || value[0] != '1' || value[1] != '3') {
+        return -1;
+    }
+    if (mk_http_header_lookup(info, "Sec-WebSocket-Key", &value, &len) ||
+            !mk_websocket_key_valid(value, len)) {
         return -1;
     }
-    uri_len = tmp - uri;
+    return 0;
+}
+
+/*
+ * Decide whether the connection persists after this request: HTTP/1.1
+ * keeps it unless "close" is listed in Connection, HTTP/1.0 closes it
+ * unless "keep-alive" is listed. An "upgrade" token together with an
+ * Upgrade header hands the connection over to another protocol.
+ */
+static void mk_http_connection_process(struct mk_request_info *info)
+{
+    const char *value, *p, *end, *token;
+    size_t len, token_len;
+    int close = 0, keep_alive = 0, upgrade = 0;
+
+    info->connection = 0;
+
+    if (!mk_http_header_lookup(info, "Connection", &value, &len)) {
+        end = value + len;
+        for (p = value; p < end; p++) {
+            if (*p == ' ' || *p == '\t' || *p == ',') {
+                continue;
+            }
+            token = p;
+            while (p < end && *p != ',' && *p != ' ' && *p != '\t') {
+                p++;
+            }
+            token_len = p - token;
+
+            if (token_len == sizeof("close") - 1 &&
+                    !strncasecmp(token, "close", token_len)) {
+                close = 1;
+            }
+            else if (token_len == sizeof("keep-alive") - 1 &&
+                    !strncasecmp(token, "keep-alive", token_len)) {
+                keep_alive = 1;
+            }
+            else if (token_len == sizeof("upgrade") - 1 &&
+                    !strncasecmp(token, "upgrade", token_len)) {
+                upgrade = 1;
+            }
+        }
+    }
 
-    protocol = tmp + 1;
-    tmp = memchr(protocol, '\n', request.len - (protocol - request.data));
-    if (tmp == NULL) {
+    if (upgrade && !mk_http_header_lookup(info, "Upgrade", &value, &len)) {
+        info->connection |= MK_CONN_UPGRADE;
+        if (mk_http_token_list_has(value, len, "websocket",
+                                   sizeof("websocket") - 1)) {
+            info->connection |= MK_CONN_WEBSOCKET;
+        }
+    }
+
+    if (close) {
+        return;
+    }
+    switch (mk_http_protocol_check(info->protocol)) {
+    case HTTP_PROTOCOL_11:
+        info->connection |= MK_CONN_KEEP_ALIVE;
+        break;
+    case HTTP_PROTOCOL_10:
+        if (keep_alive) {
+            info->connection |= MK_CONN_KEEP_ALIVE;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static int mk_http_header_parse(mk_pointer request, struct mk_request_info *info,
+        const struct mk_request_key_policy *policy)
+{
+    unsigned int headers_len = 0;
+    unsigned long start;
+    mk_pointer method, uri, protocol;
+    char *headers;
+    int ret;
+
+    start = mk_http_timing_start();
+    headers = mk_http_scan_request_line(request.data,
+                                        request.data + request.len,
+                                        &method, &uri, &protocol);
+    mk_http_timing_end(MK_PHASE_REQUEST_LINE, start);
+    if (headers == NULL) {
         MK_TRACE("Error, first header can't be parsed.");
         return -1;
     }
-    protocol_len = tmp - protocol - 1;
-
-    headers = tmp + 1;
     headers_len = (request.data + request.len) - headers; // Just guessing.
 
     memset(info, 0, sizeof(*info));
-    info->protocol.data = protocol;
-    info->protocol.len = protocol_len;
-    info->method.data = method;
-    info->method.len = method_len;
-    info->uri.data = uri;
-    info->uri.len = uri_len;
+    info->protocol = protocol;
+    info->method = method;
+    info->uri = uri;
     info->headers.data = headers;
     info->headers.len = headers_len;
 
-    if (headers_len == sizeof(MK_ENDBLOCK) - 3) {
-        // First data is endblock.
-        info->headers.len = 0;
-        return 0;
-    }
-    else if (mk_http_headers_process(info)) {
+    if (mk_http_target_process(info)) {
+        MK_TRACE("Error, invalid request-target.");
         return -1;
     }
+
+    if (headers_len == sizeof(MK_ENDBLOCK) - 3 &&
+            headers[0] == '\r' && headers[1] == '\n') {
+        // First data is endblock. Two other bytes are the start of a
+        // header line still being received, left to the header scan.
+        info->headers.len = 0;
+    }
     else {
+        start = mk_http_timing_start();
+        ret = mk_http_headers_process(info, policy);
+        mk_http_timing_end(MK_PHASE_HEADERS, start);
+        if (ret) {
+            return -1;
+        }
+    }
+
+    mk_http_connection_process(info);
+    return 0;
+}
+
+/* Does the path hold ".."? Not memmem(), which only glibc's _GNU_SOURCE declares */
+static int mk_http_path_dot_dot(mk_pointer path)
+{
+    const char *p = path.data, *end;
+
+    if (path.len < 2) {
         return 0;
     }
+    end = path.data + path.len - 1;
+    while ((p = memchr(p, '.', end - p)) != NULL) {
+        if (p[1] == '.') {
+            return 1;
+        }
+        p++;
+    }
+    return 0;
 }
 
-static int mk_http_sanity_check(struct mk_request *sr)
+/*
+ * Does the path hold a percent-encoded '.'? Unreserved characters have no
+ * reason to be encoded (RFC 3986 2.3), and "%2e%2e" would slip a dot
+ * segment past the ".." check since the path stays encoded.
+ */
+static int mk_http_path_dot_escaped(mk_pointer path)
+{
+    const char *p = path.data, *end = path.data + path.len;
+
+    while ((p = memchr(p, '%', end - p)) != NULL) {
+        if (end - p >= 3 && p[1] == '2' && (p[2] | 0x20) == 'e') {
+            return 1;
+        }
+        p++;
+    }
+    return 0;
+}
+
+/*
+ * Check the request before processing it. With body_complete unset only
+ * the checks not needing the body run, see mk_http_expect_process().
+ */
+static int mk_http_sanity_check(struct mk_request *sr, int body_complete)
 {
     struct mk_request_info info;
     unsigned long content_length;
@@ -445,14 +750,32 @@ static int mk_http_sanity_check(struct mk_request *sr)
 
     http_request_info(sr, &info);
 
+    /* Only HTTP/1.x and HTTP/0.9 are spoken here */
+    if (mk_http_protocol_check(info.protocol) == HTTP_PROTOCOL_UNKNOWN) {
+        MK_TRACE("[http] Unsupported protocol version.");
+        mk_response_set_status(sr, MK_SERVER_HTTP_VERSION_UNSUP);
+        goto error;
+    }
+
     /* Check backward directory request */
-    if (memmem(info.path.data, info.path.len, "..", sizeof("..") - 1)) {
+    if (mk_http_path_dot_dot(info.path) ||
+            mk_http_path_dot_escaped(info.path)) {
         mk_response_set_status(sr, MK_CLIENT_FORBIDDEN);
         goto error;
     }
 
-    if (!mk_http_request_header(&info, "Host", &header, &len)) {
-        tmp = memchr(header, ':', len);
+    if (!mk_http_header_lookup(&info, "Host", &header, &len)) {
+        tmp = header;
+        if (len > 0 && header[0] == '[') {
+            /* IP literal, its colons are not the port separator */
+            tmp = memchr(header, ']', len);
+            if (tmp == NULL || (++tmp < header + len && *tmp != ':')) {
+                MK_TRACE("[http] Invalid IP literal in Host.");
+                mk_response_set_status(sr, MK_CLIENT_BAD_REQUEST);
+                goto error;
+            }
+        }
+        tmp = memchr(tmp, ':', (header + len) - tmp);
         if (tmp) {
             tmp += 1;
             len = (header + len) - tmp;
@@ -498,7 +821,7 @@ error_port:
             }
 ok_port:
             for (i = 0; i < len; i++) {
-                if (!isdigit(tmp[i])) {
+                if (!isdigit((unsigned char) tmp[i])) {
                     mk_response_set_status(sr, MK_CLIENT_BAD_REQUEST);
                     goto error;
                 }
@@ -511,24 +834,31 @@ ok_port:
         goto error;
     }
 
+    if ((info.connection & MK_CONN_WEBSOCKET) &&
+            mk_http_websocket_check(&info)) {
+        MK_TRACE("[http] Invalid WebSocket handshake.");
+        mk_response_set_status(sr, MK_CLIENT_BAD_REQUEST);
+        goto error;
+    }
+
     method = mk_http_method_check(info.method);
     if (method == HTTP_METHOD_POST || method == HTTP_METHOD_PUT) {
-        if (mk_http_request_header(&info, "Content-Length", &header, &len)) {
+        if (mk_http_header_lookup(&info, "Content-Length", &header, &len)) {
             MK_TRACE("Content length required.");
             mk_response_set_status(sr, MK_CLIENT_LENGTH_REQUIRED);
             goto error;
         }
-        else if (sscanf(header, "%lu", &content_length) != 1) {
+        else if (mk_http_length_parse(header, len, &content_length)) {
             MK_TRACE("Failed to get content length.");
             mk_response_set_status(sr, MK_CLIENT_BAD_REQUEST);
             goto error;
         }
-        else if (content_length > 4096 /* (size_t)config->max_request_size */) {
+        else if (content_length > mk_http_body_limit()) {
             MK_TRACE("[http] Too large POST request, abort.");
             mk_response_set_status(sr, MK_CLIENT_REQUEST_ENTITY_TOO_LARGE);
             goto error;
         }
-        else if (content_length != info.body.len) {
+        else if (body_complete && content_length != info.body.len) {
             MK_TRACE("Content length does not match body size, %zd != %zd",
                     content_length, info.body.len);
             mk_response_set_status(sr, MK_CLIENT_BAD_REQUEST);
@@ -541,35 +871,105 @@ ok_port:
     sr->state = MK_RESPONSE_NEW;
     return 0;
 error:
-    /*
-     * TODO: Add error page to response.
-    mk_response_error_page(sr);
-    mk_response_end(sr);
-     */
+    sr->response.error_page = mk_response_error(sr->response.http_status);
     return -1;
 }
 
+/*
+ * The client sent Expect: 100-continue and waits before uploading the
+ * body. Run the checks not needing it right away, so it gets either the
+ * interim 100 response or the final rejection before sending anything.
+ * HTTP/1.0 clients do not know about it, the expectation is ignored.
+ */
+static int mk_http_expect_process(struct mk_request *sr,
+        struct mk_request_info *info)
+{
+    const char *value;
+    size_t len;
+
+    if (mk_http_header_lookup(info, "Expect", &value, &len) ||
+            mk_http_protocol_check(info->protocol) != HTTP_PROTOCOL_11) {
+        return 0;
+    }
+
+    if (len != sizeof("100-continue") - 1 ||
+            strncasecmp(value, "100-continue", len)) {
+        MK_TRACE("[http] Unknown expectation '%.*s'.", (int)len, value);
+        mk_http_premature_abort(sr, MK_CLIENT_EXPECTATION_FAILED);
+        return -1;
+    }
+
+    sr->request = *info;
+    if (mk_http_sanity_check(sr, 0)) {
+        MK_TRACE("[http] Expectation rejected.");
+        return -1;
+    }
+
+    /* Still waiting for the body */
+    sr->state = MK_RESPONSE_UNUSED;
+    sr->response.http_status = MK_INFO_CONTINUE;
+    sr->response.interim = mk_response_continue();
+    return 0;
+}
+
+/*
+ * Return the head of a request whose body is too large for the buffer,
+ * the caller moves the body, see mk_body_sink_init(). The checks not
+ * needing the body run now, as for an expectation.
+ */
+static int mk_http_body_stream(struct mk_request *sr,
+        struct mk_request_info *info)
+{
+    if (info->body.len > info->content_length) {
+        info->body.len = info->content_length;
+    }
+
+    sr->request = *info;
+    if (info->body.len == 0 && mk_http_expect_process(sr, info)) {
+        return -1;
+    }
+    if (sr->response.interim == NULL && mk_http_sanity_check(sr, 0)) {
+        return -1;
+    }
+    sr->state = MK_RESPONSE_STREAM;
+    return 0;
+}
+
 static void mk_http_request_init(struct mk_request *sr)
 {
     sr->next = NULL;
     sr->state = MK_RESPONSE_UNUSED;
+    memset(&sr->response, 0, sizeof(sr->response));
 }
 
-int mk_http_parser(struct mk_request *sr,
+void mk_http_request_release(struct mk_request *sr)
+{
+    struct mk_request *next;
+
+    while (sr->next) {
+        next = sr->next->next;
+        free(sr->next);
+        sr->next = next;
+    }
+}
+
+static int mk_http_parser_run(struct mk_request *sr,
         char *buffer,
         size_t length)
 {
-    int method;
+    int method, ret;
     char *cur;
-    const char *header;
-    size_t len;
-    size_t content_length = 0;
+    unsigned long content_length = 0;
+    const struct mk_quick_header *cl;
+    unsigned long start;
+    const struct mk_request_key_policy *policy;
     struct mk_request *current_request = sr;
     struct mk_request_info info;
     mk_pointer request;
     unsigned int i;
 
     mk_http_request_init(current_request);
+    policy = __atomic_load_n(&mk_http_key, __ATOMIC_ACQUIRE);
 
     cur = buffer;
     do {
@@ -582,24 +982,61 @@ int mk_http_parser(struct mk_request *sr,
             return 0;
         }
 
-        if (mk_http_header_parse(request, &info)) {
+        if (mk_http_header_parse(request, &info, policy)) {
             MK_TRACE("[http] Failed to parse headers.");
             mk_http_premature_abort(current_request, MK_CLIENT_BAD_REQUEST);
             goto error;
         }
 
         cur = info.headers.data + info.headers.len + 2;
-        if (strncmp(cur - 4, MK_ENDBLOCK, sizeof(MK_ENDBLOCK) - 1)) {
+        if (cur > buffer + length ||
+                strncmp(cur - 4, MK_ENDBLOCK, sizeof(MK_ENDBLOCK) - 1)) {
             MK_TRACE("[http] No endblock in request, wait.");
             return 0;
         }
 
+        if (current_request->state != MK_RESPONSE_UNUSED) {
+            // Pipelined requests
+            current_request->next = malloc(sizeof(*current_request));
+            if (current_request->next == NULL) {
+                printf("Malloc() failed: %s", strerror(errno));
+                mk_http_premature_abort(current_request, MK_SERVER_INTERNAL_ERROR);
+                goto error;
+            }
+            current_request = current_request->next;
+            mk_http_request_init(current_request);
+        }
+
+        /*
+         * Bodies are framed by Content-Length only. A chunked body would
+         * be parsed as the next pipelined request, so refuse the coding
+         * whether or not a Content-Length comes with it.
+         */
+        if (info.quick_headers[MK_HEADER_TRANSFER_ENCODING].value_index) {
+            MK_TRACE("[http] Transfer-Encoding in request, abort.");
+            mk_http_premature_abort(current_request, MK_SERVER_NOT_IMPLEMENTED);
+            goto error;
+        }
+
+        /*
+         * Any method may send a body, a Content-Length frames it whatever
+         * the method: left unframed, the body would be taken for the next
+         * pipelined request.
+         */
+        start = mk_http_timing_start();
         method = mk_http_method_check(info.method);
-        if (method == HTTP_METHOD_POST) {
-            if (!mk_http_request_header(&info, "Content-Length", &header, &len)) {
-                sscanf(header, "%lu", &content_length);
+        cl = &info.quick_headers[MK_HEADER_CONTENT_LENGTH];
+        if (cl->value_index != 0 ||
+                method == HTTP_METHOD_POST || method == HTTP_METHOD_PUT) {
+            content_length = 0;
+            if (cl->value_index != 0 &&
+                    mk_http_length_parse(info.headers.data + cl->value_index,
+                                         cl->value_len, &content_length)) {
+                MK_TRACE("[http] Invalid Content-Length, abort.");
+                mk_http_premature_abort(current_request, MK_CLIENT_BAD_REQUEST);
+                goto error;
             }
-            if (content_length > 4096 /* (size_t)config->max_request_size */) {
+            if (content_length > mk_http_body_limit()) {
                 MK_TRACE("[http] Too large POST request, abort.");
                 mk_http_premature_abort(current_request, MK_CLIENT_REQUEST_ENTITY_TOO_LARGE);
                 goto error;
@@ -607,36 +1044,53 @@ int mk_http_parser(struct mk_request *sr,
 
             info.body.data = cur;
             info.body.len = (buffer + length) - cur;
-            cur = buffer + length;
+            info.content_length = content_length;
+
+            if (content_length > MK_HTTP_BODY_MAX) {
+                MK_TRACE("[http] Body left to the caller.");
+                mk_http_timing_end(MK_PHASE_BODY, start);
+                if (mk_http_body_stream(current_request, &info)) {
+                    goto error;
+                }
+                return 0;
+            }
 
             if (content_length > info.body.len) {
                 MK_TRACE("[http] Partial post request.");
+                mk_http_timing_end(MK_PHASE_BODY, start);
+                if (info.body.len == 0 &&
+                        mk_http_expect_process(current_request, &info)) {
+                    goto error;
+                }
                 return 0;
             }
-            else if (content_length < info.body.len) {
-                MK_TRACE("[http] Extra data in POST body.");
-                mk_http_premature_abort(current_request, MK_CLIENT_BAD_REQUEST);
-                goto error;
-            }
-        }
 
-        if (current_request != sr) {
-            // Pipelined requests
-            current_request->next = malloc(sizeof(*current_request));
-            if (current_request->next == NULL) {
-                printf("Malloc() failed: %s", strerror(errno));
-                mk_http_premature_abort(current_request, MK_SERVER_INTERNAL_ERROR);
-                goto error;
-            }
-            current_request = current_request->next;
-            mk_http_request_init(current_request);
+            /* A pipelined request may follow the body */
+            info.body.len = content_length;
+            cur += content_length;
         }
+
+        mk_http_timing_end(MK_PHASE_BODY, start);
+
         current_request->state = MK_RESPONSE_NEW;
         current_request->request = info;
 
-        if (mk_http_sanity_check(current_request)) {
+        start = mk_http_timing_start();
+        ret = mk_http_sanity_check(current_request, 1);
+        mk_http_timing_end(MK_PHASE_SANITY, start);
+        if (ret) {
             MK_TRACE("[http] Sanity check failed.");
             cur = buffer + length;
+            continue;
+        }
+
+        if (policy) {
+            mk_http_key_final(policy, &current_request->request);
+        }
+        if (!(info.connection & MK_CONN_KEEP_ALIVE) ||
+                (info.connection & MK_CONN_UPGRADE)) {
+            MK_TRACE("[http] Connection not persistent, ignore pipeline.");
+            cur = buffer + length;
         }
     } while (cur < buffer + length);
 
@@ -644,3 +1098,267 @@ int mk_http_parser(struct mk_request *sr,
 error:
     return -1;
 }
+
+#if MK_HTTP_STATS
+/* Account a parser call from the requests it left in the chain */
+static void mk_http_stats_account(struct mk_request *sr, size_t length)
+{
+    int depth = 0, status, protocol;
+    enum mk_http_method method;
+    struct mk_http_stats *st;
+
+    st = mk_http_stats_thread();
+    if (st == NULL) {
+        return;
+    }
+
+    mk_http_stats_begin(st);
+    st->c.calls++;
+    st->c.bytes += length;
+
+    for (; sr; sr = sr->next) {
+        status = sr->response.http_status;
+        if (status >= MK_STATS_STATUS_FIRST &&
+                status < MK_STATS_STATUS_FIRST + MK_STATS_STATUS_COUNT) {
+            st->c.errors[status - MK_STATS_STATUS_FIRST]++;
+        }
+        if (sr->state != MK_RESPONSE_NEW && sr->state != MK_RESPONSE_STREAM) {
+            if (sr->state == MK_RESPONSE_UNUSED && sr->next == NULL &&
+                    status < MK_STATS_STATUS_FIRST) {
+                st->c.pending++;
+            }
+            continue;
+        }
+
+        depth++;
+        method = mk_http_method_check(sr->request.method);
+        st->c.methods[method == HTTP_METHOD_UNKNOWN ?
+                      MK_STATS_METHODS - 1 : method]++;
+        protocol = mk_http_protocol_check(sr->request.protocol);
+        st->c.protocols[protocol == HTTP_PROTOCOL_UNKNOWN ?
+                        MK_STATS_PROTOCOLS - 1 : protocol - HTTP_PROTOCOL_09]++;
+    }
+
+    st->c.requests += depth;
+    if (depth > 0) {
+        st->c.pipeline[(depth < MK_STATS_PIPELINE ?
+                        depth : MK_STATS_PIPELINE) - 1]++;
+    }
+    mk_http_stats_end(st);
+}
+#endif
+
+int mk_http_parser(struct mk_request *sr,
+        char *buffer,
+        size_t length)
+{
+    int ret;
+
+    ret = mk_http_parser_run(sr, buffer, length);
+#if MK_HTTP_STATS
+    if (mk_http_stats_enabled) {
+        mk_http_stats_account(sr, length);
+    }
+#endif
+    return ret;
+}
+
+/* Transfer-Encoding ends with "chunked" */
+static int mk_http_chunked_final(const char *value, size_t len)
+{
+    const char *p = value + len;
+
+    while (p > value && (p[-1] == ' ' || p[-1] == '\t')) {
+        p--;
+    }
+    len = p - value;
+    if (len < sizeof("chunked") - 1) {
+        return 0;
+    }
+    p -= sizeof("chunked") - 1;
+    if (strncasecmp(p, "chunked", sizeof("chunked") - 1)) {
+        return 0;
+    }
+    return p == value || p[-1] == ',' || p[-1] == ' ' || p[-1] == '\t';
+}
+
+/*
+ * Walk a chunked body starting at p. Returns the end of the body, last
+ * chunk and trailer section included, or NULL while it is incomplete or
+ * when *error got set. *size receives the decoded length.
+ */
+static char *mk_http_chunked_end(char *p, char *end,
+        unsigned long *size, int *error)
+{
+    unsigned long chunk;
+    char *eol, *digits;
+
+    *size = 0;
+    for (;;) {
+        chunk = 0;
+        for (digits = p; p < end && isxdigit((unsigned char) *p); p++) {
+            if (chunk >> (sizeof(chunk) * 8 - 8)) {
+                MK_TRACE("[http] Chunk size too large.");
+                *error = 1;
+                return NULL;
+            }
+            chunk = chunk * 16 +
+                (isdigit((unsigned char) *p) ? *p - '0' : (*p | 0x20) - 'a' + 10);
+        }
+        if (p == end) {
+            return NULL;
+        }
+        if (p == digits) {
+            MK_TRACE("[http] Invalid chunk size.");
+            *error = 1;
+            return NULL;
+        }
+
+        /* chunk extensions are skipped */
+        eol = memchr(p, '\n', end - p);
+        if (eol == NULL) {
+            return NULL;
+        }
+        p = eol + 1;
+        if (chunk == 0) {
+            break;
+        }
+
+        if ((unsigned long) (end - p) < chunk + 2) {
+            return NULL;
+        }
+        p += chunk;
+        if (p[0] != '\r' || p[1] != '\n') {
+            MK_TRACE("[http] Chunk data overflows its size.");
+            *error = 1;
+            return NULL;
+        }
+        p += 2;
+        *size += chunk;
+    }
+
+    /* trailer section, ends with a blank line */
+    for (;;) {
+        eol = memchr(p, '\n', end - p);
+        if (eol == NULL) {
+            return NULL;
+        }
+        if (eol == p || (eol == p + 1 && *p == '\r')) {
+            return eol + 1;
+        }
+        p = eol + 1;
+    }
+}
+
+static int mk_http_framing_process(struct mk_http_upstream *res, int flags)
+{
+    struct mk_request_info *info = &res->info;
+    const char *value;
+    size_t len;
+
+    if ((flags & MK_HTTP_RESPONSE_HEAD) || res->status / 100 == 1 ||
+            res->status == MK_SUCCESS_NOCONTENT ||
+            res->status == MK_NOT_MODIFIED) {
+        res->framing = MK_BODY_NONE;
+    }
+    else if (!mk_http_header_lookup(info, "Transfer-Encoding", &value, &len)) {
+        /* without chunked last, only the end of the connection frames it */
+        res->framing = mk_http_chunked_final(value, len) ?
+            MK_BODY_CHUNKED : MK_BODY_CLOSE;
+    }
+    else if (!mk_http_header_lookup(info, "Content-Length", &value, &len)) {
+        if (mk_http_length_parse(value, len, &res->content_length)) {
+            MK_TRACE("[http] Invalid upstream content length.");
+            return -1;
+        }
+        res->framing = MK_BODY_LENGTH;
+    }
+    else {
+        res->framing = MK_BODY_CLOSE;
+    }
+
+    if (res->framing == MK_BODY_CLOSE) {
+        info->connection &= ~MK_CONN_KEEP_ALIVE;
+    }
+    return 0;
+}
+
+int mk_http_response_parser(struct mk_http_upstream *res,
+        char *buffer, size_t length, int flags)
+{
+    char *headers, *cur, *tmp, *end = buffer + length;
+    struct mk_request_info *info = &res->info;
+    int error = 0;
+
+    memset(res, 0, sizeof(*res));
+
+    if (memchr(buffer, '\n', length) == NULL) {
+        MK_TRACE("[http] Partial status line, wait.");
+        return MK_HTTP_PENDING;
+    }
+
+    headers = mk_http_scan_status_line(buffer, end, &info->protocol,
+                                       &res->status, &res->reason);
+    if (headers == NULL) {
+        MK_TRACE("[http] Invalid status line.");
+        return MK_HTTP_ERROR;
+    }
+
+    info->headers.data = headers;
+    info->headers.len = end - headers;
+    if (mk_http_headers_process(info, NULL)) {
+        return MK_HTTP_ERROR;
+    }
+
+    cur = info->headers.data + info->headers.len;
+    if (end - cur < 2 || cur[0] != '\r' || cur[1] != '\n') {
+        MK_TRACE("[http] No endblock in response, wait.");
+        return MK_HTTP_PENDING;
+    }
+    cur += 2;
+
+    mk_http_connection_process(info);
+    if (mk_http_framing_process(res, flags)) {
+        return MK_HTTP_ERROR;
+    }
+
+    info->body.data = cur;
+    info->body.len = end - cur;
+
+    switch (res->framing) {
+    case MK_BODY_LENGTH:
+        if (info->body.len < res->content_length) {
+            return MK_HTTP_PENDING;
+        }
+        info->body.len = res->content_length;
+        break;
+    case MK_BODY_CHUNKED:
+        tmp = mk_http_chunked_end(cur, end, &res->content_length, &error);
+        if (error) {
+            return MK_HTTP_ERROR;
+        }
+        else if (tmp == NULL) {
+            res->content_length = 0;
+            return MK_HTTP_PENDING;
+        }
+        info->body.len = tmp - cur;
+        break;
+    case MK_BODY_CLOSE:
+        if (!(flags & MK_HTTP_RESPONSE_EOF)) {
+            return MK_HTTP_PENDING;
+        }
+        res->content_length = info->body.len;
+        break;
+    default:
+        info->body.len = 0;
+        break;
+    }
+
+    return MK_HTTP_OK;
+}
+
+int mk_http_parser_events(const struct mk_http_callbacks *cb, void *data,
+        char *buffer, size_t length)
+{
+    return mk_http_events_run(cb, data, buffer, length);
+}
@@ -20,10 +20,17 @@
 #ifndef MK_HTTP_PARSER_H
 #define MK_HTTP_PARSER_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "mk_http_status.h"
+
 /* General status */
 #define MK_HTTP_PENDING -10  /* cannot complete until more data arrives */
 #define MK_HTTP_ERROR    -1  /* found an error when parsing the string */
 #define MK_HTTP_OK        0
+#define MK_HTTP_STOPPED  -2  /* a callback stopped the parser */
 
 typedef struct
 {
@@ -35,7 +42,21 @@ struct vhost {
     char *hostname;
 };
 
-#define MK_QUICK_HEADER_COUNT (8)
+#define MK_QUICK_HEADER_COUNT (9)
+
+/* Headers indexed while parsing, see mk_http_scan_header_id() */
+enum mk_quick_header_id {
+    MK_HEADER_OTHER             = -1,
+    MK_HEADER_HOST              =  0,
+    MK_HEADER_ACCEPT_ENCODING   =  1,
+    MK_HEADER_LAST_MODIFIED     =  2,
+    MK_HEADER_IF_MODIFIED_SINCE =  3,
+    MK_HEADER_RANGE             =  4,
+    MK_HEADER_CONTENT_LENGTH    =  5,
+    MK_HEADER_CONNECTION        =  6,
+    MK_HEADER_EXPECT            =  7,
+    MK_HEADER_TRANSFER_ENCODING =  8
+};
 #define MK_REQUEST_FILTER_COUNT (4)
 
 struct mk_quick_header
@@ -44,19 +65,60 @@ struct mk_quick_header
     unsigned int value_len;
 };
 
+/* Connection persistence, decided from the protocol and Connection */
+#define MK_CONN_KEEP_ALIVE  (1 << 0)   /* connection can take another request */
+#define MK_CONN_UPGRADE     (1 << 1)   /* switching to the Upgrade protocol */
+#define MK_CONN_WEBSOCKET   (1 << 2)   /* WebSocket opening handshake */
+
+/*
+ * Request-target forms (RFC 9112 3.2). Absolute-form and authority-form
+ * targets are split into scheme, host and port views of the request line;
+ * host keeps the brackets of an IP literal. An absolute-form target with
+ * no path leaves path empty, it stands for "/".
+ */
+enum mk_target_form {
+    MK_TARGET_ORIGIN = 0,   /* /path?query */
+    MK_TARGET_ABSOLUTE,     /* scheme://host[:port]/path?query, to a proxy */
+    MK_TARGET_AUTHORITY,    /* host:port, CONNECT only */
+    MK_TARGET_ASTERISK,     /* *, OPTIONS only */
+};
+
 struct mk_request_info {
     mk_pointer method;
     mk_pointer protocol;
     mk_pointer uri;
     mk_pointer path;
     mk_pointer query;
+    int target;             /* enum mk_target_form */
+    mk_pointer scheme;
+    mk_pointer host;
+    mk_pointer port;
     mk_pointer headers;
     mk_pointer body;
+    unsigned long content_length;   /* whole body, from Content-Length */
     struct vhost *vhost;
+    int connection;
+    uint64_t key;           /* fingerprint, see mk_http_key_policy() */
 
     struct mk_quick_header quick_headers[MK_QUICK_HEADER_COUNT];
 };
 
+/* First byte after a parsed request, where a pipelined one starts */
+static inline char *mk_http_request_end(const struct mk_request_info *info)
+{
+    if (info->body.data != NULL) {
+        return info->body.data + info->body.len;
+    }
+    return info->headers.data + info->headers.len + 2;
+}
+
+/* End of the authority of an absolute-form or authority-form target */
+static inline char *mk_http_authority_end(const struct mk_request_info *info)
+{
+    return info->port.data ? info->port.data + info->port.len :
+        info->host.data + info->host.len;
+}
+
 enum mk_response_state {
     MK_RESPONSE_UNUSED = 0,
     MK_RESPONSE_NEW = 1,
@@ -64,10 +126,17 @@ enum mk_response_state {
     MK_RESPONSE_BODY = 3,
     MK_RESPONSE_FILTER = 4,
     MK_RESPONSE_DONE = 5,
+    MK_RESPONSE_STREAM = 6,     /* head parsed, body left to a sink */
 };
 
 struct mk_response_info {
     int http_status;
+    const struct iovec *error_page;   /* canned response, see mk_response_error() */
+    const struct iovec *interim;      /* 100 Continue to send before the body */
+
+    /* response ready to be sent, set by mk_response_done() */
+    const struct iovec *iov;
+    int iov_count;
 };
 
 struct mk_request {
@@ -81,27 +150,119 @@ int mk_http_parser(struct mk_request *sr,
         char *buffer,
         size_t length);
 
+/*
+ * Lookup a header of a parsed request, quick headers are answered from
+ * the index. Returns 0 when found, -1 otherwise.
+ */
+int mk_http_request_header(const struct mk_request_info *info,
+        const char *key,
+        const char **value,
+        size_t *value_len);
+
+/*
+ * Host the request is for, the one vhost selection uses: the target's
+ * for absolute-form and authority-form, the Host header otherwise, both
+ * without the port. Returns 0 when found, -1 otherwise.
+ */
+int mk_http_request_host(const struct mk_request_info *info,
+        const char **host,
+        size_t *host_len);
+
+/*
+ * Request fingerprint
+ * ===================
+ *
+ * A 64-bit hash over the request components selected by a key policy,
+ * folded in while the parser scans them and stored in info->key, ready
+ * to be used as a response cache key. The method, Host and path are
+ * hashed in that order. The headers listed in vary are hashed wherever
+ * they appear, so the same set of headers in a different order gives the
+ * same key; a missing header differs from an empty one. Bytes are hashed
+ * as sent, the path is not decoded yet.
+ *
+ * The policy is process wide and must stay valid while it is in use. Set
+ * it before parsing starts; NULL disables the fingerprint and info->key
+ * stays 0.
+ */
+#define MK_KEY_METHOD   (1 << 0)
+#define MK_KEY_HOST     (1 << 1)
+#define MK_KEY_PATH     (1 << 2)
+#define MK_KEY_QUERY    (1 << 3)
+
+#define MK_KEY_VARY_MAX (8)
+
+struct mk_request_key_policy {
+    int fields;                             /* MK_KEY_* */
+    uint64_t seed;
+    int vary_count;
+    mk_pointer vary[MK_KEY_VARY_MAX];       /* header names */
+};
+
+void mk_http_key_policy(const struct mk_request_key_policy *policy);
+
+/*
+ * Body sink
+ * =========
+ *
+ * Request bodies are kept in the receive buffer up to MK_HTTP_BODY_MAX
+ * bytes and larger ones are refused with 413, unless a sink limit is set.
+ * A Content-Length over MK_HTTP_BODY_MAX and within that limit makes the
+ * parser return as soon as the head is complete, the request in state
+ * MK_RESPONSE_STREAM with info.body holding the part of the body already
+ * received; the caller moves the rest, see mk_http_sink.h. A pending
+ * 100-continue is answered first, as without a sink. 0, the default,
+ * disables it.
+ */
+#define MK_HTTP_BODY_MAX (4096)
+
+void mk_http_body_sink_max(unsigned long max);
+
+/*
+ * Pipelined requests are chained through sr->next, release them before
+ * parsing into sr again. sr itself belongs to the caller.
+ */
+void mk_http_request_release(struct mk_request *sr);
+
+/*
+ * Response parsing
+ * ================
+ *
+ * Parses a response from an upstream server with the same scanner. The
+ * head lands in a struct mk_request_info, so headers are looked up with
+ * mk_http_request_header() and the quick header index: info.protocol is
+ * the version, info.headers the header block, info.body the body as it
+ * is on the wire (chunk framing included) and info.connection tells
+ * whether the upstream connection can be reused.
+ *
+ * The no-body rules need the request method, pass MK_HTTP_RESPONSE_HEAD
+ * for HEAD requests. A body delimited by the end of the connection is
+ * complete once the caller passes MK_HTTP_RESPONSE_EOF.
+ *
+ * Returns MK_HTTP_OK for a complete response, MK_HTTP_ERROR, or
+ * MK_HTTP_PENDING; in the latter case framing is already set once the
+ * head is complete, so the head can be forwarded before the body.
+ */
+#define MK_HTTP_RESPONSE_HEAD  (1 << 0)   /* answer to a HEAD request */
+#define MK_HTTP_RESPONSE_EOF   (1 << 1)   /* upstream closed the connection */
+
+enum mk_body_framing {
+    MK_BODY_UNKNOWN = 0,    /* head not complete yet */
+    MK_BODY_NONE,           /* HEAD, 1xx, 204 and 304 */
+    MK_BODY_LENGTH,
+    MK_BODY_CHUNKED,
+    MK_BODY_CLOSE,          /* read until the upstream closes */
+};
+
+struct mk_http_upstream {
+    int status;
+    mk_pointer reason;
+    struct mk_request_info info;
+
+    enum mk_body_framing framing;
+    unsigned long content_length;   /* decoded body size when complete */
+};
 
-/* ANSI Colors */
-#define ANSI_RESET "\033[0m"
-#define ANSI_BOLD  "\033[1m"
-
-#define ANSI_CYAN          "\033[36m"
-#define ANSI_BOLD_CYAN     ANSI_BOLD ANSI_CYAN
-#define ANSI_MAGENTA       "\033[35m"
-#define ANSI_BOLD_MAGENTA  ANSI_BOLD ANSI_MAGENTA
-#define ANSI_RED           "\033[31m"
-#define ANSI_BOLD_RED      ANSI_BOLD ANSI_RED
-#define ANSI_YELLOW        "\033[33m"
-#define ANSI_BOLD_YELLOW   ANSI_BOLD ANSI_YELLOW
-#define ANSI_BLUE          "\033[34m"
-#define ANSI_BOLD_BLUE     ANSI_BOLD ANSI_BLUE
-#define ANSI_GREEN         "\033[32m"
-#define ANSI_BOLD_GREEN    ANSI_BOLD ANSI_GREEN
-#define ANSI_WHITE         "\033[37m"
-#define ANSI_BOLD_WHITE    ANSI_BOLD ANSI_WHITE
-
-#define TEST_OK      0
-#define TEST_FAIL    1
+int mk_http_response_parser(struct mk_http_upstream *res,
+        char *buffer, size_t length, int flags);
 
 #endif // MK_HTTP_PARSER_H
@@ -0,0 +1,288 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "mk_http_proxy.h"
+#include "mk_http_scan.h"
+
+#define MK_XFF "X-Forwarded-For"
+
+#define MK_HOP(name) { name, sizeof(name) - 1 }
+
+static const mk_pointer mk_proxy_hop_headers[] = {
+    MK_HOP("Connection"),
+    MK_HOP("Keep-Alive"),
+    MK_HOP("Proxy-Authenticate"),
+    MK_HOP("Proxy-Authorization"),
+    MK_HOP("Proxy-Connection"),
+    MK_HOP("TE"),
+    MK_HOP("Trailer"),
+    MK_HOP("Transfer-Encoding"),
+    MK_HOP("Upgrade"),
+};
+
+#define MK_HOP_COUNT (sizeof(mk_proxy_hop_headers) / sizeof(mk_pointer))
+
+static int mk_proxy_name_in(const char *name, size_t len,
+        const mk_pointer *list, unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        if (list[i].len == len && !strncasecmp(name, list[i].data, len)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Split the values of every Connection line into tokens, -1 if there are
+ * too many of them. The quick header index only knows the last line.
+ */
+static int mk_proxy_connection_tokens(const struct mk_request_info *info,
+        mk_pointer *tokens)
+{
+    const char *line, *next, *colon, *eol, *p;
+    const char *end = info->headers.data + info->headers.len;
+    int count = 0;
+
+    for (line = info->headers.data; line < end; line = next) {
+        eol = memchr(line, '\n', end - line);
+        next = eol ? eol + 1 : end;
+        eol = eol ? eol : end;
+        colon = memchr(line, ':', eol - line);
+        if (colon == NULL ||
+                mk_http_scan_header_id(line, colon - line) != MK_HEADER_CONNECTION) {
+            continue;
+        }
+
+        for (p = colon + 1; p < eol; p++) {
+            if (*p == ' ' || *p == '\t' || *p == ',' || *p == '\r') {
+                continue;
+            }
+            if (count == MK_PROXY_CONNECTION_TOKENS) {
+                return -1;
+            }
+            tokens[count].data = (char *) p;
+            while (p < eol && *p != ',' && *p != ' ' && *p != '\t' &&
+                   *p != '\r') {
+                p++;
+            }
+            tokens[count].len = p - tokens[count].data;
+            count++;
+        }
+    }
+    return count;
+}
+
+/* Append a range, growing the last entry when contiguous */
+static int mk_proxy_view_add(struct mk_proxy_view *view,
+        const char *data, size_t len)
+{
+    struct iovec *last;
+
+    if (len == 0) {
+        return 0;
+    }
+
+    if (view->iov_count > 0) {
+        last = &view->iov[view->iov_count - 1];
+        if (last->iov_base != NULL &&
+                (char *) last->iov_base + last->iov_len == data) {
+            last->iov_len += len;
+            return 0;
+        }
+    }
+
+    if (view->iov_count == view->iov_size) {
+        return -1;
+    }
+    view->iov[view->iov_count].iov_base = (void *) data;
+    view->iov[view->iov_count].iov_len = len;
+    view->iov_count++;
+    return 0;
+}
+
+/* Append an empty entry for the caller to fill */
+static int mk_proxy_view_slot(struct mk_proxy_view *view)
+{
+    if (view->iov_count == view->iov_size) {
+        return -1;
+    }
+    view->iov[view->iov_count].iov_base = NULL;
+    view->iov[view->iov_count].iov_len = 0;
+    return view->iov_count++;
+}
+
+int mk_proxy_view_build(struct mk_proxy_view *view,
+        const struct mk_request_info *info,
+        struct iovec *iov, int iov_size,
+        int inject_count)
+{
+    int i;
+    char *line, *next, *colon, *eol, *end;
+    size_t name_len;
+    mk_pointer tokens[MK_PROXY_CONNECTION_TOKENS];
+    int token_count, lengths = 0;
+
+    view->iov = iov;
+    view->iov_size = iov_size;
+    view->iov_count = 0;
+    view->inject = -1;
+    view->inject_count = 0;
+    view->xff_slot = -1;
+
+    /* A Content-Length goes upstream with the body it frames, or not at all */
+    if (info->quick_headers[MK_HEADER_TRANSFER_ENCODING].value_index ||
+            (info->quick_headers[MK_HEADER_CONTENT_LENGTH].value_index &&
+             info->body.data == NULL)) {
+        return -1;
+    }
+
+    token_count = mk_proxy_connection_tokens(info, tokens);
+    if (token_count < 0) {
+        return -1;
+    }
+
+    /* Request line, an absolute-form target is sent on in origin-form */
+    if (info->target == MK_TARGET_ABSOLUTE) {
+        line = mk_http_authority_end(info);
+        if (mk_proxy_view_add(view, info->method.data,
+                              info->uri.data - info->method.data) ||
+                (info->path.len == 0 && mk_proxy_view_add(view, "/", 1)) ||
+                mk_proxy_view_add(view, line, info->headers.data - line)) {
+            return -1;
+        }
+    }
+    else if (mk_proxy_view_add(view, info->method.data,
+                               info->headers.data - info->method.data)) {
+        return -1;
+    }
+
+    line = info->headers.data;
+    end = info->headers.data + info->headers.len;
+    while (line < end) {
+        eol = memchr(line, '\n', end - line);
+        next = eol ? eol + 1 : end;
+        colon = memchr(line, ':', next - line);
+        name_len = colon ? (size_t) (colon - line) : 0;
+
+        /* One Content-Length, holding one value */
+        if (colon != NULL &&
+                mk_http_scan_header_id(line, name_len) == MK_HEADER_CONTENT_LENGTH) {
+            if (++lengths > 1 || memchr(colon, ',', next - colon)) {
+                return -1;
+            }
+        }
+
+        if (colon != NULL &&
+                (mk_proxy_name_in(line, name_len,
+                                  mk_proxy_hop_headers, MK_HOP_COUNT) ||
+                 mk_proxy_name_in(line, name_len, tokens, (unsigned int) token_count))) {
+            line = next;
+            continue;
+        }
+
+        if (colon != NULL && name_len == sizeof(MK_XFF) - 1 &&
+                !strncasecmp(line, MK_XFF, name_len)) {
+            /* Leave room to extend the list before the line end */
+            eol = next;
+            if (eol > line && eol[-1] == '\n') {
+                eol--;
+            }
+            if (eol > line && eol[-1] == '\r') {
+                eol--;
+            }
+            if (mk_proxy_view_add(view, line, eol - line)) {
+                return -1;
+            }
+            view->xff_slot = mk_proxy_view_slot(view);
+            if (view->xff_slot < 0) {
+                return -1;
+            }
+            line = eol;
+            continue;
+        }
+
+        if (mk_proxy_view_add(view, line, next - line)) {
+            return -1;
+        }
+        line = next;
+    }
+
+    view->inject = view->iov_count;
+    for (i = 0; i < inject_count; i++) {
+        if (mk_proxy_view_slot(view) < 0) {
+            return -1;
+        }
+    }
+    view->inject_count = inject_count;
+
+    /* Blank line ending the block, then the body */
+    if (mk_proxy_view_add(view, end, *end == '\r' ? 2 : 1) ||
+            mk_proxy_view_add(view, info->body.data, info->body.len)) {
+        return -1;
+    }
+
+    return view->iov_count;
+}
+
+int mk_proxy_view_inject(struct mk_proxy_view *view,
+        const char *line, size_t len)
+{
+    struct iovec *slot;
+
+    if (view->inject_count == 0) {
+        return -1;
+    }
+
+    slot = &view->iov[view->inject];
+    slot->iov_base = (void *) line;
+    slot->iov_len = len;
+    view->inject++;
+    view->inject_count--;
+    return 0;
+}
+
+int mk_proxy_view_forwarded_for(struct mk_proxy_view *view,
+        const char *client, size_t client_len,
+        char *buf, size_t size)
+{
+    int len;
+
+    if (view->xff_slot >= 0) {
+        len = snprintf(buf, size, ", %.*s", (int) client_len, client);
+        if (len < 0 || (size_t) len >= size) {
+            return -1;
+        }
+        view->iov[view->xff_slot].iov_base = buf;
+        view->iov[view->xff_slot].iov_len = len;
+        return 0;
+    }
+
+    len = snprintf(buf, size, MK_XFF ": %.*s\r\n", (int) client_len, client);
+    if (len < 0 || (size_t) len >= size) {
+        return -1;
+    }
+    return mk_proxy_view_inject(view, buf, len);
+}
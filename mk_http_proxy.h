@@ -0,0 +1,83 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_PROXY_H
+#define MK_HTTP_PROXY_H
+
+#include <sys/uio.h>
+
+#include "mk_http_parser2.h"
+
+/*
+ * Forwarding view
+ * ===============
+ *
+ * Describes the request as it must be sent upstream, as an iovec over the
+ * original buffer: request line, end to end headers, injection slots, the
+ * blank line and the body. Hop-by-hop headers (Connection, Keep-Alive,
+ * Proxy-Authenticate, Proxy-Authorization, Proxy-Connection, TE, Trailer,
+ * Transfer-Encoding, Upgrade) and the headers listed in any Connection
+ * line are left out, nothing is copied.
+ *
+ * The body is forwarded as framed by Content-Length, so a request with
+ * Transfer-Encoding or with more than one Content-Length value is refused,
+ * as is one whose Content-Length body was not framed by the parser, or
+ * one listing more than MK_PROXY_CONNECTION_TOKENS Connection tokens:
+ * dropping the extra ones would leak their headers upstream.
+ *
+ * The inject slots are empty entries right before the blank line, the
+ * caller points them to complete header lines ("Name: value\r\n"). When
+ * the client sent X-Forwarded-For, xff_slot is an empty entry right before
+ * the end of its last line, so the list can be extended in place.
+ */
+
+#define MK_PROXY_CONNECTION_TOKENS (16)
+
+struct mk_proxy_view {
+    struct iovec *iov;
+    int iov_size;
+    int iov_count;
+
+    int inject;         /* first inject slot */
+    int inject_count;   /* inject slots not used yet */
+    int xff_slot;       /* append slot in X-Forwarded-For, -1 if none */
+};
+
+int mk_proxy_view_build(struct mk_proxy_view *view,
+        const struct mk_request_info *info,
+        struct iovec *iov, int iov_size,
+        int inject_count);
+
+/*
+ * Point the next inject slot to a complete header line, which must stay
+ * valid until the view is written.
+ */
+int mk_proxy_view_inject(struct mk_proxy_view *view,
+        const char *line, size_t len);
+
+/*
+ * Add the client address to X-Forwarded-For: appended to the client's
+ * header when there is one, a new header otherwise. The text is formatted
+ * into buf, which must stay valid until the view is written.
+ */
+int mk_proxy_view_forwarded_for(struct mk_proxy_view *view,
+        const char *client, size_t client_len,
+        char *buf, size_t size);
+
+#endif // MK_HTTP_PROXY_H
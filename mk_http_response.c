@@ -0,0 +1,523 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+#include "mk_http_response.h"
+
+#define MK_CRLF            "\r\n"
+#define MK_HEADER_SEP      ": "
+#define MK_CONTENT_LENGTH  "Content-Length: "
+
+/*
+ * Status lines indexed by [class - 1][code % 100], so a lookup is two
+ * array indexes and the strings are ready to be sent as they are.
+ */
+#define MK_STATUS_LINE(code, reason)                                    \
+    [(code) / 100 - 1][(code) % 100] = {                                \
+        "HTTP/1.1 " #code " " reason MK_CRLF,                           \
+        sizeof("HTTP/1.1 " #code " " reason MK_CRLF) - 1                \
+    }
+
+#define MK_STATUS_CLASS_MAX (32)
+
+static const mk_pointer mk_status_lines[5][MK_STATUS_CLASS_MAX] = {
+    MK_STATUS_LINE(100, "Continue"),
+    MK_STATUS_LINE(101, "Switching Protocols"),
+
+    MK_STATUS_LINE(200, "OK"),
+    MK_STATUS_LINE(201, "Created"),
+    MK_STATUS_LINE(202, "Accepted"),
+    MK_STATUS_LINE(203, "Non-Authoritative Information"),
+    MK_STATUS_LINE(204, "No Content"),
+    MK_STATUS_LINE(205, "Reset Content"),
+    MK_STATUS_LINE(206, "Partial Content"),
+
+    MK_STATUS_LINE(300, "Multiple Choices"),
+    MK_STATUS_LINE(301, "Moved Permanently"),
+    MK_STATUS_LINE(302, "Found"),
+    MK_STATUS_LINE(303, "See Other"),
+    MK_STATUS_LINE(304, "Not Modified"),
+    MK_STATUS_LINE(305, "Use Proxy"),
+    MK_STATUS_LINE(307, "Temporary Redirect"),
+    MK_STATUS_LINE(308, "Permanent Redirect"),
+
+    MK_STATUS_LINE(400, "Bad Request"),
+    MK_STATUS_LINE(401, "Unauthorized"),
+    MK_STATUS_LINE(402, "Payment Required"),
+    MK_STATUS_LINE(403, "Forbidden"),
+    MK_STATUS_LINE(404, "Not Found"),
+    MK_STATUS_LINE(405, "Method Not Allowed"),
+    MK_STATUS_LINE(406, "Not Acceptable"),
+    MK_STATUS_LINE(407, "Proxy Authentication Required"),
+    MK_STATUS_LINE(408, "Request Timeout"),
+    MK_STATUS_LINE(409, "Conflict"),
+    MK_STATUS_LINE(410, "Gone"),
+    MK_STATUS_LINE(411, "Length Required"),
+    MK_STATUS_LINE(412, "Precondition Failed"),
+    MK_STATUS_LINE(413, "Content Too Large"),
+    MK_STATUS_LINE(414, "URI Too Long"),
+    MK_STATUS_LINE(415, "Unsupported Media Type"),
+    MK_STATUS_LINE(416, "Range Not Satisfiable"),
+    MK_STATUS_LINE(417, "Expectation Failed"),
+    MK_STATUS_LINE(431, "Request Header Fields Too Large"),
+
+    MK_STATUS_LINE(500, "Internal Server Error"),
+    MK_STATUS_LINE(501, "Not Implemented"),
+    MK_STATUS_LINE(502, "Bad Gateway"),
+    MK_STATUS_LINE(503, "Service Unavailable"),
+    MK_STATUS_LINE(504, "Gateway Timeout"),
+    MK_STATUS_LINE(505, "HTTP Version Not Supported"),
+};
+
+const mk_pointer *mk_response_status_line(int status)
+{
+    const mk_pointer *line;
+
+    if (status < 100 || status > 599 || status % 100 >= MK_STATUS_CLASS_MAX) {
+        return NULL;
+    }
+
+    line = &mk_status_lines[status / 100 - 1][status % 100];
+    if (line->data == NULL) {
+        return NULL;
+    }
+    return line;
+}
+
+/* Date header, per thread */
+
+#define MK_DATE_SAMPLE "Date: Thu, 01 Jan 1970 00:00:00 GMT" MK_CRLF
+
+static const char mk_date_days[7][4] = {
+    "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+};
+
+static const char mk_date_months[12][4] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+/* Status line + Date for the fast path, rebuilt with the date */
+static const int mk_fast_status[] = {
+    MK_SUCCESS_OK, MK_NOT_MODIFIED, MK_CLIENT_NOT_FOUND
+};
+#define MK_FAST_COUNT (sizeof(mk_fast_status) / sizeof(mk_fast_status[0]))
+#define MK_FAST_HEAD_SIZE (64 + sizeof(MK_DATE_SAMPLE))
+
+static __thread time_t mk_date_time = -1;
+static __thread char mk_date_buf[sizeof(MK_DATE_SAMPLE)];
+static __thread mk_pointer mk_date_header;
+static __thread char mk_fast_buf[MK_FAST_COUNT][MK_FAST_HEAD_SIZE];
+static __thread mk_pointer mk_fast_head[MK_FAST_COUNT];
+
+static inline char *put_2digits(char *p, int n)
+{
+    p[0] = '0' + n / 10;
+    p[1] = '0' + n % 10;
+    return p + 2;
+}
+
+void mk_response_date_refresh(time_t now)
+{
+    unsigned int i;
+    char *p;
+    struct tm tm;
+    const mk_pointer *line;
+
+    if (now == mk_date_time) {
+        return;
+    }
+    gmtime_r(&now, &tm);
+
+    /* strftime() would depend on the locale */
+    p = mk_date_buf;
+    memcpy(p, "Date: ", 6);
+    p += 6;
+    memcpy(p, mk_date_days[tm.tm_wday], 3);
+    p += 3;
+    *p++ = ',';
+    *p++ = ' ';
+    p = put_2digits(p, tm.tm_mday);
+    *p++ = ' ';
+    memcpy(p, mk_date_months[tm.tm_mon], 3);
+    p += 3;
+    *p++ = ' ';
+    p = put_2digits(p, (tm.tm_year + 1900) / 100);
+    p = put_2digits(p, (tm.tm_year + 1900) % 100);
+    *p++ = ' ';
+    p = put_2digits(p, tm.tm_hour);
+    *p++ = ':';
+    p = put_2digits(p, tm.tm_min);
+    *p++ = ':';
+    p = put_2digits(p, tm.tm_sec);
+    memcpy(p, " GMT" MK_CRLF, 6);
+    p += 6;
+
+    mk_date_header.data = mk_date_buf;
+    mk_date_header.len = p - mk_date_buf;
+
+    for (i = 0; i < MK_FAST_COUNT; i++) {
+        line = mk_response_status_line(mk_fast_status[i]);
+        memcpy(mk_fast_buf[i], line->data, line->len);
+        memcpy(mk_fast_buf[i] + line->len, mk_date_header.data,
+               mk_date_header.len);
+        mk_fast_head[i].data = mk_fast_buf[i];
+        mk_fast_head[i].len = line->len + mk_date_header.len;
+    }
+
+    mk_date_time = now;
+}
+
+const mk_pointer *mk_response_date(void)
+{
+    mk_response_date_refresh(time(NULL));
+    return &mk_date_header;
+}
+
+/* Writer */
+
+void mk_response_writer_init(struct mk_response_writer *w,
+        char *buf, size_t size,
+        struct iovec *iov, int iov_size)
+{
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+    w->iov = iov;
+    w->iov_size = iov ? iov_size : 0;
+    w->iov_count = 0;
+    w->total = 0;
+    w->error = 0;
+}
+
+/* Add an iovec entry, growing the previous one when data is contiguous */
+static int writer_iov_add(struct mk_response_writer *w,
+        const char *data, size_t len)
+{
+    struct iovec *last;
+
+    if (w->iov_count > 0) {
+        last = &w->iov[w->iov_count - 1];
+        if ((char *) last->iov_base + last->iov_len == data) {
+            last->iov_len += len;
+            return 0;
+        }
+    }
+
+    if (w->iov_count == w->iov_size) {
+        w->error = 1;
+        return -1;
+    }
+
+    w->iov[w->iov_count].iov_base = (void *) data;
+    w->iov[w->iov_count].iov_len = len;
+    w->iov_count++;
+    return 0;
+}
+
+/* Copy data into the buffer (referenced from the iovec if any) */
+static int writer_copy(struct mk_response_writer *w,
+        const char *data, size_t len)
+{
+    char *dst;
+
+    if (w->error) {
+        return -1;
+    }
+    if (w->size - w->len < len) {
+        w->error = 1;
+        return -1;
+    }
+
+    dst = w->buf + w->len;
+    memcpy(dst, data, len);
+    w->len += len;
+    w->total += len;
+
+    if (w->iov) {
+        return writer_iov_add(w, dst, len);
+    }
+    return 0;
+}
+
+/* Reference data living longer than the writer, copy in buffer mode */
+static int writer_ref(struct mk_response_writer *w,
+        const char *data, size_t len)
+{
+    if (w->error) {
+        return -1;
+    }
+    if (w->iov == NULL) {
+        return writer_copy(w, data, len);
+    }
+
+    w->total += len;
+    return writer_iov_add(w, data, len);
+}
+
+int mk_response_write_status(struct mk_response_writer *w, int status)
+{
+    const mk_pointer *line;
+
+    line = mk_response_status_line(status);
+    if (line == NULL) {
+        w->error = 1;
+        return -1;
+    }
+    return writer_ref(w, line->data, line->len);
+}
+
+int mk_response_write_date(struct mk_response_writer *w)
+{
+    const mk_pointer *date;
+
+    /* The cached header changes every second, never reference it */
+    date = mk_response_date();
+    return writer_copy(w, date->data, date->len);
+}
+
+int mk_response_write_header(struct mk_response_writer *w,
+        const char *key, size_t key_len,
+        const char *value, size_t value_len)
+{
+    writer_ref(w, key, key_len);
+    writer_ref(w, MK_HEADER_SEP, sizeof(MK_HEADER_SEP) - 1);
+    writer_ref(w, value, value_len);
+    return writer_ref(w, MK_CRLF, sizeof(MK_CRLF) - 1);
+}
+
+int mk_response_write_content_length(struct mk_response_writer *w,
+        unsigned long length)
+{
+    char tmp[sizeof(MK_CONTENT_LENGTH) + 20 + sizeof(MK_CRLF)];
+    char digits[20];
+    char *p;
+    int n = 0;
+
+    do {
+        digits[n++] = '0' + length % 10;
+        length /= 10;
+    } while (length > 0);
+
+    p = tmp;
+    memcpy(p, MK_CONTENT_LENGTH, sizeof(MK_CONTENT_LENGTH) - 1);
+    p += sizeof(MK_CONTENT_LENGTH) - 1;
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+    memcpy(p, MK_CRLF, sizeof(MK_CRLF) - 1);
+    p += sizeof(MK_CRLF) - 1;
+
+    return writer_copy(w, tmp, p - tmp);
+}
+
+int mk_response_write_end(struct mk_response_writer *w)
+{
+    return writer_ref(w, MK_CRLF, sizeof(MK_CRLF) - 1);
+}
+
+int mk_response_write_fast(struct mk_response_writer *w, int status,
+        unsigned long content_length)
+{
+    unsigned int i;
+
+    for (i = 0; i < MK_FAST_COUNT; i++) {
+        if (mk_fast_status[i] == status) {
+            break;
+        }
+    }
+    if (i == MK_FAST_COUNT) {
+        return -1;
+    }
+
+    mk_response_date_refresh(time(NULL));
+    writer_copy(w, mk_fast_head[i].data, mk_fast_head[i].len);
+    if (status != MK_NOT_MODIFIED) {
+        mk_response_write_content_length(w, content_length);
+    }
+    return mk_response_write_end(w);
+}
+
+/* Interim responses */
+
+#define MK_CONTINUE "HTTP/1.1 100 Continue" MK_CRLF MK_CRLF
+
+static const struct iovec mk_continue_iov = {
+    MK_CONTINUE, sizeof(MK_CONTINUE) - 1
+};
+
+const struct iovec *mk_response_continue(void)
+{
+    return &mk_continue_iov;
+}
+
+/* Canned error responses */
+
+#define MK_ERROR_PAGE(code, reason)                                     \
+    { code, "<html><head><title>" #code " " reason "</title></head>"    \
+            "<body><h1>" #code " " reason "</h1></body></html>\n" }
+
+static const struct {
+    int status;
+    const char *body;
+} mk_error_pages[] = {
+    MK_ERROR_PAGE(400, "Bad Request"),
+    MK_ERROR_PAGE(403, "Forbidden"),
+    MK_ERROR_PAGE(404, "Not Found"),
+    MK_ERROR_PAGE(405, "Method Not Allowed"),
+    MK_ERROR_PAGE(408, "Request Timeout"),
+    MK_ERROR_PAGE(411, "Length Required"),
+    MK_ERROR_PAGE(413, "Content Too Large"),
+    MK_ERROR_PAGE(414, "URI Too Long"),
+    MK_ERROR_PAGE(417, "Expectation Failed"),
+    MK_ERROR_PAGE(431, "Request Header Fields Too Large"),
+    MK_ERROR_PAGE(500, "Internal Server Error"),
+    MK_ERROR_PAGE(501, "Not Implemented"),
+    MK_ERROR_PAGE(503, "Service Unavailable"),
+    MK_ERROR_PAGE(505, "HTTP Version Not Supported"),
+};
+
+#define MK_ERROR_COUNT (sizeof(mk_error_pages) / sizeof(mk_error_pages[0]))
+#define MK_ERROR_ARENA_SIZE (MK_ERROR_COUNT * 320)
+
+static char mk_error_arena[MK_ERROR_ARENA_SIZE];
+static struct iovec mk_error_iov[MK_ERROR_COUNT];
+
+/* mk_error_iov is built once, by the first thread getting here */
+#define MK_ERRORS_NONE      0
+#define MK_ERRORS_BUILDING  1
+#define MK_ERRORS_READY     2
+
+static int mk_error_state = MK_ERRORS_NONE;
+
+static int mk_response_errors_build(void)
+{
+    unsigned int i;
+    size_t body_len;
+    struct mk_response_writer w;
+
+    mk_response_writer_init(&w, mk_error_arena, sizeof(mk_error_arena),
+                            NULL, 0);
+
+    for (i = 0; i < MK_ERROR_COUNT; i++) {
+        mk_error_iov[i].iov_base = w.buf + w.len;
+        body_len = strlen(mk_error_pages[i].body);
+
+        mk_response_write_status(&w, mk_error_pages[i].status);
+        mk_response_write_header(&w, "Content-Type", 12, "text/html", 9);
+        mk_response_write_content_length(&w, body_len);
+        mk_response_write_header(&w, "Connection", 10, "close", 5);
+        mk_response_write_end(&w);
+        writer_copy(&w, mk_error_pages[i].body, body_len);
+        if (w.error) {
+            return -1;
+        }
+
+        mk_error_iov[i].iov_len = (w.buf + w.len) -
+            (char *) mk_error_iov[i].iov_base;
+    }
+    return 0;
+}
+
+int mk_response_errors_init(void)
+{
+    int state = MK_ERRORS_NONE;
+
+    if (__atomic_load_n(&mk_error_state, __ATOMIC_ACQUIRE) == MK_ERRORS_READY) {
+        return 0;
+    }
+
+    if (__atomic_compare_exchange_n(&mk_error_state, &state,
+                                    MK_ERRORS_BUILDING, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        state = mk_response_errors_build() ? MK_ERRORS_NONE : MK_ERRORS_READY;
+        __atomic_store_n(&mk_error_state, state, __ATOMIC_RELEASE);
+    }
+    else {
+        while (state == MK_ERRORS_BUILDING) {
+            sched_yield();
+            state = __atomic_load_n(&mk_error_state, __ATOMIC_ACQUIRE);
+        }
+    }
+    return state == MK_ERRORS_READY ? 0 : -1;
+}
+
+const struct iovec *mk_response_error(int status)
+{
+    unsigned int i;
+
+    if (mk_response_errors_init()) {
+        return NULL;
+    }
+
+    for (i = 0; i < MK_ERROR_COUNT; i++) {
+        if (mk_error_pages[i].status == status) {
+            return &mk_error_iov[i];
+        }
+    }
+    return NULL;
+}
+
+/* Pipelined response ordering */
+
+void mk_response_done(struct mk_request *sr,
+        const struct iovec *iov, int iov_count)
+{
+    sr->response.iov = iov;
+    sr->response.iov_count = iov_count;
+    sr->state = MK_RESPONSE_DONE;
+}
+
+int mk_response_queue_gather(struct mk_request *head,
+        struct iovec *iov, int iov_size,
+        struct mk_request **pending)
+{
+    int count = 0;
+    struct mk_request *sr;
+
+    for (sr = head; sr != NULL; sr = sr->next) {
+        if (sr->state != MK_RESPONSE_DONE) {
+            break;
+        }
+        if (count + sr->response.iov_count > iov_size) {
+            if (count == 0) {
+                return -1;
+            }
+            break;
+        }
+
+        memcpy(iov + count, sr->response.iov,
+               sizeof(*iov) * sr->response.iov_count);
+        count += sr->response.iov_count;
+
+        if (!(sr->request.connection & MK_CONN_KEEP_ALIVE) ||
+                sr->response.error_page != NULL) {
+            sr = NULL;
+            break;
+        }
+    }
+
+    *pending = sr;
+    return count;
+}
@@ -0,0 +1,130 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_RESPONSE_H
+#define MK_HTTP_RESPONSE_H
+
+#include <time.h>
+#include <sys/uio.h>
+
+#include "mk_http_parser2.h"
+
+/*
+ * Response writer
+ * ===============
+ *
+ * Builds a response header block into a caller buffer. When an iovec
+ * array is given too, constant pieces (status lines, header names and
+ * values owned by the caller) are referenced instead of copied and the
+ * buffer only holds what had to be formatted; the result goes out with a
+ * single writev(2). Nothing is allocated.
+ *
+ * Every call returns 0 on success or -1 once the buffer or the iovec array
+ * is exhausted; the error sticks until the writer is initialized again.
+ */
+struct mk_response_writer {
+    char *buf;
+    size_t size;
+    size_t len;
+
+    struct iovec *iov;
+    int iov_size;
+    int iov_count;
+
+    size_t total;         /* bytes of header block produced so far */
+    int error;
+};
+
+/* Preformatted "HTTP/1.1 <code> <reason>\r\n", NULL for unknown codes */
+const mk_pointer *mk_response_status_line(int status);
+
+/*
+ * Cached "Date: ...\r\n" header, formatted at most once per second per
+ * thread. mk_response_date_refresh() can be driven from a timer instead
+ * of checking the clock on each call.
+ */
+const mk_pointer *mk_response_date(void);
+void mk_response_date_refresh(time_t now);
+
+void mk_response_writer_init(struct mk_response_writer *w,
+        char *buf, size_t size,
+        struct iovec *iov, int iov_size);
+
+int mk_response_write_status(struct mk_response_writer *w, int status);
+int mk_response_write_date(struct mk_response_writer *w);
+int mk_response_write_header(struct mk_response_writer *w,
+        const char *key, size_t key_len,
+        const char *value, size_t value_len);
+int mk_response_write_content_length(struct mk_response_writer *w,
+        unsigned long length);
+int mk_response_write_end(struct mk_response_writer *w);
+
+/*
+ * Complete header block for 200, 304 and 404: status line, Date and, but
+ * for 304, Content-Length. Other codes return -1.
+ */
+int mk_response_write_fast(struct mk_response_writer *w, int status,
+        unsigned long content_length);
+
+/* Complete "100 Continue" interim response */
+const struct iovec *mk_response_continue(void);
+
+/*
+ * Canned error responses
+ * ======================
+ *
+ * Complete responses (status line, headers, small HTML body) for the
+ * statuses the parser aborts with (400, 403, 411, 413, 417, 500, 501 and
+ * 505)
+ * and for the common ones a server sends on its own, such as 404, 408,
+ * 414 and 431 for the limits it enforces. They are built on first use,
+ * or eagerly by mk_response_errors_init(), and immutable afterwards, so
+ * they can be shared by all threads. An abort is a single send(2) of the
+ * returned iovec. They carry no Date header and always close the
+ * connection.
+ *
+ * mk_response_error() returns NULL for statuses without a canned
+ * response.
+ */
+int mk_response_errors_init(void);
+const struct iovec *mk_response_error(int status);
+
+/*
+ * Pipelined response ordering
+ * ===========================
+ *
+ * Responses to pipelined requests may be completed in any order but must
+ * leave in request order. mk_response_done() attaches the finished
+ * response to its request; mk_response_queue_gather() then collects the
+ * responses of consecutive finished requests from the head of the chain
+ * into iov, ready for one writev(2).
+ *
+ * Gathering stops at the first unfinished request, returned in *pending,
+ * and after a request that does not keep the connection alive, in which
+ * case *pending is NULL and the connection must be closed once written.
+ * Returns the number of iovec entries used or -1 if iov is too small for
+ * even the first response.
+ */
+void mk_response_done(struct mk_request *sr,
+        const struct iovec *iov, int iov_count);
+int mk_response_queue_gather(struct mk_request *head,
+        struct iovec *iov, int iov_size,
+        struct mk_request **pending);
+
+#endif // MK_HTTP_RESPONSE_H
@@ -0,0 +1,386 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mk_http_ring.h"
+
+#define MK_RING_MAGIC     0x6d6b7267    /* "mkrg" */
+#define MK_RING_CACHELINE 64
+
+/* Shared header, the slots follow it */
+struct mk_ring_shared {
+    uint32_t magic;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint32_t stride;
+    int32_t flags;
+
+    uint64_t head __attribute__((aligned(MK_RING_CACHELINE)));
+    uint64_t tail __attribute__((aligned(MK_RING_CACHELINE)));
+} __attribute__((aligned(MK_RING_CACHELINE)));
+
+/* Each slot starts on its own cache line, the payload on the next one */
+struct mk_ring_slot {
+    uint64_t seq;
+    uint32_t len;
+};
+
+#define MK_RING_SLOT_HEADER MK_RING_CACHELINE
+
+/*
+ * Wire form
+ */
+
+static inline void mk_wire_span_set(struct mk_wire_span *span,
+        mk_pointer p, const char *start)
+{
+    span->offset = p.data ? p.data - start : 0;
+    span->len = p.data ? p.len : 0;
+}
+
+/* Bytes to copy and the size of the record holding them */
+static size_t mk_wire_size(const struct mk_request_info *info,
+        char **start, size_t *data_len, uint32_t *count)
+{
+    char *p, *end, *hend;
+
+    *start = info->method.data;
+    hend = info->headers.data + info->headers.len;
+    end = hend + 2;
+    if (info->body.len && info->body.data + info->body.len > end) {
+        end = info->body.data + info->body.len;
+    }
+    *data_len = end - *start;
+
+    *count = 0;
+    for (p = info->headers.data; p < hend; p++) {
+        p = memchr(p, '\n', hend - p);
+        if (!p) {
+            break;
+        }
+        (*count)++;
+    }
+
+    return ((sizeof(struct mk_request_wire) + *data_len + 7) & ~7UL) +
+        *count * sizeof(struct mk_wire_header);
+}
+
+/* Write the record sized by mk_wire_size() */
+static void mk_wire_fill(const struct mk_request_info *info,
+        struct mk_request_wire *wire, size_t total,
+        char *start, size_t data_len, uint32_t count)
+{
+    char *d, *colon, *eol, *value, *value_end, *hend;
+    uint32_t n = 0;
+    struct mk_wire_header *index;
+
+    memcpy(wire->data, start, data_len);
+    wire->size = total;
+    wire->data_len = data_len;
+    wire->index_offset = (sizeof(*wire) + data_len + 7) & ~7UL;
+    wire->key = info->key;
+    wire->content_length = info->content_length;
+    wire->connection = info->connection;
+    wire->target = info->target;
+
+    mk_wire_span_set(&wire->method, info->method, start);
+    mk_wire_span_set(&wire->protocol, info->protocol, start);
+    mk_wire_span_set(&wire->uri, info->uri, start);
+    mk_wire_span_set(&wire->path, info->path, start);
+    mk_wire_span_set(&wire->query, info->query, start);
+    mk_wire_span_set(&wire->scheme, info->scheme, start);
+    mk_wire_span_set(&wire->host, info->host, start);
+    mk_wire_span_set(&wire->port, info->port, start);
+    mk_wire_span_set(&wire->headers, info->headers, start);
+    mk_wire_span_set(&wire->body, info->body, start);
+    memcpy(wire->quick_headers, info->quick_headers,
+           sizeof(wire->quick_headers));
+
+    index = (struct mk_wire_header *) ((char *) wire + wire->index_offset);
+    hend = info->headers.data + info->headers.len;
+    for (d = info->headers.data; d < hend && n < count; d = eol + 1) {
+        eol = memchr(d, '\n', hend - d);
+        if (!eol) {
+            break;
+        }
+        colon = memchr(d, ':', eol - d);
+        if (!colon) {
+            continue;
+        }
+        value = colon + 1;
+        while (value < eol && (*value == ' ' || *value == '\t')) {
+            value++;
+        }
+        value_end = eol;
+        if (value_end > value && value_end[-1] == '\r') {
+            value_end--;
+        }
+        index[n].name.offset = d - start;
+        index[n].name.len = colon - d;
+        index[n].value.offset = value - start;
+        index[n].value.len = value_end - value;
+        n++;
+    }
+    wire->header_count = n;
+}
+
+int mk_request_wire_write(const struct mk_request_info *info,
+        void *dst, size_t size)
+{
+    char *start;
+    size_t total, data_len;
+    uint32_t count;
+
+    total = mk_wire_size(info, &start, &data_len, &count);
+    if (total > size || total > UINT32_MAX) {
+        return -1;
+    }
+    mk_wire_fill(info, dst, total, start, data_len, count);
+    return total;
+}
+
+void mk_request_wire_view(struct mk_request_wire *wire,
+        struct mk_request_info *info)
+{
+#define MK_WIRE_POINTER(field)                                  \
+    info->field.data = wire->data + wire->field.offset;         \
+    info->field.len = wire->field.len
+
+    memset(info, 0, sizeof(*info));
+    MK_WIRE_POINTER(method);
+    MK_WIRE_POINTER(protocol);
+    MK_WIRE_POINTER(uri);
+    MK_WIRE_POINTER(path);
+    MK_WIRE_POINTER(query);
+    MK_WIRE_POINTER(scheme);
+    MK_WIRE_POINTER(host);
+    MK_WIRE_POINTER(port);
+    MK_WIRE_POINTER(headers);
+    MK_WIRE_POINTER(body);
+#undef MK_WIRE_POINTER
+
+    if (info->query.len == 0) {
+        info->query.data = NULL;
+    }
+    if (info->port.len == 0) {
+        info->port.data = NULL;
+    }
+    info->target = wire->target;
+    info->key = wire->key;
+    info->content_length = wire->content_length;
+    info->connection = wire->connection;
+    memcpy(info->quick_headers, wire->quick_headers,
+           sizeof(info->quick_headers));
+}
+
+/*
+ * Ring
+ */
+
+static inline struct mk_ring_slot *mk_ring_slot(struct mk_ring *ring,
+        uint64_t pos)
+{
+    return (struct mk_ring_slot *) (ring->slots +
+                                    (pos & (ring->slot_count - 1)) * ring->stride);
+}
+
+static int mk_ring_map(struct mk_ring *ring, int fd, size_t size)
+{
+    void *map;
+
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    ring->fd = fd;
+    ring->map_size = size;
+    ring->shm = map;
+    ring->slots = (char *) map + sizeof(struct mk_ring_shared);
+    return 0;
+}
+
+int mk_ring_create(struct mk_ring *ring, uint32_t slot_count,
+        uint32_t slot_size, int flags)
+{
+    int fd;
+    uint32_t i, stride;
+    size_t size;
+
+    if (slot_count == 0 || (slot_count & (slot_count - 1)) || slot_size == 0) {
+        return -1;
+    }
+    stride = MK_RING_SLOT_HEADER +
+        ((slot_size + MK_RING_CACHELINE - 1) & ~(MK_RING_CACHELINE - 1));
+    size = sizeof(struct mk_ring_shared) + (size_t) slot_count * stride;
+
+    fd = memfd_create("mk_http_ring", MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (ftruncate(fd, size) || mk_ring_map(ring, fd, size)) {
+        close(fd);
+        return -1;
+    }
+
+    ring->slot_count = slot_count;
+    ring->slot_size = slot_size;
+    ring->stride = stride;
+    ring->flags = flags;
+
+    ring->shm->slot_count = slot_count;
+    ring->shm->slot_size = slot_size;
+    ring->shm->stride = stride;
+    ring->shm->flags = flags;
+    for (i = 0; i < slot_count; i++) {
+        mk_ring_slot(ring, i)->seq = i;
+    }
+    __atomic_store_n(&ring->shm->magic, MK_RING_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int mk_ring_attach(struct mk_ring *ring, int fd)
+{
+    struct stat st;
+    struct mk_ring_shared *shm;
+
+    if (fstat(fd, &st) || (size_t) st.st_size < sizeof(*shm) ||
+            mk_ring_map(ring, fd, st.st_size)) {
+        return -1;
+    }
+
+    /* The header is shared, check it the way mk_ring_create() sizes it */
+    shm = ring->shm;
+    if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != MK_RING_MAGIC ||
+            shm->slot_count == 0 || (shm->slot_count & (shm->slot_count - 1)) ||
+            shm->slot_size == 0 ||
+            shm->stride < (uint64_t) MK_RING_SLOT_HEADER + shm->slot_size ||
+            sizeof(*shm) + (size_t) shm->slot_count * shm->stride >
+            ring->map_size) {
+        munmap(ring->shm, ring->map_size);
+        return -1;
+    }
+    ring->slot_count = shm->slot_count;
+    ring->slot_size = shm->slot_size;
+    ring->stride = shm->stride;
+    ring->flags = shm->flags;
+    return 0;
+}
+
+void mk_ring_detach(struct mk_ring *ring)
+{
+    munmap(ring->shm, ring->map_size);
+    close(ring->fd);
+}
+
+void *mk_ring_reserve(struct mk_ring *ring, uint64_t *ticket)
+{
+    uint64_t pos, seq;
+    int64_t dif;
+    struct mk_ring_slot *slot;
+
+    pos = __atomic_load_n(&ring->shm->head, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = mk_ring_slot(ring, pos);
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        dif = (int64_t) (seq - pos);
+        if (dif == 0) {
+            if (ring->flags & MK_RING_SPSC) {
+                __atomic_store_n(&ring->shm->head, pos + 1, __ATOMIC_RELAXED);
+                break;
+            }
+            if (__atomic_compare_exchange_n(&ring->shm->head, &pos, pos + 1,
+                                            1, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (dif < 0) {
+            /* the consumer did not release this slot yet */
+            return NULL;
+        }
+        else {
+            pos = __atomic_load_n(&ring->shm->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    *ticket = pos;
+    return (char *) slot + MK_RING_SLOT_HEADER;
+}
+
+void mk_ring_commit(struct mk_ring *ring, uint64_t ticket, uint32_t len)
+{
+    struct mk_ring_slot *slot = mk_ring_slot(ring, ticket);
+
+    slot->len = len;
+    __atomic_store_n(&slot->seq, ticket + 1, __ATOMIC_RELEASE);
+}
+
+void *mk_ring_peek(struct mk_ring *ring, uint64_t *ticket, uint32_t *len)
+{
+    uint64_t pos;
+    struct mk_ring_slot *slot;
+
+    pos = __atomic_load_n(&ring->shm->tail, __ATOMIC_RELAXED);
+    slot = mk_ring_slot(ring, pos);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+        return NULL;
+    }
+
+    *ticket = pos;
+    *len = slot->len;
+    return (char *) slot + MK_RING_SLOT_HEADER;
+}
+
+void mk_ring_release(struct mk_ring *ring, uint64_t ticket)
+{
+    struct mk_ring_slot *slot = mk_ring_slot(ring, ticket);
+
+    __atomic_store_n(&ring->shm->tail, ticket + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, ticket + ring->slot_count, __ATOMIC_RELEASE);
+}
+
+int mk_ring_push_request(struct mk_ring *ring,
+        const struct mk_request_info *info)
+{
+    char *start;
+    void *dst;
+    size_t total, data_len;
+    uint32_t count;
+    uint64_t ticket;
+
+    total = mk_wire_size(info, &start, &data_len, &count);
+    if (total > ring->slot_size) {
+        return -1;
+    }
+    dst = mk_ring_reserve(ring, &ticket);
+    if (!dst) {
+        return -1;
+    }
+    mk_wire_fill(info, dst, total, start, data_len, count);
+    mk_ring_commit(ring, ticket, total);
+    return 0;
+}
@@ -0,0 +1,139 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_RING_H
+#define MK_HTTP_RING_H
+
+#include <stdint.h>
+
+#include "mk_http_parser2.h"
+
+/*
+ * Request wire form
+ * =================
+ *
+ * A parsed request, relocatable: the request bytes (request line to the
+ * end of the body) followed by an index of its header lines, every piece
+ * addressed by its offset in the record instead of a pointer. It can be
+ * written straight into shared memory and turned back into a struct
+ * mk_request_info in another process without copying.
+ */
+struct mk_wire_span {
+    uint32_t offset;
+    uint32_t len;
+};
+
+struct mk_wire_header {
+    struct mk_wire_span name;
+    struct mk_wire_span value;
+};
+
+struct mk_request_wire {
+    uint32_t size;              /* whole record */
+    uint32_t data_len;
+    uint32_t index_offset;      /* header index, from the record start */
+    uint32_t header_count;
+    uint64_t key;
+    uint64_t content_length;
+    int32_t connection;
+    int32_t target;
+
+    struct mk_wire_span method;
+    struct mk_wire_span protocol;
+    struct mk_wire_span uri;
+    struct mk_wire_span path;
+    struct mk_wire_span query;
+    struct mk_wire_span scheme;
+    struct mk_wire_span host;
+    struct mk_wire_span port;
+    struct mk_wire_span headers;
+    struct mk_wire_span body;
+    struct mk_quick_header quick_headers[MK_QUICK_HEADER_COUNT];
+
+    char data[];                /* offsets are relative to data */
+};
+
+/* Write the wire form into dst, returns its size or -1 if it does not fit */
+int mk_request_wire_write(const struct mk_request_info *info,
+        void *dst, size_t size);
+
+/* Point info into the record, the record must outlive it */
+void mk_request_wire_view(struct mk_request_wire *wire,
+        struct mk_request_info *info);
+
+static inline const struct mk_wire_header *mk_request_wire_headers(
+        const struct mk_request_wire *wire)
+{
+    return (const struct mk_wire_header *) ((const char *) wire +
+                                            wire->index_offset);
+}
+
+/*
+ * Handoff ring
+ * ============
+ *
+ * A bounded ring of fixed size slots in a memfd backed shared memory
+ * segment, passing records from acceptor processes to a worker. Each slot
+ * carries a sequence number telling whose turn it is (producer or
+ * consumer, and for which lap), so the ring needs no lock: producers
+ * claim a slot with a compare-and-swap on the head, or with a plain store
+ * when the ring is created MK_RING_SPSC for a single producer. There is
+ * one consumer.
+ *
+ * The payload is built in place: reserve a slot, write into it (e.g. with
+ * mk_request_wire_write()), commit it. The consumer reads it in place too
+ * and releases it once done, so a request is copied only once, into the
+ * ring.
+ *
+ * Another process maps the ring with mk_ring_attach() on the memfd
+ * descriptor, inherited through fork() or passed over a unix socket.
+ */
+#define MK_RING_SPSC  (1 << 0)
+
+struct mk_ring_shared;
+
+struct mk_ring {
+    int fd;
+    size_t map_size;
+    struct mk_ring_shared *shm;
+    char *slots;
+    uint32_t slot_count;        /* power of two */
+    uint32_t slot_size;         /* payload bytes per slot */
+    uint32_t stride;
+    int flags;
+};
+
+int mk_ring_create(struct mk_ring *ring, uint32_t slot_count,
+        uint32_t slot_size, int flags);
+int mk_ring_attach(struct mk_ring *ring, int fd);
+void mk_ring_detach(struct mk_ring *ring);
+
+/* Producer side: a slot to write up to slot_size bytes into, NULL if full */
+void *mk_ring_reserve(struct mk_ring *ring, uint64_t *ticket);
+void mk_ring_commit(struct mk_ring *ring, uint64_t ticket, uint32_t len);
+
+/* Consumer side: the oldest committed payload, NULL if there is none */
+void *mk_ring_peek(struct mk_ring *ring, uint64_t *ticket, uint32_t *len);
+void mk_ring_release(struct mk_ring *ring, uint64_t ticket);
+
+/* Reserve, write the wire form of info and commit; -1 if full or too big */
+int mk_ring_push_request(struct mk_ring *ring,
+        const struct mk_request_info *info);
+
+#endif // MK_HTTP_RING_H
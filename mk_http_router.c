@@ -0,0 +1,470 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mk_http_router.h"
+
+struct mk_route {
+    int handler;
+    int count;
+    char *names[MK_ROUTE_MAX_PARAMS];
+};
+
+/*
+ * A node is entered by matching its label. Static children are sorted by
+ * the first byte of their label, which is unique among siblings.
+ */
+struct mk_route_node {
+    char *label;
+    size_t label_len;
+
+    unsigned char *keys;
+    struct mk_route_node **children;
+    int child_count;
+
+    struct mk_route_node *param;    /* :name child */
+    struct mk_route *route;         /* route ending here */
+    struct mk_route *wildcard;      /* route ending here with * */
+};
+
+struct mk_route_table {
+    struct mk_route_node root;
+};
+
+static void mk_route_free(struct mk_route *route)
+{
+    int i;
+
+    if (!route) {
+        return;
+    }
+    for (i = 0; i < route->count; i++) {
+        free(route->names[i]);
+    }
+    free(route);
+}
+
+static void mk_route_node_free(struct mk_route_node *node)
+{
+    int i;
+
+    for (i = 0; i < node->child_count; i++) {
+        mk_route_node_free(node->children[i]);
+        free(node->children[i]);
+    }
+    if (node->param) {
+        mk_route_node_free(node->param);
+        free(node->param);
+    }
+    mk_route_free(node->route);
+    mk_route_free(node->wildcard);
+    free(node->keys);
+    free(node->children);
+    free(node->label);
+}
+
+static struct mk_route_node *mk_route_node_new(const char *label, size_t len)
+{
+    struct mk_route_node *node;
+
+    node = calloc(1, sizeof(*node));
+    if (!node) {
+        return NULL;
+    }
+    if (len > 0) {
+        node->label = malloc(len);
+        if (!node->label) {
+            free(node);
+            return NULL;
+        }
+        memcpy(node->label, label, len);
+        node->label_len = len;
+    }
+    return node;
+}
+
+/* Index of the child whose label starts with c, or where it would go */
+static int mk_route_child_pos(const struct mk_route_node *node,
+        unsigned char c)
+{
+    int lo = 0, hi = node->child_count, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (node->keys[mid] < c) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static struct mk_route_node *mk_route_child_add(struct mk_route_node *node,
+        int pos, const char *label, size_t len)
+{
+    unsigned char *keys;
+    struct mk_route_node **children, *child;
+
+    child = mk_route_node_new(label, len);
+    if (!child) {
+        return NULL;
+    }
+    keys = realloc(node->keys, node->child_count + 1);
+    if (keys) {
+        node->keys = keys;
+    }
+    children = realloc(node->children,
+                       (node->child_count + 1) * sizeof(*children));
+    if (children) {
+        node->children = children;
+    }
+    if (!keys || !children) {
+        free(child->label);
+        free(child);
+        return NULL;
+    }
+
+    memmove(keys + pos + 1, keys + pos, node->child_count - pos);
+    memmove(children + pos + 1, children + pos,
+            (node->child_count - pos) * sizeof(*children));
+    keys[pos] = (unsigned char) *label;
+    children[pos] = child;
+    node->child_count++;
+    return child;
+}
+
+/* Cut the label of child pos at len, the head becomes a new parent */
+static struct mk_route_node *mk_route_split(struct mk_route_node *node,
+        int pos, size_t len)
+{
+    struct mk_route_node *child = node->children[pos], *head;
+
+    head = mk_route_node_new(child->label, len);
+    if (!head) {
+        return NULL;
+    }
+    head->keys = malloc(1);
+    head->children = malloc(sizeof(*head->children));
+    if (!head->keys || !head->children) {
+        mk_route_node_free(head);
+        free(head);
+        return NULL;
+    }
+
+    child->label_len -= len;
+    memmove(child->label, child->label + len, child->label_len);
+    head->keys[0] = (unsigned char) child->label[0];
+    head->children[0] = child;
+    head->child_count = 1;
+    node->children[pos] = head;
+    return head;
+}
+
+/* ':' and '*' are only special at the start of a segment */
+#define MK_ROUTE_SEGMENT(pattern, p)  ((p) == (pattern) || (p)[-1] == '/')
+
+struct mk_route_table *mk_route_table_create()
+{
+    return calloc(1, sizeof(struct mk_route_table));
+}
+
+void mk_route_table_destroy(struct mk_route_table *table)
+{
+    if (table) {
+        mk_route_node_free(&table->root);
+        free(table);
+    }
+}
+
+int mk_route_table_add(struct mk_route_table *table,
+        const char *pattern, int handler)
+{
+    int pos;
+    size_t common;
+    const char *p = pattern, *q, *end = pattern + strlen(pattern);
+    struct mk_route *route;
+    struct mk_route_node *node = &table->root, *child;
+
+    route = calloc(1, sizeof(*route));
+    if (!route) {
+        return -1;
+    }
+    route->handler = handler;
+
+    while (p < end) {
+        if (MK_ROUTE_SEGMENT(pattern, p) && *p == ':') {
+            q = memchr(p, '/', end - p);
+            if (!q) {
+                q = end;
+            }
+            if (q == p + 1 || route->count == MK_ROUTE_MAX_PARAMS) {
+                goto error;
+            }
+            route->names[route->count] = strndup(p + 1, q - p - 1);
+            if (!route->names[route->count]) {
+                goto error;
+            }
+            route->count++;
+
+            if (!node->param) {
+                node->param = mk_route_node_new(NULL, 0);
+                if (!node->param) {
+                    goto error;
+                }
+            }
+            node = node->param;
+            p = q;
+            continue;
+        }
+
+        if (MK_ROUTE_SEGMENT(pattern, p) && *p == '*') {
+            if (p + 1 != end || node->wildcard ||
+                    route->count == MK_ROUTE_MAX_PARAMS) {
+                goto error;
+            }
+            route->names[route->count] = strdup("*");
+            if (!route->names[route->count]) {
+                goto error;
+            }
+            route->count++;
+            node->wildcard = route;
+            return 0;
+        }
+
+        /* static run up to the next capture */
+        q = p + 1;
+        while (q < end && !(q[-1] == '/' && (*q == ':' || *q == '*'))) {
+            q++;
+        }
+
+        pos = mk_route_child_pos(node, (unsigned char) *p);
+        if (pos == node->child_count ||
+                node->keys[pos] != (unsigned char) *p) {
+            node = mk_route_child_add(node, pos, p, q - p);
+            if (!node) {
+                goto error;
+            }
+            p = q;
+            continue;
+        }
+
+        child = node->children[pos];
+        common = 1;
+        while (common < child->label_len && p + common < q &&
+               child->label[common] == p[common]) {
+            common++;
+        }
+        if (common < child->label_len) {
+            child = mk_route_split(node, pos, common);
+            if (!child) {
+                goto error;
+            }
+        }
+        node = child;
+        p += common;
+    }
+
+    if (node->route) {
+        goto error;
+    }
+    node->route = route;
+    return 0;
+
+ error:
+    mk_route_free(route);
+    return -1;
+}
+
+/*
+ * Static edges first, then the capture, then the suffix. Backtracking
+ * only happens where routes of different kinds overlap.
+ */
+static struct mk_route *mk_route_lookup(const struct mk_route_node *node,
+        char *p, char *end, mk_pointer *params, int depth)
+{
+    int pos;
+    char *q;
+    struct mk_route *route;
+    const struct mk_route_node *child;
+
+    if (p == end && node->route) {
+        return node->route;
+    }
+
+    if (p < end) {
+        pos = mk_route_child_pos(node, (unsigned char) *p);
+        if (pos < node->child_count && node->keys[pos] == (unsigned char) *p) {
+            child = node->children[pos];
+            if ((size_t) (end - p) >= child->label_len &&
+                    !memcmp(p, child->label, child->label_len)) {
+                route = mk_route_lookup(child, p + child->label_len, end,
+                                        params, depth);
+                if (route) {
+                    return route;
+                }
+            }
+        }
+
+        if (node->param && *p != '/') {
+            q = memchr(p, '/', end - p);
+            if (!q) {
+                q = end;
+            }
+            route = mk_route_lookup(node->param, q, end, params, depth + 1);
+            if (route) {
+                params[depth].data = p;
+                params[depth].len = q - p;
+                return route;
+            }
+        }
+    }
+
+    if (node->wildcard) {
+        params[depth].data = p;
+        params[depth].len = end - p;
+        return node->wildcard;
+    }
+    return NULL;
+}
+
+int mk_route_table_match(const struct mk_route_table *table,
+        mk_pointer path, struct mk_route_match *match)
+{
+    struct mk_route *route;
+
+    route = mk_route_lookup(&table->root, path.data, path.data + path.len,
+                            match->params, 0);
+    if (!route) {
+        match->handler = -1;
+        match->count = 0;
+        return -1;
+    }
+
+    match->handler = route->handler;
+    match->count = route->count;
+    match->names = (const char * const *) route->names;
+    return route->handler;
+}
+
+const mk_pointer *mk_route_param(const struct mk_route_match *match,
+        const char *name)
+{
+    int i;
+
+    for (i = 0; i < match->count; i++) {
+        if (!strcmp(match->names[i], name)) {
+            return &match->params[i];
+        }
+    }
+    return NULL;
+}
+
+static inline int mk_route_hex(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/*
+ * Percent-decode path into buf, which holds at least path.len bytes. An
+ * encoded '/' stays as sent so it cannot split a segment. Returns the
+ * decoded length, -1 on a malformed escape.
+ */
+static long mk_route_decode(mk_pointer path, char *buf)
+{
+    const char *p = path.data, *end = path.data + path.len, *run;
+    char *out = buf;
+    int hi, lo, c;
+
+    while (p < end) {
+        run = memchr(p, '%', end - p);
+        if (!run) {
+            run = end;
+        }
+        memcpy(out, p, run - p);
+        out += run - p;
+        p = run;
+        if (p == end) {
+            break;
+        }
+
+        if (end - p < 3 ||
+                (hi = mk_route_hex(p[1])) < 0 || (lo = mk_route_hex(p[2])) < 0) {
+            return -1;
+        }
+        c = (hi << 4) | lo;
+        if (c == '/') {
+            memcpy(out, p, 3);
+            out += 3;
+        }
+        else {
+            *out++ = c;
+        }
+        p += 3;
+    }
+    return out - buf;
+}
+
+int mk_router_match(struct mk_router *router,
+        const struct mk_request_info *info,
+        struct mk_route_match *match,
+        char *buf, size_t size)
+{
+    long len;
+    mk_pointer path = info->path;
+    struct mk_route_table *table;
+
+    match->handler = -1;
+    match->count = 0;
+
+    table = __atomic_load_n(&router->table, __ATOMIC_ACQUIRE);
+    if (!table) {
+        return -1;
+    }
+    /* an absolute-form target without a path asks for "/" */
+    if (path.len == 0) {
+        path.data = "/";
+        path.len = 1;
+    }
+    else if (memchr(path.data, '%', path.len)) {
+        if (path.len > size || (len = mk_route_decode(path, buf)) < 0) {
+            return -1;
+        }
+        path.data = buf;
+        path.len = len;
+    }
+    return mk_route_table_match(table, path, match);
+}
+
+struct mk_route_table *mk_router_swap(struct mk_router *router,
+        struct mk_route_table *table)
+{
+    return __atomic_exchange_n(&router->table, table, __ATOMIC_ACQ_REL);
+}
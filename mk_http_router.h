@@ -0,0 +1,96 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_ROUTER_H
+#define MK_HTTP_ROUTER_H
+
+#include "mk_http_parser2.h"
+
+/*
+ * URI router
+ * ==========
+ *
+ * Routes are compiled into a radix trie where each edge holds a run of
+ * static bytes, so a path is matched in one pass over its bytes. A pattern
+ * segment (what follows a '/') can also be:
+ *
+ *   :name   captures one non empty segment
+ *   *       captures the rest of the path, must end the pattern
+ *
+ * Static edges win over :name, which wins over *. Captures point into the
+ * matched path, nothing is copied. mk_router_match() matches the decoded
+ * path: info->path stays as sent, since the request is parsed again from
+ * the buffer, so a path holding %XX is decoded into the caller's scratch
+ * buffer and the captures point there. A path without escapes is matched
+ * where it is. An encoded '/' is left encoded, it never splits a segment.
+ * Routes are written decoded. The parser refuses paths with ".." or an
+ * encoded dot, so a match cannot climb out of its prefix.
+ *
+ * A route table is immutable once in use. struct mk_router publishes one
+ * with an atomic pointer: workers match without locks while a reload
+ * builds a new table and swaps it in. The table returned by
+ * mk_router_swap() can be destroyed once no worker may still be matching
+ * on it, e.g. after every worker went back to its event loop.
+ */
+
+#define MK_ROUTE_MAX_PARAMS (8)
+
+struct mk_route_table;
+
+struct mk_route_match {
+    int handler;
+    int count;
+    const char * const *names;          /* capture names, "*" for a suffix */
+    mk_pointer params[MK_ROUTE_MAX_PARAMS];
+};
+
+struct mk_router {
+    struct mk_route_table *table;
+};
+
+struct mk_route_table *mk_route_table_create(void);
+void mk_route_table_destroy(struct mk_route_table *table);
+
+/* Returns -1 on a malformed pattern or when the route already exists */
+int mk_route_table_add(struct mk_route_table *table,
+        const char *pattern, int handler);
+
+/* Returns the handler id, -1 when no route matches; path is used as is */
+int mk_route_table_match(const struct mk_route_table *table,
+        mk_pointer path, struct mk_route_match *match);
+
+/* Capture by name, NULL when the route has none */
+const mk_pointer *mk_route_param(const struct mk_route_match *match,
+        const char *name);
+
+/*
+ * Match info->path, decoded into buf when it has escapes. A buf of
+ * info->path.len bytes always fits; -1 when it is smaller, on a malformed
+ * escape or when no route matches.
+ */
+int mk_router_match(struct mk_router *router,
+        const struct mk_request_info *info,
+        struct mk_route_match *match,
+        char *buf, size_t size);
+
+/* Publish table, returns the table it replaced */
+struct mk_route_table *mk_router_swap(struct mk_router *router,
+        struct mk_route_table *table);
+
+#endif // MK_HTTP_ROUTER_H
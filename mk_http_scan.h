@@ -0,0 +1,352 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_SCAN_H
+#define MK_HTTP_SCAN_H
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+
+#include "mk_http_parser2.h"
+#include "mk_http_chars.h"
+
+/*
+ * Scanner primitives
+ * ==================
+ *
+ * Locate the pieces of the request line and of each header line, checking
+ * the grammar on the way when MK_HTTP_STRICT is set. They store nothing,
+ * the request parser and the callback parser (mk_http_events.h) are both
+ * built on them.
+ */
+
+#define MK_HTTP_VERSION_SAMPLE "HTTP/1.1"
+
+/*
+ * Split the request line starting at p into method, request-target and
+ * protocol, the form of the target is left to the caller. The caller
+ * made sure the line is complete. Returns the start of the header block,
+ * NULL when the line is malformed.
+ */
+static inline char *mk_http_scan_request_line(char *p, char *end,
+        mk_pointer *restrict method, mk_pointer *restrict uri,
+        mk_pointer *restrict protocol)
+{
+    char *tmp;
+
+#if MK_HTTP_STRICT
+    tmp = (char *) mk_char_span_tchar(p, end);
+    if (tmp == p || tmp == end || *tmp != ' ') {
+        return NULL;
+    }
+#else
+    tmp = memchr(p, ' ', end - p);
+    if (tmp == NULL) {
+        return NULL;
+    }
+#endif
+    method->data = p;
+    method->len = tmp - p;
+
+    p = tmp + 1;
+    if (*p == ' ') {
+        return NULL;
+    }
+#if MK_HTTP_STRICT
+    tmp = (char *) mk_char_span_target(p, end);
+    if (tmp == end) {
+        return NULL;
+    }
+#else
+    for (tmp = p; tmp && *tmp != ' ' && *tmp != '\n'; tmp++);
+#endif
+    if (*tmp != ' ') {
+        return NULL;
+    }
+    uri->data = p;
+    uri->len = tmp - p;
+
+    p = tmp + 1;
+    tmp = memchr(p, '\n', end - p);
+    if (tmp == NULL) {
+        return NULL;
+    }
+    protocol->data = p;
+    protocol->len = tmp - p - 1;
+#if MK_HTTP_STRICT
+    /* HTTP-version = "HTTP/" DIGIT "." DIGIT, followed by CRLF */
+    if (tmp - p != sizeof(MK_HTTP_VERSION_SAMPLE) ||
+            tmp[-1] != '\r' ||
+            strncmp(p, "HTTP/", 5) ||
+            !isdigit((unsigned char) p[5]) || p[6] != '.' ||
+            !isdigit((unsigned char) p[7])) {
+        return NULL;
+    }
+#endif
+
+    return tmp + 1;
+}
+
+/*
+ * Split the status line of a response starting at p into protocol, the
+ * three digit status code and the reason phrase, which may be empty. The
+ * caller made sure the line is complete. Returns the start of the header
+ * block, NULL when the line is malformed.
+ */
+static inline char *mk_http_scan_status_line(char *p, char *end,
+        mk_pointer *restrict protocol, int *restrict status,
+        mk_pointer *restrict reason)
+{
+    char *tmp;
+
+    tmp = memchr(p, ' ', end - p);
+    if (tmp == NULL || end - tmp < 5) {
+        return NULL;
+    }
+#if MK_HTTP_STRICT
+    if (tmp - p != sizeof(MK_HTTP_VERSION_SAMPLE) - 1 ||
+            strncmp(p, "HTTP/", 5) ||
+            !isdigit((unsigned char) p[5]) || p[6] != '.' ||
+            !isdigit((unsigned char) p[7])) {
+        return NULL;
+    }
+#endif
+    protocol->data = p;
+    protocol->len = tmp - p;
+
+    p = tmp + 1;
+    if (!isdigit((unsigned char) p[0]) || !isdigit((unsigned char) p[1]) ||
+            !isdigit((unsigned char) p[2])) {
+        return NULL;
+    }
+    *status = (p[0] - '0') * 100 + (p[1] - '0') * 10 + (p[2] - '0');
+
+    p += 3;
+    if (*p == ' ') {
+        p++;
+    }
+#if MK_HTTP_STRICT
+    else if (*p != '\r') {
+        return NULL;
+    }
+    tmp = (char *) mk_char_span_value(p, end);
+    if (tmp + 1 >= end || tmp[0] != '\r' || tmp[1] != '\n') {
+        return NULL;
+    }
+    reason->data = p;
+    reason->len = tmp - p;
+    return tmp + 2;
+#else
+    tmp = memchr(p, '\n', end - p);
+    if (tmp == NULL) {
+        return NULL;
+    }
+    reason->data = p;
+    reason->len = tmp - p;
+    if (tmp > p && tmp[-1] == '\r') {
+        reason->len--;
+    }
+    return tmp + 1;
+#endif
+}
+
+/*
+ * Locate the ':' and the '\n' of the header line starting at d. Both are
+ * left NULL while the line is incomplete and a blank line only sets eol.
+ * In strict mode the field-name is checked against tchar and the
+ * field-value against field-vchar in the same pass, -1 is returned on
+ * invalid bytes.
+ */
+static inline int mk_http_scan_header_line(char *d, char *end,
+        char **restrict colon, char **restrict eol)
+{
+#if MK_HTTP_STRICT
+    char *name_end, *p;
+
+    *colon = NULL;
+    *eol = NULL;
+
+    if (d < end && *d == '\r') {
+        if (d + 1 < end) {
+            if (d[1] != '\n') {
+                return -1;
+            }
+            *eol = d + 1;
+        }
+        return 0;
+    }
+
+    p = (char *) mk_char_span_field(d, end, (const char **) &name_end);
+    if (name_end == end) {
+        return 0;
+    }
+    else if (*name_end != ':' || name_end == d) {
+        return -1;
+    }
+
+    if (p == end || (*p == '\r' && p + 1 == end)) {
+        return 0;
+    }
+    else if (*p != '\r' || p[1] != '\n') {
+        return -1;
+    }
+
+    *colon = name_end;
+    *eol = p + 1;
+#else
+    *eol = memchr(d, '\n', end - d);
+    *colon = *eol ? memchr(d, ':', *eol - d) : NULL;
+#endif
+    return 0;
+}
+
+/*
+ * Quick header id of a field-name, MK_HEADER_OTHER if it is not indexed.
+ * Every quick header has a distinct length, one comparison is enough.
+ */
+static inline int mk_http_scan_header_id(const char *name, size_t len)
+{
+    const char *key;
+    int id;
+
+    switch (len) {
+    case 4:
+        key = "Host";
+        id = MK_HEADER_HOST;
+        break;
+    case 5:
+        key = "Range";
+        id = MK_HEADER_RANGE;
+        break;
+    case 6:
+        key = "Expect";
+        id = MK_HEADER_EXPECT;
+        break;
+    case 10:
+        key = "Connection";
+        id = MK_HEADER_CONNECTION;
+        break;
+    case 13:
+        key = "Last-Modified";
+        id = MK_HEADER_LAST_MODIFIED;
+        break;
+    case 14:
+        key = "Content-Length";
+        id = MK_HEADER_CONTENT_LENGTH;
+        break;
+    case 15:
+        key = "Accept-Encoding";
+        id = MK_HEADER_ACCEPT_ENCODING;
+        break;
+    case 17:
+        if ((name[0] | 0x20) == 't') {
+            key = "Transfer-Encoding";
+            id = MK_HEADER_TRANSFER_ENCODING;
+            break;
+        }
+        key = "If-Modified-Since";
+        id = MK_HEADER_IF_MODIFIED_SINCE;
+        break;
+    default:
+        return MK_HEADER_OTHER;
+    }
+
+    if (strncasecmp(name, key, len)) {
+        return MK_HEADER_OTHER;
+    }
+    return id;
+}
+
+/*
+ * Header lookup behind mk_http_request_header(), inline so the parser
+ * and embedders can resolve a constant key at compile time. Quick
+ * headers are answered from the index, others by walking the block.
+ */
+static inline int mk_http_header_lookup(
+        const struct mk_request_info *restrict info,
+        const char *restrict key,
+        const char **restrict value,
+        size_t *restrict value_len)
+{
+    char *d, *p;
+    off_t rem;
+    size_t len;
+    int quick_index;
+
+    len = strlen(key);
+    quick_index = mk_http_scan_header_id(key, len);
+    if (quick_index >= 0) {
+        if (info->quick_headers[quick_index].value_len != 0) {
+            if (value != NULL) {
+                *value = info->headers.data +
+                    info->quick_headers[quick_index].value_index;
+            }
+            if (value_len != NULL) {
+                *value_len = info->quick_headers[quick_index].value_len;
+            }
+            return 0;
+        }
+        else {
+            return -1;
+        }
+    }
+
+    d = info->headers.data;
+
+    do {
+        rem = info->headers.len - (d - info->headers.data);
+        p = memchr(d, ':', rem);
+        if (!p) {
+            break;
+        }
+        else if ((size_t)(p - d) == len) {
+            if (!strncasecmp(p - len, key, len)) {
+                for (; *p && (*p == ' '  || *p == ':'); p++);
+                if (value != NULL) {
+                    *value = p;
+                }
+                if (value_len != NULL) {
+                    rem = info->headers.len - (p - info->headers.data);
+                    d = memchr(p, '\n', rem);
+                    if (!d) {
+                            d = info->headers.data + info->headers.len;
+                    }
+                    if (d[-1] == '\r') {
+                        *value_len = d - p - 1;
+                    }
+                    else {
+                        *value_len = d - p;
+                    }
+                }
+                return 0;
+            }
+        }
+        rem = info->headers.len - (p - info->headers.data);
+        d = memchr(p, '\n', rem);
+        if (d) {
+            d++;
+        }
+    } while (p && d);
+
+    return -1;
+}
+
+#endif // MK_HTTP_SCAN_H
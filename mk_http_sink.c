@@ -0,0 +1,137 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "mk_http_sink.h"
+
+#define MK_SINK_PIPE_SIZE  (1 << 20)
+
+int mk_body_sink_init(struct mk_body_sink *sink,
+        const struct mk_request_info *info, int fd)
+{
+    const char *p = info->body.data;
+    size_t len = info->body.len;
+    ssize_t n;
+    struct stat st;
+
+    sink->fd = fd;
+    sink->pipe[0] = -1;
+    sink->pipe[1] = -1;
+    sink->remaining = info->content_length - info->body.len;
+    sink->relay = 0;
+
+    while (len > 0) {
+        n = write(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+
+    if (sink->remaining == 0) {
+        return 0;
+    }
+    if (fstat(fd, &st) == -1) {
+        return -1;
+    }
+    if (!S_ISFIFO(st.st_mode)) {
+        if (pipe2(sink->pipe, O_CLOEXEC) == -1) {
+            return -1;
+        }
+        /* A larger pipe means fewer round trips, the default is fine too */
+        fcntl(sink->pipe[1], F_SETPIPE_SZ, MK_SINK_PIPE_SIZE);
+    }
+    return 0;
+}
+
+/* Empty the relay pipe into the file */
+static int mk_body_sink_flush(struct mk_body_sink *sink)
+{
+    ssize_t n;
+
+    while (sink->relay > 0) {
+        n = splice(sink->pipe[0], NULL, sink->fd, NULL, sink->relay,
+                   SPLICE_F_MOVE);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        sink->relay -= n;
+    }
+    return 0;
+}
+
+int mk_body_sink_feed(struct mk_body_sink *sink, int sock)
+{
+    int out = sink->pipe[1] != -1 ? sink->pipe[1] : sink->fd;
+    size_t len;
+    ssize_t n;
+
+    while (sink->remaining > 0) {
+        len = sink->remaining < MK_SINK_CHUNK ? sink->remaining : MK_SINK_CHUNK;
+        n = splice(sock, NULL, out, NULL, len,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n == 0) {
+            return MK_HTTP_ERROR;
+        }
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                return MK_HTTP_ERROR;
+            }
+            if (sink->relay == 0) {
+                return MK_HTTP_PENDING;
+            }
+        }
+        else {
+            sink->remaining -= n;
+            if (sink->pipe[1] != -1) {
+                sink->relay += n;
+            }
+        }
+
+        if (sink->relay > 0 && mk_body_sink_flush(sink)) {
+            return MK_HTTP_ERROR;
+        }
+    }
+    return MK_HTTP_OK;
+}
+
+void mk_body_sink_release(struct mk_body_sink *sink)
+{
+    if (sink->pipe[0] != -1) {
+        close(sink->pipe[0]);
+        close(sink->pipe[1]);
+        sink->pipe[0] = -1;
+        sink->pipe[1] = -1;
+    }
+}
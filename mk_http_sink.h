@@ -0,0 +1,69 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_SINK_H
+#define MK_HTTP_SINK_H
+
+#include <stddef.h>
+
+#include "mk_http_parser2.h"
+
+/*
+ * Request body sink
+ * =================
+ *
+ * Moves the body of a request returned in state MK_RESPONSE_STREAM (see
+ * mk_http_body_sink_max()) from the socket to a file or a pipe inside the
+ * kernel. The part of the body already in the receive buffer is written
+ * once by mk_body_sink_init(), the rest goes through splice(2) and never
+ * reaches user space. splice(2) needs a pipe on one side, a file
+ * destination goes through a pipe owned by the sink. Exactly the body is
+ * taken from the socket, a pipelined request after it stays there.
+ *
+ * The destination is written in blocking mode. With a non-blocking socket
+ * mk_body_sink_feed() returns MK_HTTP_PENDING once the socket is drained,
+ * to be called again when it is readable; for a pipe destination it also
+ * does when the pipe is full.
+ */
+#define MK_SINK_CHUNK      (1 << 20)     /* most bytes per splice(2) */
+
+struct mk_body_sink {
+    int fd;                     /* destination */
+    int pipe[2];                /* socket to file relay, -1 if not needed */
+    unsigned long remaining;    /* body bytes still in the socket */
+    unsigned long relay;        /* bytes in the relay pipe */
+};
+
+/*
+ * Set up the sink for the request and write the buffered part of the body
+ * to fd. Returns 0 on success, -1 on error with errno set.
+ */
+int mk_body_sink_init(struct mk_body_sink *sink,
+        const struct mk_request_info *info, int fd);
+
+/*
+ * Move body bytes from sock. Returns MK_HTTP_OK once the whole body is in
+ * the destination, MK_HTTP_PENDING or MK_HTTP_ERROR, also when the peer
+ * closed before the end of the body.
+ */
+int mk_body_sink_feed(struct mk_body_sink *sink, int sock);
+
+void mk_body_sink_release(struct mk_body_sink *sink);
+
+#endif // MK_HTTP_SINK_H
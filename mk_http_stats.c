@@ -0,0 +1,106 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mk_http_stats.h"
+
+int mk_http_stats_enabled;
+
+static __thread struct mk_http_stats *mk_stats_local;
+
+static struct mk_http_stats *mk_stats_list;
+static pthread_mutex_t mk_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void mk_http_stats_enable(int on)
+{
+    __atomic_store_n(&mk_http_stats_enabled, on, __ATOMIC_RELAXED);
+}
+
+struct mk_http_stats *mk_http_stats_thread()
+{
+    struct mk_http_stats *st = mk_stats_local;
+
+    if (st) {
+        return st;
+    }
+    if (posix_memalign((void **) &st, 64, sizeof(*st))) {
+        return NULL;
+    }
+    memset(st, 0, sizeof(*st));
+
+    pthread_mutex_lock(&mk_stats_lock);
+    st->next = mk_stats_list;
+    mk_stats_list = st;
+    pthread_mutex_unlock(&mk_stats_lock);
+
+    mk_stats_local = st;
+    return st;
+}
+
+/* Copy one block, retrying while its owner is in the middle of an update */
+static void mk_stats_read(struct mk_http_stats *st, struct mk_http_counters *c)
+{
+    unsigned long seq;
+
+    for (;;) {
+        seq = __atomic_load_n(&st->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        memcpy(c, &st->c, sizeof(*c));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&st->seq, __ATOMIC_RELAXED) == seq) {
+            return;
+        }
+    }
+}
+
+void mk_http_stats_snapshot(struct mk_http_counters *out)
+{
+    unsigned int i;
+    unsigned long *sum, *add;
+    struct mk_http_counters c;
+    struct mk_http_stats *st;
+
+    memset(out, 0, sizeof(*out));
+    sum = (unsigned long *) out;
+    add = (unsigned long *) &c;
+
+    pthread_mutex_lock(&mk_stats_lock);
+    for (st = mk_stats_list; st; st = st->next) {
+        mk_stats_read(st, &c);
+        for (i = 0; i < sizeof(c) / sizeof(unsigned long); i++) {
+            sum[i] += add[i];
+        }
+    }
+    pthread_mutex_unlock(&mk_stats_lock);
+}
+
+double mk_http_stats_pending_ratio(const struct mk_http_counters *c)
+{
+    return c->calls ? (double) c->pending / c->calls : 0;
+}
+
+double mk_http_stats_bytes_per_request(const struct mk_http_counters *c)
+{
+    return c->requests ? (double) c->bytes / c->requests : 0;
+}
@@ -0,0 +1,93 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_STATS_H
+#define MK_HTTP_STATS_H
+
+/*
+ * Parser statistics
+ * =================
+ *
+ * Every thread running the parser owns a counter block, allocated on its
+ * first request, aligned and padded to a cache line and updated with
+ * plain increments. A per block sequence number lets
+ * mk_http_stats_snapshot() read each block consistently without making
+ * the writer wait, and sums all of them. Blocks of exited threads are
+ * kept so totals never go backwards.
+ *
+ * Accounting is off until mk_http_stats_enable() switches it on, a
+ * disabled parser only tests a flag. MK_HTTP_STATS=0 compiles it out of
+ * the parser altogether.
+ */
+#ifndef MK_HTTP_STATS
+#define MK_HTTP_STATS 1
+#endif
+
+#define MK_STATS_METHODS      6     /* GET, POST, HEAD, PUT, DELETE, other */
+#define MK_STATS_PROTOCOLS    4     /* HTTP/0.9, HTTP/1.0, HTTP/1.1, other */
+#define MK_STATS_PIPELINE     8     /* requests per call, the last counts 8+ */
+#define MK_STATS_STATUS_FIRST 400
+#define MK_STATS_STATUS_COUNT 200   /* error statuses 400 to 599 */
+
+struct mk_http_counters {
+    unsigned long calls;        /* mk_http_parser() invocations */
+    unsigned long pending;      /* calls ending on a partial request */
+    unsigned long bytes;        /* bytes scanned, re-entries included */
+    unsigned long requests;     /* complete requests */
+
+    unsigned long methods[MK_STATS_METHODS];
+    unsigned long protocols[MK_STATS_PROTOCOLS];
+    unsigned long pipeline[MK_STATS_PIPELINE];
+    unsigned long errors[MK_STATS_STATUS_COUNT];
+};
+
+struct mk_http_stats {
+    unsigned long seq;          /* odd while the owner is updating */
+    struct mk_http_counters c;
+    struct mk_http_stats *next;
+} __attribute__((aligned(64)));
+
+extern int mk_http_stats_enabled;
+
+void mk_http_stats_enable(int on);
+
+/* Block of the calling thread, NULL if it could not be allocated */
+struct mk_http_stats *mk_http_stats_thread(void);
+
+static inline void mk_http_stats_begin(struct mk_http_stats *st)
+{
+    __atomic_store_n(&st->seq, st->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void mk_http_stats_end(struct mk_http_stats *st)
+{
+    __atomic_store_n(&st->seq, st->seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Sum of all the blocks */
+void mk_http_stats_snapshot(struct mk_http_counters *out);
+
+/* Share of calls that ended waiting for more data */
+double mk_http_stats_pending_ratio(const struct mk_http_counters *c);
+
+/* Average bytes scanned per complete request */
+double mk_http_stats_bytes_per_request(const struct mk_http_counters *c);
+
+#endif // MK_HTTP_STATS_H
@@ -0,0 +1,80 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_STATUS_H
+#define MK_HTTP_STATUS_H
+
+/*
+ * HTTP status codes. Note that MK_HTTP_OK is the parser status, the 200
+ * status code is MK_SUCCESS_OK.
+ */
+
+/* Informational */
+#define MK_INFO_CONTINUE			100
+#define MK_INFO_SWITCH_PROTOCOL			101
+
+/* Success */
+#define MK_SUCCESS_OK				200
+#define MK_SUCCESS_CREATED			201
+#define MK_SUCCESS_ACCEPTED			202
+#define MK_SUCCESS_NON_AUTH_INFO		203
+#define MK_SUCCESS_NOCONTENT			204
+#define MK_SUCCESS_RESET			205
+#define MK_SUCCESS_PARTIAL			206
+
+/* Redirections */
+#define MK_REDIR_MULTIPLE			300
+#define MK_REDIR_MOVED				301
+#define MK_REDIR_MOVED_T			302
+#define MK_REDIR_SEE_OTHER			303
+#define MK_NOT_MODIFIED				304
+#define MK_REDIR_USE_PROXY			305
+#define MK_REDIR_TEMPORARY			307
+#define MK_REDIR_PERMANENT			308
+
+/* Client Errors */
+#define MK_CLIENT_BAD_REQUEST			400
+#define MK_CLIENT_UNAUTH			401
+#define MK_CLIENT_PAYMENT_REQ   		402     /* Wtf?! :-) */
+#define MK_CLIENT_FORBIDDEN			403
+#define MK_CLIENT_NOT_FOUND			404
+#define MK_CLIENT_METHOD_NOT_ALLOWED		405
+#define MK_CLIENT_NOT_ACCEPTABLE		406
+#define MK_CLIENT_PROXY_AUTH			407
+#define MK_CLIENT_REQUEST_TIMEOUT		408
+#define MK_CLIENT_CONFLICT			409
+#define MK_CLIENT_GONE				410
+#define MK_CLIENT_LENGTH_REQUIRED		411
+#define MK_CLIENT_PRECOND_FAILED		412
+#define MK_CLIENT_REQUEST_ENTITY_TOO_LARGE	413
+#define MK_CLIENT_REQUEST_URI_TOO_LONG		414
+#define MK_CLIENT_UNSUPPORTED_MEDIA		415
+#define MK_CLIENT_REQUESTED_RANGE_NOT_SATISF    416
+#define MK_CLIENT_EXPECTATION_FAILED		417
+#define MK_CLIENT_REQUEST_HEADER_TOO_LARGE	431
+
+/* Server Errors */
+#define MK_SERVER_INTERNAL_ERROR		500
+#define MK_SERVER_NOT_IMPLEMENTED		501
+#define MK_SERVER_BAD_GATEWAY			502
+#define MK_SERVER_SERVICE_UNAV			503
+#define MK_SERVER_GATEWAY_TIMEOUT		504
+#define MK_SERVER_HTTP_VERSION_UNSUP		505
+
+#endif // MK_HTTP_STATUS_H
@@ -0,0 +1,47 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_TEST_H
+#define MK_HTTP_TEST_H
+
+/* Output helpers of the standalone test runner */
+
+/* ANSI Colors */
+#define ANSI_RESET "\033[0m"
+#define ANSI_BOLD  "\033[1m"
+
+#define ANSI_CYAN          "\033[36m"
+#define ANSI_BOLD_CYAN     ANSI_BOLD ANSI_CYAN
+#define ANSI_MAGENTA       "\033[35m"
+#define ANSI_BOLD_MAGENTA  ANSI_BOLD ANSI_MAGENTA
+#define ANSI_RED           "\033[31m"
+#define ANSI_BOLD_RED      ANSI_BOLD ANSI_RED
+#define ANSI_YELLOW        "\033[33m"
+#define ANSI_BOLD_YELLOW   ANSI_BOLD ANSI_YELLOW
+#define ANSI_BLUE          "\033[34m"
+#define ANSI_BOLD_BLUE     ANSI_BOLD ANSI_BLUE
+#define ANSI_GREEN         "\033[32m"
+#define ANSI_BOLD_GREEN    ANSI_BOLD ANSI_GREEN
+#define ANSI_WHITE         "\033[37m"
+#define ANSI_BOLD_WHITE    ANSI_BOLD ANSI_WHITE
+
+#define TEST_OK      0
+#define TEST_FAIL    1
+
+#endif // MK_HTTP_TEST_H
@@ -0,0 +1,197 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mk_http_timing.h"
+
+int mk_http_timing_enabled;
+
+static __thread struct mk_http_timing *mk_timing_local;
+
+static struct mk_http_timing *mk_timing_list;
+static pthread_mutex_t mk_timing_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *mk_phase_names[MK_PHASE_COUNT] = {
+    "request_line",
+    "headers",
+    "sanity",
+    "uri",
+    "body",
+};
+
+static inline int mk_histogram_index(unsigned long value)
+{
+    int exp;
+
+    if (value < MK_HIST_SUB) {
+        return value;
+    }
+    exp = 63 - __builtin_clzl(value);
+    if (exp >= MK_HIST_MAX_BITS) {
+        return MK_HIST_BUCKETS - 1;
+    }
+    return (exp - MK_HIST_SUB_BITS + 1) * MK_HIST_SUB +
+        (int) (value >> (exp - MK_HIST_SUB_BITS)) - MK_HIST_SUB;
+}
+
+static inline unsigned long mk_histogram_value(int index)
+{
+    int exp;
+
+    if (index < MK_HIST_SUB) {
+        return index;
+    }
+    exp = index / MK_HIST_SUB + MK_HIST_SUB_BITS - 1;
+    return (unsigned long) (MK_HIST_SUB + index % MK_HIST_SUB) <<
+        (exp - MK_HIST_SUB_BITS);
+}
+
+void mk_histogram_record(struct mk_histogram *h, unsigned long value)
+{
+    h->buckets[mk_histogram_index(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+void mk_histogram_merge(struct mk_histogram *dst, const struct mk_histogram *src)
+{
+    int i;
+
+    for (i = 0; i < MK_HIST_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+unsigned long mk_histogram_percentile(const struct mk_histogram *h,
+        double percentile)
+{
+    int i;
+    unsigned long rank, seen = 0;
+
+    if (h->count == 0) {
+        return 0;
+    }
+    rank = (unsigned long) (h->count * percentile / 100);
+    if (rank >= h->count) {
+        rank = h->count - 1;
+    }
+    for (i = 0; i < MK_HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen > rank) {
+            return mk_histogram_value(i);
+        }
+    }
+    return h->max;
+}
+
+void mk_http_timing_enable(int on)
+{
+    __atomic_store_n(&mk_http_timing_enabled, on, __ATOMIC_RELAXED);
+}
+
+static struct mk_http_timing *mk_timing_thread()
+{
+    struct mk_http_timing *t = mk_timing_local;
+
+    if (t) {
+        return t;
+    }
+    t = calloc(1, sizeof(*t));
+    if (!t) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&mk_timing_lock);
+    t->next = mk_timing_list;
+    mk_timing_list = t;
+    pthread_mutex_unlock(&mk_timing_lock);
+
+    mk_timing_local = t;
+    return t;
+}
+
+void mk_http_timing_record(int phase, unsigned long start)
+{
+    struct timespec ts;
+    struct mk_http_timing *t;
+    unsigned long now;
+
+    t = mk_timing_thread();
+    if (!t) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    now = ts.tv_sec * 1000000000UL + ts.tv_nsec + 1;
+    mk_histogram_record(&t->phases[phase], now > start ? now - start : 0);
+}
+
+void mk_http_timing_snapshot(struct mk_http_timing *out)
+{
+    int i;
+    struct mk_http_timing *t;
+
+    memset(out, 0, sizeof(*out));
+
+    pthread_mutex_lock(&mk_timing_lock);
+    for (t = mk_timing_list; t; t = t->next) {
+        for (i = 0; i < MK_PHASE_COUNT; i++) {
+            mk_histogram_merge(&out->phases[i], &t->phases[i]);
+        }
+    }
+    pthread_mutex_unlock(&mk_timing_lock);
+}
+
+int mk_http_timing_export(const struct mk_http_timing *timing,
+        char *buf, size_t size)
+{
+    int i, n;
+    size_t len = 0;
+    const struct mk_histogram *h;
+
+    for (i = 0; i < MK_PHASE_COUNT; i++) {
+        h = &timing->phases[i];
+        n = snprintf(buf + len, size - len,
+                     "phase=%s count=%lu mean=%lu p50=%lu p90=%lu p99=%lu "
+                     "p999=%lu max=%lu\n",
+                     mk_phase_names[i], h->count,
+                     h->count ? h->sum / h->count : 0,
+                     mk_histogram_percentile(h, 50),
+                     mk_histogram_percentile(h, 90),
+                     mk_histogram_percentile(h, 99),
+                     mk_histogram_percentile(h, 99.9),
+                     h->max);
+        if (n < 0 || (size_t) n >= size - len) {
+            return -1;
+        }
+        len += n;
+    }
+    return len;
+}
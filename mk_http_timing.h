@@ -0,0 +1,131 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_TIMING_H
+#define MK_HTTP_TIMING_H
+
+#include <stddef.h>
+#include <time.h>
+
+/*
+ * Parse phase timing
+ * ==================
+ *
+ * With MK_HTTP_TIMING=1 the parser timestamps its phases with
+ * CLOCK_MONOTONIC_RAW and records the durations, in nanoseconds, into
+ * per-thread histograms. Recording also has to be switched on at runtime
+ * with mk_http_timing_enable(). Built with the default MK_HTTP_TIMING=0,
+ * the probes compile to nothing.
+ *
+ * Histograms are log-linear, HDR style: values below 16 have a bucket
+ * each, above that every power of two is split into 16 buckets, so any
+ * value is known within 1/16 of it.
+ */
+#ifndef MK_HTTP_TIMING
+#define MK_HTTP_TIMING 0
+#endif
+
+enum mk_http_phase {
+    MK_PHASE_REQUEST_LINE = 0,
+    MK_PHASE_HEADERS,           /* mk_http_headers_process() */
+    MK_PHASE_SANITY,            /* mk_http_sanity_check(), URI included */
+    MK_PHASE_URI,               /* parse_uri() */
+    MK_PHASE_BODY,              /* body framing */
+    MK_PHASE_COUNT
+};
+
+#define MK_HIST_SUB_BITS  4
+#define MK_HIST_SUB       (1 << MK_HIST_SUB_BITS)
+#define MK_HIST_MAX_BITS  36    /* about 68 seconds, longer goes in the last bucket */
+#define MK_HIST_BUCKETS   ((MK_HIST_MAX_BITS - MK_HIST_SUB_BITS + 1) * MK_HIST_SUB)
+
+struct mk_histogram {
+    unsigned long count;
+    unsigned long sum;
+    unsigned long max;
+    unsigned long buckets[MK_HIST_BUCKETS];
+};
+
+void mk_histogram_record(struct mk_histogram *h, unsigned long value);
+void mk_histogram_merge(struct mk_histogram *dst, const struct mk_histogram *src);
+
+/* Lower bound of the bucket holding the given percentile, 0 to 100 */
+unsigned long mk_histogram_percentile(const struct mk_histogram *h,
+        double percentile);
+
+struct mk_http_timing {
+    struct mk_histogram phases[MK_PHASE_COUNT];
+    struct mk_http_timing *next;
+};
+
+extern int mk_http_timing_enabled;
+
+void mk_http_timing_enable(int on);
+
+/* Record the time elapsed since start in the calling thread's histogram */
+void mk_http_timing_record(int phase, unsigned long start);
+
+/*
+ * Merge the histograms of all threads into out. Blocks are read while
+ * their owners keep recording, a snapshot may miss the samples landing
+ * at the same time.
+ */
+void mk_http_timing_snapshot(struct mk_http_timing *out);
+
+/*
+ * Write one key=value line per phase (count, mean, p50, p90, p99, p999
+ * and max in nanoseconds) into buf. Returns the length written or -1 if
+ * buf is too small.
+ */
+int mk_http_timing_export(const struct mk_http_timing *timing,
+        char *buf, size_t size);
+
+#if MK_HTTP_TIMING
+/* Start of a phase, 0 while recording is off */
+static inline unsigned long mk_http_timing_start()
+{
+    struct timespec ts;
+
+    if (!mk_http_timing_enabled) {
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec + 1;
+}
+
+static inline void mk_http_timing_end(int phase, unsigned long start)
+{
+    if (start) {
+        mk_http_timing_record(phase, start);
+    }
+}
+#else
+static inline unsigned long mk_http_timing_start()
+{
+    return 0;
+}
+
+static inline void mk_http_timing_end(int phase, unsigned long start)
+{
+    (void) phase;
+    (void) start;
+}
+#endif
+
+#endif // MK_HTTP_TIMING_H
@@ -0,0 +1,207 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string.h>
+
+#include "mk_http_websocket.h"
+
+/*
+ * SHA-1
+ * =====
+ *
+ * Plain FIPS 180-4 with the message schedule kept in a 16 word ring and
+ * the four rounds groups unrolled by stage, enough for handshakes: the
+ * accept value is two blocks.
+ */
+#define SHA1_ROL(x, n)  (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define SHA1_W(i)                                                       \
+    (w[(i) & 15] = SHA1_ROL(w[((i) + 13) & 15] ^ w[((i) + 8) & 15] ^    \
+                            w[((i) + 2) & 15] ^ w[(i) & 15], 1))
+
+#define SHA1_ROUND(f, k, wi)                                            \
+    do {                                                                \
+        t = SHA1_ROL(a, 5) + (f) + e + (k) + (wi);                      \
+        e = d;                                                          \
+        d = c;                                                          \
+        c = SHA1_ROL(b, 30);                                            \
+        b = a;                                                          \
+        a = t;                                                          \
+    } while (0)
+
+static void sha1_block(uint32_t h[5], const unsigned char *p)
+{
+    uint32_t w[16], a, b, c, d, e, t;
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = (uint32_t) p[4 * i] << 24 | (uint32_t) p[4 * i + 1] << 16 |
+               (uint32_t) p[4 * i + 2] << 8 | p[4 * i + 3];
+    }
+
+    a = h[0];
+    b = h[1];
+    c = h[2];
+    d = h[3];
+    e = h[4];
+
+    for (i = 0; i < 16; i++) {
+        SHA1_ROUND((b & c) | (~b & d), 0x5a827999, w[i]);
+    }
+    for (; i < 20; i++) {
+        SHA1_ROUND((b & c) | (~b & d), 0x5a827999, SHA1_W(i));
+    }
+    for (; i < 40; i++) {
+        SHA1_ROUND(b ^ c ^ d, 0x6ed9eba1, SHA1_W(i));
+    }
+    for (; i < 60; i++) {
+        SHA1_ROUND((b & c) | (b & d) | (c & d), 0x8f1bbcdc, SHA1_W(i));
+    }
+    for (; i < 80; i++) {
+        SHA1_ROUND(b ^ c ^ d, 0xca62c1d6, SHA1_W(i));
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+static void sha1_digest(const uint32_t h[5], unsigned char digest[20])
+{
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        digest[4 * i]     = h[i] >> 24;
+        digest[4 * i + 1] = h[i] >> 16;
+        digest[4 * i + 2] = h[i] >> 8;
+        digest[4 * i + 3] = h[i];
+    }
+}
+
+void mk_sha1(const void *data, size_t len, unsigned char digest[20])
+{
+    uint32_t h[5] = {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+    };
+    const unsigned char *p = data;
+    unsigned char tail[128];
+    size_t rest, tail_len;
+    uint64_t bits = (uint64_t) len * 8;
+    int i;
+
+    for (rest = len; rest >= 64; rest -= 64, p += 64) {
+        sha1_block(h, p);
+    }
+
+    /* 0x80, zeros, then the length in bits as a big endian 64-bit */
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, p, rest);
+    tail[rest] = 0x80;
+    tail_len = rest < 56 ? 64 : 128;
+    for (i = 0; i < 8; i++) {
+        tail[tail_len - 1 - i] = bits >> (8 * i);
+    }
+
+    sha1_block(h, tail);
+    if (tail_len == 128) {
+        sha1_block(h, tail + 64);
+    }
+    sha1_digest(h, digest);
+}
+
+static const char base64_table[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+size_t mk_base64_encode(const unsigned char *in, size_t len, char *out)
+{
+    char *o = out;
+    uint32_t v;
+
+    for (; len >= 3; len -= 3, in += 3) {
+        v = (uint32_t) in[0] << 16 | (uint32_t) in[1] << 8 | in[2];
+        *o++ = base64_table[v >> 18];
+        *o++ = base64_table[(v >> 12) & 63];
+        *o++ = base64_table[(v >> 6) & 63];
+        *o++ = base64_table[v & 63];
+    }
+    if (len > 0) {
+        v = (uint32_t) in[0] << 16 | (len == 2 ? (uint32_t) in[1] << 8 : 0);
+        *o++ = base64_table[v >> 18];
+        *o++ = base64_table[(v >> 12) & 63];
+        *o++ = len == 2 ? base64_table[(v >> 6) & 63] : '=';
+        *o++ = '=';
+    }
+    return o - out;
+}
+
+void mk_websocket_accept(const char *key, char accept[MK_WEBSOCKET_ACCEPT_LEN])
+{
+    unsigned char buf[MK_WEBSOCKET_KEY_LEN + sizeof(MK_WEBSOCKET_GUID) - 1];
+    unsigned char digest[20];
+
+    memcpy(buf, key, MK_WEBSOCKET_KEY_LEN);
+    memcpy(buf + MK_WEBSOCKET_KEY_LEN, MK_WEBSOCKET_GUID,
+           sizeof(MK_WEBSOCKET_GUID) - 1);
+    mk_sha1(buf, sizeof(buf), digest);
+    mk_base64_encode(digest, sizeof(digest), accept);
+}
+
+#define WS_HEAD "HTTP/1.1 101 Switching Protocols\r\n"    \
+                "Upgrade: websocket\r\n"                  \
+                "Connection: Upgrade\r\n"                 \
+                "Sec-WebSocket-Accept: "
+#define WS_PROTOCOL "\r\nSec-WebSocket-Protocol: "
+
+int mk_websocket_response(const struct mk_request_info *info,
+        const mk_pointer *protocol, char *buf, size_t size)
+{
+    const char *key;
+    size_t key_len, len;
+    char *p = buf;
+
+    if (!(info->connection & MK_CONN_WEBSOCKET) ||
+            mk_http_request_header(info, "Sec-WebSocket-Key", &key, &key_len) ||
+            !mk_websocket_key_valid(key, key_len)) {
+        return -1;
+    }
+
+    len = sizeof(WS_HEAD) - 1 + MK_WEBSOCKET_ACCEPT_LEN + 4;
+    if (protocol != NULL) {
+        len += sizeof(WS_PROTOCOL) - 1 + protocol->len;
+    }
+    if (len > size) {
+        return -1;
+    }
+
+    memcpy(p, WS_HEAD, sizeof(WS_HEAD) - 1);
+    p += sizeof(WS_HEAD) - 1;
+    mk_websocket_accept(key, p);
+    p += MK_WEBSOCKET_ACCEPT_LEN;
+    if (protocol != NULL) {
+        memcpy(p, WS_PROTOCOL, sizeof(WS_PROTOCOL) - 1);
+        p += sizeof(WS_PROTOCOL) - 1;
+        memcpy(p, protocol->data, protocol->len);
+        p += protocol->len;
+    }
+    memcpy(p, "\r\n\r\n", 4);
+
+    return len;
+}
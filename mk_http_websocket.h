@@ -0,0 +1,84 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MK_HTTP_WEBSOCKET_H
+#define MK_HTTP_WEBSOCKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mk_http_parser2.h"
+
+/*
+ * WebSocket handshake
+ * ===================
+ *
+ * The parser flags MK_CONN_WEBSOCKET when Connection lists "upgrade" and
+ * Upgrade lists "websocket", and the sanity check then requires a valid
+ * opening handshake (RFC 6455 4.2.1): GET over HTTP/1.1, Sec-WebSocket-
+ * Version 13 and a Sec-WebSocket-Key of 16 bytes in base64, or the
+ * request is refused with 400.
+ *
+ * mk_websocket_response() writes the whole 101 response into a caller
+ * buffer, the Sec-WebSocket-Accept value is computed on the stack.
+ */
+#define MK_WEBSOCKET_KEY_LEN     (24)
+#define MK_WEBSOCKET_ACCEPT_LEN  (28)
+#define MK_WEBSOCKET_GUID        "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+void mk_sha1(const void *data, size_t len, unsigned char digest[20]);
+
+/* Standard base64 with padding, out gets 4 * ((len + 2) / 3) bytes */
+size_t mk_base64_encode(const unsigned char *in, size_t len, char *out);
+
+/* Sec-WebSocket-Accept for a validated key */
+void mk_websocket_accept(const char *key, char accept[MK_WEBSOCKET_ACCEPT_LEN]);
+
+/*
+ * 101 response to a request flagged MK_CONN_WEBSOCKET, protocol is the
+ * subprotocol picked from Sec-WebSocket-Protocol or NULL. Returns the
+ * length written, -1 when buf is too small or the request is no upgrade.
+ */
+int mk_websocket_response(const struct mk_request_info *info,
+        const mk_pointer *protocol, char *buf, size_t size);
+
+/*
+ * A key is 16 bytes in base64: 21 full characters, one holding the last
+ * two bits (A, Q, g or w) and "==".
+ */
+static inline int mk_websocket_key_valid(const char *key, size_t len)
+{
+    size_t i;
+    char c;
+
+    if (len != MK_WEBSOCKET_KEY_LEN || key[22] != '=' || key[23] != '=') {
+        return 0;
+    }
+    for (i = 0; i < 21; i++) {
+        c = key[i];
+        if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+              (c >= '0' && c <= '9') || c == '+' || c == '/')) {
+            return 0;
+        }
+    }
+    c = key[21];
+    return c == 'A' || c == 'Q' || c == 'g' || c == 'w';
+}
+
+#endif // MK_HTTP_WEBSOCKET_H
@@ -0,0 +1,754 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Monkey HTTP Server
+ *  ==================
+ *  Copyright 2001-2014 Monkey Software LLC <eduardo@monkey.io>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#ifdef SERVER_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#define SERVER_IO "uring"
+#else
+#include <sys/epoll.h>
+#define SERVER_IO "epoll"
+#endif
+
+#include "mk_http_parser2.h"
+#include "mk_http_response.h"
+#include "mk_http_buffer.h"
+
+/*
+ * Reference server
+ * ================
+ *
+ * Single threaded HTTP/1.1 server answering every request with the same
+ * canned 200, so a load generator over loopback measures the parser and
+ * the I/O path and nothing else. Two builds share the request handling:
+ *
+ *   server-uring: multishot accept and recv over io_uring, the kernel
+ *   picks the receive buffer from a registered provided buffer ring and
+ *   the parser runs on it in place. Only the partial request left at the
+ *   end of a buffer is copied, into the connection mk_buffer, and the
+ *   buffer goes back to the ring right away. Replies are linked sends of
+ *   the static reply, no copy either.
+ *
+ *   server-epoll: level triggered epoll, read(2) into the connection
+ *   mk_buffer and writev(2) of the replies.
+ *
+ * Usage: server-uring|server-epoll [port], 8080 by default. SIGINT stops
+ * the server and prints the number of requests answered.
+ */
+#define SERVER_PORT      8080
+#define SERVER_BACKLOG   1024
+#define SERVER_READ_MIN  1024   /* epoll: room asked before each read */
+#define SERVER_IOV       64     /* replies written per writev or batch */
+
+#define SERVER_BODY      "Hello, World!"
+
+static const char server_reply[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Server: Monkey/parser\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 13\r\n"
+    "\r\n"
+    SERVER_BODY;
+
+#define SERVER_REPLY_LEN (sizeof(server_reply) - 1)
+
+struct server_conn {
+    int fd;
+    struct mk_buffer buf;       /* partial request across reads */
+
+    int replies;                /* canned replies owed */
+    size_t offset;              /* epoll: bytes of the first one written */
+    const struct iovec *error;  /* canned error to send after them */
+    int close;                  /* close once everything is sent */
+
+#ifdef SERVER_URING
+    int reading;                /* multishot recv armed */
+    int inflight;               /* sends submitted, not completed */
+#endif
+};
+
+static volatile sig_atomic_t server_stop;
+static unsigned long server_requests;
+static struct mk_buffer_pool server_pool;
+
+static void server_signal(int sig)
+{
+    (void) sig;
+    server_stop = 1;
+}
+
+static int server_listen(int port)
+{
+    int fd, on = 1;
+    struct sockaddr_in addr;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        perror("socket");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+            listen(fd, SERVER_BACKLOG) == -1) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static struct server_conn *server_conn_new(int fd)
+{
+    int on = 1;
+    struct server_conn *conn;
+
+    conn = calloc(1, sizeof(*conn));
+    if (conn == NULL) {
+        close(fd);
+        return NULL;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    conn->fd = fd;
+    mk_buffer_init(&conn->buf, &server_pool);
+    return conn;
+}
+
+static void server_conn_free(struct server_conn *conn)
+{
+    close(conn->fd);
+    mk_buffer_release(&conn->buf);
+    free(conn);
+}
+
+/*
+ * Parse the requests in data and add their replies to the connection.
+ * Returns the bytes taken by complete requests, the rest is a partial one.
+ */
+static size_t server_parse(struct server_conn *conn, char *data, size_t len)
+{
+    int ret;
+    char *next = data;
+    struct mk_request sr, *r;
+
+    memset(&sr, 0, sizeof(sr));
+    ret = mk_http_parser(&sr, data, len);
+
+    for (r = &sr; r != NULL; r = r->next) {
+        if (r->response.http_status >= 400 ||
+                (ret == MK_HTTP_ERROR && r->next == NULL)) {
+            conn->error = r->response.error_page;
+            if (conn->error == NULL) {
+                conn->error = mk_response_error(MK_CLIENT_BAD_REQUEST);
+            }
+            conn->close = 1;
+            break;
+        }
+        if (r->state == MK_RESPONSE_UNUSED) {
+            break;
+        }
+
+        conn->replies++;
+        server_requests++;
+        next = mk_http_request_end(&r->request);
+        if (!(r->request.connection & MK_CONN_KEEP_ALIVE)) {
+            conn->close = 1;
+            break;
+        }
+    }
+
+    mk_http_request_release(&sr);
+    return next - data;
+}
+
+/* Parse what the connection buffer holds, once a head is complete */
+static void server_parse_buffer(struct server_conn *conn)
+{
+    size_t used;
+
+    if (!mk_buffer_head_ready(&conn->buf)) {
+        return;
+    }
+    used = server_parse(conn, mk_buffer_data(&conn->buf),
+                        mk_buffer_len(&conn->buf));
+    mk_buffer_consume(&conn->buf, used);
+}
+
+static void server_too_large(struct server_conn *conn)
+{
+    conn->error = mk_response_error(MK_CLIENT_REQUEST_ENTITY_TOO_LARGE);
+    conn->close = 1;
+}
+
+#ifdef SERVER_URING
+
+/*
+ * io_uring
+ * ========
+ *
+ * Raw system calls, no liburing. user_data carries the connection with
+ * the operation in its low bits.
+ */
+#define SERVER_ENTRIES   1024
+#define SERVER_CQ        8192
+#define SERVER_BUFFERS   1024   /* provided buffers, power of two */
+#define SERVER_BUF_SIZE  4096
+#define SERVER_BGID      0
+
+enum {
+    SERVER_OP_ACCEPT = 0,
+    SERVER_OP_RECV,
+    SERVER_OP_SEND,
+    SERVER_OP_ERROR,
+};
+
+#define SERVER_OP_MASK   (7UL)
+
+struct server_ring {
+    int fd;
+    unsigned sq_entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned sq_local;          /* tail not published yet */
+    unsigned submit;            /* entries to pass to io_uring_enter() */
+
+    struct io_uring_buf_ring *br;
+    char *bufs;
+    unsigned short br_tail;
+};
+
+static struct server_ring ring;
+static int server_fd;
+
+static int server_ring_enter(unsigned submit, unsigned wait)
+{
+    return syscall(__NR_io_uring_enter, ring.fd, submit, wait,
+                   wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+/* Append len bytes to the connection buffer, -1 when it is full */
+static int server_buffer_put(struct server_conn *conn, const char *data,
+        size_t len)
+{
+    size_t avail;
+    char *p;
+
+    p = mk_buffer_reserve(&conn->buf, len, &avail, NULL);
+    if (p == NULL) {
+        return -1;
+    }
+    memcpy(p, data, len);
+    mk_buffer_commit(&conn->buf, len);
+    return 0;
+}
+
+static void server_buffer_recycle(unsigned short bid)
+{
+    struct io_uring_buf *b;
+
+    b = &ring.br->bufs[ring.br_tail & (SERVER_BUFFERS - 1)];
+    b->addr = (unsigned long) (ring.bufs + (size_t) bid * SERVER_BUF_SIZE);
+    b->len = SERVER_BUF_SIZE;
+    b->bid = bid;
+    ring.br_tail++;
+    __atomic_store_n(&ring.br->tail, ring.br_tail, __ATOMIC_RELEASE);
+}
+
+static int server_ring_init()
+{
+    int i;
+    size_t sq_size, cq_size;
+    char *sq, *cq;
+    struct io_uring_params p;
+    struct io_uring_buf_reg reg;
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER;
+    p.cq_entries = SERVER_CQ;
+    ring.fd = syscall(__NR_io_uring_setup, SERVER_ENTRIES, &p);
+    if (ring.fd < 0) {
+        perror("io_uring_setup");
+        return -1;
+    }
+
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+    }
+    sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+              ring.fd, IORING_OFF_SQ_RING);
+    cq = sq;
+    if (sq != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+    }
+    ring.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring.fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || ring.sqes == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+
+    ring.sq_entries = p.sq_entries;
+    ring.sq_head = (unsigned *) (sq + p.sq_off.head);
+    ring.sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    ring.sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    ring.sq_array = (unsigned *) (sq + p.sq_off.array);
+    ring.cq_head = (unsigned *) (cq + p.cq_off.head);
+    ring.cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    ring.cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+    ring.sq_local = *ring.sq_tail;
+
+    /* Provided buffer ring, recv completions pick their buffer from it */
+    ring.br = mmap(NULL, SERVER_BUFFERS * sizeof(struct io_uring_buf),
+                   PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring.bufs = malloc((size_t) SERVER_BUFFERS * SERVER_BUF_SIZE);
+    if (ring.br == MAP_FAILED || ring.bufs == NULL) {
+        perror("buffers");
+        return -1;
+    }
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long) ring.br;
+    reg.ring_entries = SERVER_BUFFERS;
+    reg.bgid = SERVER_BGID;
+    if (syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PBUF_RING,
+                &reg, 1) < 0) {
+        perror("IORING_REGISTER_PBUF_RING");
+        return -1;
+    }
+    ring.br_tail = 0;
+    for (i = 0; i < SERVER_BUFFERS; i++) {
+        server_buffer_recycle(i);
+    }
+    return 0;
+}
+
+static struct io_uring_sqe *server_sqe(void *conn, int op)
+{
+    unsigned index;
+    struct io_uring_sqe *sqe;
+
+    if (ring.sq_local - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) ==
+            ring.sq_entries) {
+        server_ring_enter(ring.submit, 0);
+        ring.submit = 0;
+    }
+
+    index = ring.sq_local & *ring.sq_mask;
+    sqe = &ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = (unsigned long) conn | op;
+    ring.sq_array[index] = index;
+    ring.sq_local++;
+    ring.submit++;
+    __atomic_store_n(ring.sq_tail, ring.sq_local, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+static void server_accept_arm()
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = server_sqe(NULL, SERVER_OP_ACCEPT);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = server_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+}
+
+static void server_recv_arm(struct server_conn *conn)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = server_sqe(conn, SERVER_OP_RECV);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = SERVER_BGID;
+    conn->reading = 1;
+}
+
+static void server_send(struct server_conn *conn, int op,
+        const void *data, size_t len, int link)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = server_sqe(conn, op);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = conn->fd;
+    sqe->addr = (unsigned long) data;
+    sqe->len = len;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->flags = link ? IOSQE_IO_LINK : 0;
+    conn->inflight++;
+}
+
+static void server_conn_done(struct server_conn *conn)
+{
+    if (conn->reading || conn->inflight) {
+        return;
+    }
+    server_conn_free(conn);
+}
+
+/*
+ * Send what the connection owes as one chain of linked sends, so replies
+ * leave in order. A new chain starts only once the previous one is done.
+ */
+static void server_flush(struct server_conn *conn)
+{
+    int i, n;
+
+    if (conn->inflight) {
+        return;
+    }
+
+    n = conn->replies < SERVER_IOV ? conn->replies : SERVER_IOV;
+    conn->replies -= n;
+    for (i = 0; i < n; i++) {
+        server_send(conn, SERVER_OP_SEND, server_reply, SERVER_REPLY_LEN,
+                    i < n - 1 || (conn->replies == 0 && conn->error));
+    }
+    if (conn->replies == 0 && conn->error) {
+        server_send(conn, SERVER_OP_ERROR, conn->error->iov_base,
+                    conn->error->iov_len, 0);
+        conn->error = NULL;
+    }
+
+    if (conn->inflight == 0 && conn->close) {
+        /* Ends the multishot recv, the connection goes once it is done */
+        shutdown(conn->fd, SHUT_RDWR);
+    }
+}
+
+static void server_on_recv(struct server_conn *conn, struct io_uring_cqe *cqe)
+{
+    size_t used, len = cqe->res;
+    unsigned short bid;
+    char *data;
+
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        conn->reading = 0;
+    }
+
+    if (cqe->res == -ENOBUFS && !conn->close) {
+        /* Ran out of provided buffers, the recv stopped */
+        server_recv_arm(conn);
+        return;
+    }
+    if (cqe->res <= 0) {
+        conn->close = 1;
+        conn->replies = 0;
+        conn->error = NULL;
+        if (conn->reading) {
+            shutdown(conn->fd, SHUT_RDWR);
+        }
+        server_conn_done(conn);
+        return;
+    }
+
+    bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    data = ring.bufs + (size_t) bid * SERVER_BUF_SIZE;
+
+    if (conn->close) {
+        /* Closing, what comes after is dropped */
+    }
+    else if (mk_buffer_len(&conn->buf) == 0) {
+        /* Parsed in place, a partial request at the end is kept */
+        used = server_parse(conn, data, len);
+        if (!conn->close && used < len &&
+                server_buffer_put(conn, data + used, len - used)) {
+            server_too_large(conn);
+        }
+    }
+    else if (server_buffer_put(conn, data, len)) {
+        server_too_large(conn);
+    }
+    else {
+        server_parse_buffer(conn);
+    }
+    server_buffer_recycle(bid);
+
+    if (!conn->reading && !conn->close) {
+        server_recv_arm(conn);
+    }
+    server_flush(conn);
+}
+
+static void server_on_send(struct server_conn *conn, struct io_uring_cqe *cqe,
+        int op)
+{
+    conn->inflight--;
+    if (cqe->res < 0 ||
+            (op == SERVER_OP_SEND && cqe->res != (int) SERVER_REPLY_LEN)) {
+        /* Broken or short send, the stream cannot be continued */
+        conn->close = 1;
+        conn->replies = 0;
+        conn->error = NULL;
+    }
+    if (conn->inflight == 0) {
+        server_flush(conn);
+        server_conn_done(conn);
+    }
+}
+
+static int server_run(int fd)
+{
+    int op;
+    unsigned head, tail;
+    struct io_uring_cqe *cqe;
+    struct server_conn *conn;
+
+    server_fd = fd;
+    if (server_ring_init()) {
+        return -1;
+    }
+    server_accept_arm();
+
+    while (!server_stop) {
+        if (server_ring_enter(ring.submit, 1) < 0 && errno != EINTR) {
+            perror("io_uring_enter");
+            return -1;
+        }
+        ring.submit = 0;
+
+        head = *ring.cq_head;
+        tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            cqe = &ring.cqes[head & *ring.cq_mask];
+            op = cqe->user_data & SERVER_OP_MASK;
+            conn = (struct server_conn *) (cqe->user_data & ~SERVER_OP_MASK);
+
+            switch (op) {
+            case SERVER_OP_ACCEPT:
+                if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                    server_accept_arm();
+                }
+                if (cqe->res >= 0 &&
+                        (conn = server_conn_new(cqe->res)) != NULL) {
+                    server_recv_arm(conn);
+                }
+                break;
+            case SERVER_OP_RECV:
+                server_on_recv(conn, cqe);
+                break;
+            default:
+                server_on_send(conn, cqe, op);
+                break;
+            }
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+#else
+
+/*
+ * epoll
+ * =====
+ */
+#define SERVER_EVENTS    256
+
+static int server_epfd;
+
+/* Write the replies owed, returns -1 when the connection is done */
+static int server_write(struct server_conn *conn)
+{
+    int n = 0;
+    ssize_t ret;
+    size_t len;
+    struct iovec iov[SERVER_IOV + 1];
+
+    while (conn->replies > 0 || conn->error) {
+        for (n = 0; n < conn->replies && n < SERVER_IOV; n++) {
+            iov[n].iov_base = (char *) server_reply;
+            iov[n].iov_len = SERVER_REPLY_LEN;
+        }
+        if (n > 0) {
+            iov[0].iov_base = (char *) server_reply + conn->offset;
+            iov[0].iov_len -= conn->offset;
+        }
+        if (n == conn->replies && conn->error) {
+            iov[n++] = *conn->error;
+        }
+
+        ret = writev(conn->fd, iov, n);
+        if (ret == -1) {
+            return errno == EAGAIN ? 0 : -1;
+        }
+
+        /* Account whole replies, then the part of the next one */
+        len = ret + conn->offset;
+        conn->offset = 0;
+        while (len > 0 && conn->replies > 0) {
+            if (len < SERVER_REPLY_LEN) {
+                conn->offset = len;
+                break;
+            }
+            len -= SERVER_REPLY_LEN;
+            conn->replies--;
+        }
+        if (conn->replies == 0 && conn->error) {
+            if (len < conn->error->iov_len) {
+                /* A short canned error is not worth finishing */
+                return -1;
+            }
+            conn->error = NULL;
+        }
+        if (conn->replies > 0 && conn->offset > 0) {
+            return 0;
+        }
+    }
+    return conn->close ? -1 : 0;
+}
+
+static void server_on_read(struct server_conn *conn)
+{
+    size_t avail;
+    ssize_t n;
+    char *p;
+
+    p = mk_buffer_reserve(&conn->buf, SERVER_READ_MIN, &avail, NULL);
+    if (p == NULL) {
+        server_too_large(conn);
+        return;
+    }
+    n = read(conn->fd, p, avail);
+    if (n <= 0) {
+        if (n == 0 || errno != EAGAIN) {
+            conn->close = 1;
+        }
+        return;
+    }
+    mk_buffer_commit(&conn->buf, n);
+    server_parse_buffer(conn);
+}
+
+static void server_on_event(struct server_conn *conn, uint32_t events)
+{
+    struct epoll_event ev;
+
+    if ((events & EPOLLIN) && !conn->close) {
+        server_on_read(conn);
+    }
+    if ((events & (EPOLLERR | EPOLLHUP)) || server_write(conn) == -1 ||
+            (conn->close && conn->replies == 0 && !conn->error)) {
+        epoll_ctl(server_epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+        server_conn_free(conn);
+        return;
+    }
+
+    /* Wait for room to write the rest, reading stops meanwhile */
+    ev.events = conn->replies > 0 || conn->error ? EPOLLOUT : EPOLLIN;
+    ev.data.ptr = conn;
+    if (ev.events != (events & (EPOLLIN | EPOLLOUT))) {
+        epoll_ctl(server_epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+    }
+}
+
+static int server_run(int fd)
+{
+    int i, n, cfd;
+    struct epoll_event ev, events[SERVER_EVENTS];
+    struct server_conn *conn;
+
+    server_epfd = epoll_create1(0);
+    if (server_epfd == -1) {
+        perror("epoll_create1");
+        return -1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(server_epfd, EPOLL_CTL_ADD, fd, &ev);
+
+    while (!server_stop) {
+        n = epoll_wait(server_epfd, events, SERVER_EVENTS, -1);
+        if (n == -1 && errno != EINTR) {
+            perror("epoll_wait");
+            return -1;
+        }
+
+        for (i = 0; i < n; i++) {
+            if (events[i].data.ptr != NULL) {
+                server_on_event(events[i].data.ptr, events[i].events);
+                continue;
+            }
+            cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK);
+            if (cfd == -1 || (conn = server_conn_new(cfd)) == NULL) {
+                continue;
+            }
+            ev.events = EPOLLIN;
+            ev.data.ptr = conn;
+            epoll_ctl(server_epfd, EPOLL_CTL_ADD, cfd, &ev);
+        }
+    }
+    return 0;
+}
+
+#endif
+
+int main(int argc, char **argv)
+{
+    int fd, ret;
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = server_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    mk_response_errors_init();
+    mk_buffer_pool_init(&server_pool, 1024);
+
+    fd = server_listen(argc > 1 ? atoi(argv[1]) : SERVER_PORT);
+    if (fd == -1) {
+        return 1;
+    }
+
+    ret = server_run(fd);
+    printf("server=%s requests=%lu\n", SERVER_IO, server_requests);
+    mk_buffer_pool_destroy(&server_pool);
+    return ret ? 1 : 0;
+}
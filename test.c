@@ -20,12 +20,31 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 #ifdef TEST1
 #include "mk_http_parser.h"
 #else
 #include "mk_http_parser2.h"
+#include "mk_http_response.h"
+#include "mk_http_events.h"
+#include "mk_http_proxy.h"
+#include "mk_http_edit.h"
+#include "mk_http_router.h"
+#include "mk_http_stats.h"
+#include "mk_http_timing.h"
+#include "mk_http_ring.h"
+#include "mk_http_multipart.h"
+#include "mk_http_form.h"
+#include "mk_http_cookie.h"
+#include "mk_http_websocket.h"
+#include "mk_http_buffer.h"
+#include "mk_http_sink.h"
+#include "mk_http_log.h"
 #endif
+#include "mk_http_chars.h"
+#include "mk_http_test.h"
 
 int t_succeed;
 int t_failed;
@@ -142,6 +161,1180 @@ void test(char *id, char *buf, int res)
     }
 }
 
+#ifdef TEST2
+#define CHECK(cond)  check(#cond, cond)
+
+void check(char *id, int ok)
+{
+    if (ok) {
+        printf("%s[%s%s%s______OK_____%s%s]%s  ",
+               ANSI_BOLD, ANSI_RESET, ANSI_BOLD, ANSI_GREEN,
+               ANSI_RESET, ANSI_BOLD, ANSI_RESET);
+        t_succeed++;
+    }
+    else {
+        printf("%s[%s%s%s____FAIL_____%s%s]%s  ",
+               ANSI_BOLD, ANSI_RESET, ANSI_BOLD, ANSI_RED,
+               ANSI_RESET, ANSI_BOLD, ANSI_RESET);
+        t_failed++;
+    }
+    printf("%s[%sCHECK %s]%s\n\n", ANSI_BOLD, ANSI_RESET, id, ANSI_RESET);
+}
+
+void test_response()
+{
+    char buf[256];
+    struct iovec iov[8];
+    struct mk_response_writer w;
+    const mk_pointer *date;
+    char *r_404 = "HTTP/1.1 404 Not Found\r\n"
+                  "Server: Monkey\r\nContent-Length: 1024\r\n\r\n";
+
+    date = mk_response_date();
+
+    mk_response_writer_init(&w, buf, sizeof(buf), NULL, 0);
+    mk_response_write_status(&w, MK_CLIENT_NOT_FOUND);
+    mk_response_write_header(&w, "Server", 6, "Monkey", 6);
+    mk_response_write_content_length(&w, 1024);
+    mk_response_write_end(&w);
+    CHECK(w.error == 0 && w.len == w.total);
+    CHECK(w.len == strlen(r_404) && !memcmp(buf, r_404, w.len));
+
+    mk_response_writer_init(&w, buf, sizeof(buf), iov, 8);
+    mk_response_write_fast(&w, MK_NOT_MODIFIED, 0);
+    CHECK(w.error == 0 && w.iov_count == 2 &&
+          w.total == sizeof("HTTP/1.1 304 Not Modified\r\n") - 1 +
+                     date->len + 2);
+
+    mk_response_writer_init(&w, buf, 16, NULL, 0);
+    CHECK(mk_response_write_fast(&w, MK_SUCCESS_OK, 10) == -1);
+    CHECK(mk_response_status_line(299) == NULL);
+
+    /* canned errors */
+    const struct iovec *e;
+    struct mk_request req;
+    char *r_bad = "GET / HTTP/1.1\r\nHost: a:99999\r\n\r\n";
+    char *r_http2 = "GET / HTTP/2.0\r\nHost: a\r\n\r\n";
+
+    e = mk_response_error(MK_CLIENT_BAD_REQUEST);
+    CHECK(e != NULL && mk_response_errors_init() == 0 &&
+          mk_response_error(MK_CLIENT_BAD_REQUEST) == e);
+    e = mk_response_error(MK_CLIENT_REQUEST_URI_TOO_LONG);
+    CHECK(e != NULL && e->iov_len > 0 &&
+          !memcmp(e->iov_base, "HTTP/1.1 414 URI Too Long\r\n", 27));
+    CHECK(mk_response_error(MK_SUCCESS_OK) == NULL);
+
+    memset(&req, 0, sizeof(req));
+    mk_http_parser(&req, r_bad, strlen(r_bad));
+    CHECK(req.response.http_status == MK_CLIENT_BAD_REQUEST &&
+          req.response.error_page == mk_response_error(MK_CLIENT_BAD_REQUEST));
+
+    memset(&req, 0, sizeof(req));
+    mk_http_parser(&req, r_http2, strlen(r_http2));
+    CHECK(req.response.http_status == MK_SERVER_HTTP_VERSION_UNSUP &&
+          req.response.error_page != NULL);
+}
+
+void test_pipeline()
+{
+    struct mk_request req, *pending;
+    struct iovec out[4];
+    struct iovec r1 = { "1", 1 }, r2 = { "2", 1 };
+    char *r_10 = "GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n";
+    char *r_up = "GET / HTTP/1.1\r\nHost: a\r\n"
+                 "Connection: keep-alive, Upgrade\r\nUpgrade: h2c\r\n\r\n";
+    char *r_pipe = "GET /a HTTP/1.1\r\nHost: a\r\n\r\n"
+                   "GET /b HTTP/1.1\r\nHost: a\r\nConnection: close\r\n\r\n"
+                   "GET /c HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_part = "GET /a HTTP/1.1\r\nHost: a\r\n\r\nGET /b HTTP/1.1\r\nHo";
+    char *r_post = "POST /a HTTP/1.1\r\nHost: a\r\nContent-Length: 4\r\n\r\nbody"
+                   "GET /b HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_te = "POST /a HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n"
+                 "Content-Length: 5\r\n\r\n0\r\n\r\n"
+                 "GET /admin HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_chunked = "POST /a HTTP/1.1\r\nHost: a\r\n"
+                      "transfer-encoding: chunked\r\n\r\n0\r\n\r\n";
+    char *r_get_body = "GET / HTTP/1.1\r\nHost: a\r\nContent-Length: 34\r\n\r\n"
+                       "GET /smuggle HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_twice = "POST /a HTTP/1.1\r\nHost: a\r\nContent-Length: 0\r\n"
+                    "Content-Length: 5\r\n\r\nhello";
+    char *r_junk = "POST /a HTTP/1.1\r\nHost: a\r\nContent-Length: 5abc\r\n\r\nhello";
+    char *r_sign = "POST /a HTTP/1.1\r\nHost: a\r\nContent-Length: +5\r\n\r\nhello";
+    char *r_minus = "POST /a HTTP/1.1\r\nHost: a\r\nContent-Length: -1\r\n\r\n";
+
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_part, strlen(r_part)) == MK_HTTP_OK &&
+          req.state == MK_RESPONSE_NEW && req.response.http_status == 0);
+
+    /* The byte after the buffer must not complete the head */
+    CHECK(mk_http_parser(&req, r_pipe, 27) == MK_HTTP_OK &&
+          req.state == MK_RESPONSE_UNUSED);
+
+    CHECK(mk_http_parser(&req, r_post, strlen(r_post)) == MK_HTTP_OK &&
+          req.request.body.len == 4 && req.next != NULL &&
+          !strncmp(req.next->request.path.data, "/b", 2));
+    mk_http_request_release(&req);
+
+    /* Transfer-Encoding is refused, with or without Content-Length */
+    CHECK(mk_http_parser(&req, r_te, strlen(r_te)) == MK_HTTP_ERROR &&
+          req.next == NULL &&
+          req.response.http_status == MK_SERVER_NOT_IMPLEMENTED);
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_chunked, strlen(r_chunked)) == MK_HTTP_ERROR &&
+          req.response.http_status == MK_SERVER_NOT_IMPLEMENTED);
+    memset(&req, 0, sizeof(req));
+
+    /* A body is framed whatever the method, never read as a request */
+    CHECK(mk_http_parser(&req, r_get_body, strlen(r_get_body)) == MK_HTTP_OK &&
+          req.state == MK_RESPONSE_NEW && req.next == NULL &&
+          req.request.body.len == 34);
+    mk_http_request_release(&req);
+
+    /* Only a single Content-Length made of digits frames it */
+    CHECK(mk_http_parser(&req, r_twice, strlen(r_twice)) == MK_HTTP_ERROR &&
+          req.response.http_status == MK_CLIENT_BAD_REQUEST);
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_junk, strlen(r_junk)) == MK_HTTP_ERROR &&
+          req.response.http_status == MK_CLIENT_BAD_REQUEST);
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_sign, strlen(r_sign)) == MK_HTTP_ERROR &&
+          req.response.http_status == MK_CLIENT_BAD_REQUEST);
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_minus, strlen(r_minus)) == MK_HTTP_ERROR &&
+          req.response.http_status == MK_CLIENT_BAD_REQUEST);
+    memset(&req, 0, sizeof(req));
+
+    mk_http_parser(&req, r_10, strlen(r_10));
+    CHECK(req.request.connection == MK_CONN_KEEP_ALIVE);
+
+    mk_http_parser(&req, r_up, strlen(r_up));
+    CHECK(req.request.connection == (MK_CONN_KEEP_ALIVE | MK_CONN_UPGRADE));
+
+    mk_http_parser(&req, r_pipe, strlen(r_pipe));
+    CHECK(req.next != NULL && req.next->next == NULL);
+    CHECK(req.request.connection == MK_CONN_KEEP_ALIVE &&
+          req.next->request.connection == 0);
+
+    mk_response_done(req.next, &r2, 1);
+    CHECK(mk_response_queue_gather(&req, out, 4, &pending) == 0 &&
+          pending == &req);
+    mk_response_done(&req, &r1, 1);
+    CHECK(mk_response_queue_gather(&req, out, 4, &pending) == 2 &&
+          pending == NULL && out[0].iov_base == r1.iov_base &&
+          out[1].iov_base == r2.iov_base);
+
+    mk_http_request_release(&req);
+}
+
+void test_expect()
+{
+    struct mk_request req;
+    char *r_ok = "POST /up HTTP/1.1\r\nHost: a\r\nContent-Length: 100\r\n"
+                 "Expect: 100-continue\r\n\r\n";
+    char *r_big = "POST /up HTTP/1.1\r\nHost: a\r\nContent-Length: 100000\r\n"
+                  "Expect: 100-continue\r\n\r\n";
+    char *r_path = "PUT /a/../b HTTP/1.1\r\nHost: a\r\nContent-Length: 10\r\n"
+                   "Expect: 100-continue\r\n\r\n";
+    char *r_unk = "PUT /a HTTP/1.1\r\nHost: a\r\nContent-Length: 10\r\n"
+                  "Expect: 200-ok\r\n\r\n";
+    char *r_body = "POST /up HTTP/1.1\r\nHost: a\r\nContent-Length: 100\r\n"
+                   "Expect: 100-continue\r\n\r\nabc";
+
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_ok, strlen(r_ok)) == 0 &&
+          req.state == MK_RESPONSE_UNUSED &&
+          req.response.interim == mk_response_continue());
+    CHECK(mk_http_parser(&req, r_body, strlen(r_body)) == 0 &&
+          req.response.interim == NULL);
+    CHECK(mk_http_parser(&req, r_big, strlen(r_big)) == -1 &&
+          req.response.http_status == MK_CLIENT_REQUEST_ENTITY_TOO_LARGE);
+    CHECK(mk_http_parser(&req, r_path, strlen(r_path)) == -1 &&
+          req.response.http_status == MK_CLIENT_FORBIDDEN &&
+          req.response.interim == NULL);
+    CHECK(mk_http_parser(&req, r_unk, strlen(r_unk)) == -1 &&
+          req.response.http_status == MK_CLIENT_EXPECTATION_FAILED);
+}
+#endif
+
+#ifdef TEST2
+struct filter {
+    int headers;
+    int host;
+    size_t body;
+};
+
+static int filter_header(void *data, int id,
+        const char *name, size_t name_len,
+        const char *value, size_t value_len)
+{
+    struct filter *f = data;
+
+    (void) name;
+    (void) name_len;
+    f->headers++;
+    if (id == MK_HEADER_HOST) {
+        f->host = (value_len == 1 && value[0] == 'a');
+    }
+    return 0;
+}
+
+static int filter_body(void *data, const char *body, size_t len)
+{
+    struct filter *f = data;
+
+    (void) body;
+    f->body += len;
+    return 0;
+}
+
+static int filter_method(void *data, const char *method, size_t len)
+{
+    (void) data;
+    return len != 3 || memcmp(method, "GET", 3);
+}
+
+static const struct mk_http_callbacks filter_cb = {
+    .on_header = filter_header,
+    .on_body   = filter_body,
+};
+
+static const struct mk_http_callbacks filter_get_cb = {
+    .on_method = filter_method,
+};
+
+MK_HTTP_PARSER_CALLBACKS(filter_parse, filter_cb)
+
+void test_events()
+{
+    struct filter f;
+    char *r_get = "GET / HTTP/1.1\r\nHost:  a \r\nX-A: b\r\n\r\nGET";
+    char *r_post = "POST / HTTP/1.1\r\nHost: a\r\nContent-Length: 4\r\n\r\nab";
+    char *r_twice = "POST / HTTP/1.1\r\nContent-Length: 4\r\n"
+                    "Content-Length: 4\r\n\r\nabcd";
+    char *r_empty = "POST / HTTP/1.1\r\nContent-Length: \r\n\r\n";
+    char *r_huge = "POST / HTTP/1.1\r\n"
+                   "Content-Length: 184467440737095516160\r\n\r\n";
+    char *r_te = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n"
+                 "Content-Length: 5\r\n\r\n0\r\n\r\n";
+
+    memset(&f, 0, sizeof(f));
+    CHECK(filter_parse(&f, r_get, strlen(r_get)) == (int) strlen(r_get) - 3 &&
+          f.headers == 2 && f.host == 1);
+
+    memset(&f, 0, sizeof(f));
+    CHECK(mk_http_parser_events(&filter_cb, &f, r_post, strlen(r_post)) ==
+          MK_HTTP_PENDING && f.body == 2);
+    CHECK(mk_http_parser_events(&filter_get_cb, NULL, r_post, strlen(r_post)) ==
+          MK_HTTP_STOPPED);
+
+    /* Only a single, well formed Content-Length frames a body */
+    CHECK(filter_parse(&f, r_twice, strlen(r_twice)) == MK_HTTP_ERROR);
+    CHECK(filter_parse(&f, r_empty, strlen(r_empty)) == MK_HTTP_ERROR);
+    CHECK(filter_parse(&f, r_huge, strlen(r_huge)) == MK_HTTP_ERROR);
+    CHECK(filter_parse(&f, r_te, strlen(r_te)) == MK_HTTP_ERROR);
+}
+
+void test_proxy()
+{
+    int i, n;
+    size_t len = 0;
+    char out[256], xff[64];
+    struct iovec iov[16];
+    struct mk_request req;
+    struct mk_proxy_view view;
+    char *r_in = "GET /p HTTP/1.1\r\nHost: a\r\n"
+                 "Connection: keep-alive, X-Secret\r\nX-Secret: 1\r\n"
+                 "X-Forwarded-For: 1.1.1.1\r\nAccept: */*\r\nTE: trailers\r\n\r\n";
+    char *r_out = "GET /p HTTP/1.1\r\nHost: a\r\n"
+                  "X-Forwarded-For: 1.1.1.1, 2.2.2.2\r\nAccept: */*\r\n"
+                  "Via: 1.1 mk\r\n\r\n";
+    char *r_cl = "GET /p HTTP/1.1\r\nHost: a\r\nContent-Length: 0\r\n"
+                 "X-A: b\r\ncontent-length: 0\r\n\r\n";
+    char *r_list = "GET /p HTTP/1.1\r\nHost: a\r\nContent-Length: 0, 0\r\n\r\n";
+    char *r_tokens = "GET /p HTTP/1.1\r\nHost: a\r\n"
+                     "Connection: a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p,X-Secret\r\n"
+                     "X-Secret: 1\r\n\r\n";
+    char *r_lines = "GET /p HTTP/1.1\r\nHost: a\r\nConnection: X-A\r\n"
+                    "X-A: 1\r\nConnection: keep-alive\r\n\r\n";
+    char *r_lines_out = "GET /p HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_get_body = "GET /p HTTP/1.1\r\nHost: a\r\nContent-Length: 2\r\n\r\nhi";
+
+    memset(&req, 0, sizeof(req));
+    mk_http_parser(&req, r_in, strlen(r_in));
+    n = mk_proxy_view_build(&view, &req.request, iov, 16, 2);
+    CHECK(n > 0 && view.xff_slot >= 0 && view.inject_count == 2);
+    CHECK(mk_proxy_view_forwarded_for(&view, "2.2.2.2", 7, xff, sizeof(xff)) == 0 &&
+          mk_proxy_view_inject(&view, "Via: 1.1 mk\r\n", 13) == 0);
+
+    for (i = 0; i < n; i++) {
+        memcpy(out + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+    CHECK(len == strlen(r_out) && !memcmp(out, r_out, len));
+    CHECK(mk_proxy_view_build(&view, &req.request, iov, 2, 2) == -1);
+
+    /* Ambiguous framing and overlong Connection lists are refused */
+    req.request.quick_headers[MK_HEADER_TRANSFER_ENCODING].value_index = 1;
+    CHECK(mk_proxy_view_build(&view, &req.request, iov, 16, 2) == -1);
+    mk_http_parser(&req, r_cl, strlen(r_cl));
+    CHECK(mk_proxy_view_build(&view, &req.request, iov, 16, 2) == -1);
+    mk_http_parser(&req, r_list, strlen(r_list));
+    CHECK(mk_proxy_view_build(&view, &req.request, iov, 16, 2) == -1);
+    mk_http_parser(&req, r_tokens, strlen(r_tokens));
+    CHECK(mk_proxy_view_build(&view, &req.request, iov, 16, 2) == -1);
+
+    /* Every Connection line names hop-by-hop headers */
+    mk_http_parser(&req, r_lines, strlen(r_lines));
+    n = mk_proxy_view_build(&view, &req.request, iov, 16, 0);
+    for (i = 0, len = 0; i < n; i++) {
+        memcpy(out + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+    CHECK(n > 0 && len == strlen(r_lines_out) && !memcmp(out, r_lines_out, len));
+
+    /* A GET body goes upstream along with its Content-Length */
+    mk_http_parser(&req, r_get_body, strlen(r_get_body));
+    n = mk_proxy_view_build(&view, &req.request, iov, 16, 0);
+    for (i = 0, len = 0; i < n; i++) {
+        memcpy(out + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+    CHECK(n > 0 && len == strlen(r_get_body) && !memcmp(out, r_get_body, len));
+
+    /* A Content-Length without the body it frames is not forwarded */
+    req.request.quick_headers[MK_HEADER_CONTENT_LENGTH].value_index = 1;
+    req.request.body.data = NULL;
+    CHECK(mk_proxy_view_build(&view, &req.request, iov, 16, 0) == -1);
+}
+
+void test_edit()
+{
+    size_t len;
+    const char *value;
+    char area[256];
+    struct mk_request req;
+    struct mk_header_editor ed;
+    char *r_in = "GET / HTTP/1.1\r\nHost: a\r\nX-A: 1\r\n"
+                 "Content-Length: 0\r\nX-A: 2\r\n\r\n";
+    char *r_out = "Host: example.com\r\nContent-Length: 7\r\n"
+                  "Via: 1.1 mk\r\n\r\n";
+    char *r_twice = "GET / HTTP/1.1\r\nHost: a\r\nX-A: 1\r\nHost: b\r\n\r\n";
+    char *r_twice_out = "Host: c\r\nX-A: 1\r\n\r\n";
+
+    memset(&req, 0, sizeof(req));
+    mk_http_parser(&req, r_in, strlen(r_in));
+    CHECK(mk_header_editor_init(&ed, &req.request, area, sizeof(area)) == 0);
+    CHECK(mk_header_set(&ed, "Host", 4, "example.com", 11) == 0 &&
+          mk_header_set(&ed, "Content-Length", 14, "7", 1) == 0 &&
+          mk_header_remove(&ed, "x-a", 3) == 2 &&
+          mk_header_append(&ed, "Via", 3, "1.1 mk", 6) == 0 &&
+          mk_header_editor_commit(&ed) == 0);
+
+    CHECK(req.request.headers.len == strlen(r_out) - 2 &&
+          !memcmp(req.request.headers.data, r_out, strlen(r_out)));
+    CHECK(mk_http_request_header(&req.request, "Content-Length",
+                                 &value, &len) == 0 &&
+          len == 1 && *value == '7');
+    CHECK(mk_http_request_header(&req.request, "Host", &value, &len) == 0 &&
+          len == 11 && !memcmp(value, "example.com", 11));
+    CHECK(mk_http_request_header(&req.request, "X-A", &value, &len) == -1);
+    CHECK(mk_header_append(&ed, "X-Big", 5, area, sizeof(area)) == -1);
+
+    /* One longer value moves the lines after it once, no gap is left */
+    mk_http_parser(&req, r_in, strlen(r_in));
+    CHECK(mk_header_editor_init(&ed, &req.request, area, sizeof(area)) == 0 &&
+          mk_header_set(&ed, "Host", 4, "example.com", 11) == 0 &&
+          ed.gap_len == 0 && mk_header_editor_commit(&ed) == 0 &&
+          !memcmp(area + 19, "X-A: 1\r\n", 8));
+
+    /* Setting a repeated header leaves one line, the index follows it */
+    mk_http_parser(&req, r_twice, strlen(r_twice));
+    CHECK(mk_header_editor_init(&ed, &req.request, area, sizeof(area)) == 0 &&
+          mk_header_set(&ed, "Host", 4, "c", 1) == 0 &&
+          mk_header_editor_commit(&ed) == 0);
+    CHECK(mk_http_request_header(&req.request, "Host", &value, &len) == 0 &&
+          len == 1 && *value == 'c');
+    CHECK(req.request.headers.len == strlen(r_twice_out) - 2 &&
+          !memcmp(req.request.headers.data, r_twice_out, strlen(r_twice_out)));
+}
+
+void test_router()
+{
+    struct mk_request req;
+    struct mk_router router = { NULL };
+    struct mk_route_table *t;
+    struct mk_route_match m;
+    const mk_pointer *id;
+    char *r_get = "GET /users/42/posts HTTP/1.1\r\nHost: a\r\n\r\n";
+    mk_pointer p_static = { "/users/me", 9 };
+    mk_pointer p_file = { "/static/css/a.css", 17 };
+    mk_pointer p_miss = { "/users/", 7 };
+    char *r_dots = "GET http://a/%2e%2e/etc HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_dot = "GET /static/.%2E/a HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_space = "GET /static/a%20b HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_esc = "GET /a%62c HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_slash = "GET /users/a%2Fb HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_bad = "GET /users/a%zz HTTP/1.1\r\nHost: a\r\n\r\n";
+    char scratch[64];
+
+    t = mk_route_table_create();
+    CHECK(mk_route_table_add(t, "/users/:id/posts", 1) == 0 &&
+          mk_route_table_add(t, "/users/me", 2) == 0 &&
+          mk_route_table_add(t, "/users/:id", 3) == 0 &&
+          mk_route_table_add(t, "/static/*", 4) == 0 &&
+          mk_route_table_add(t, "/", 5) == 0 &&
+          mk_route_table_add(t, "/abc", 7) == 0);
+    CHECK(mk_route_table_add(t, "/users/me", 6) == -1 &&
+          mk_route_table_add(t, "/a/*/b", 6) == -1);
+    CHECK(mk_router_swap(&router, t) == NULL);
+
+    memset(&req, 0, sizeof(req));
+    mk_http_parser(&req, r_get, strlen(r_get));
+    id = NULL;
+    if (mk_router_match(&router, &req.request, &m, NULL, 0) == 1) {
+        id = mk_route_param(&m, "id");
+    }
+    CHECK(id != NULL && id->len == 2 && !memcmp(id->data, "42", 2));
+
+    CHECK(mk_route_table_match(t, p_static, &m) == 2 && m.count == 0);
+    CHECK(mk_route_table_match(t, p_file, &m) == 4 &&
+          m.params[0].len == 9 && !memcmp(m.params[0].data, "css/a.css", 9));
+    CHECK(mk_route_table_match(t, p_miss, &m) == -1);
+
+    /* Routes match the decoded path, encoded dots are refused */
+    mk_http_parser(&req, r_dots, strlen(r_dots));
+    CHECK(req.response.http_status == MK_CLIENT_FORBIDDEN);
+    mk_http_parser(&req, r_dot, strlen(r_dot));
+    CHECK(req.response.http_status == MK_CLIENT_FORBIDDEN);
+    mk_http_parser(&req, r_space, strlen(r_space));
+    CHECK(req.response.http_status == 0 &&
+          mk_router_match(&router, &req.request, &m, scratch, 4) == -1);
+    CHECK(mk_router_match(&router, &req.request, &m, scratch,
+                          sizeof(scratch)) == 4 &&
+          m.params[0].len == 3 && !memcmp(m.params[0].data, "a b", 3));
+    CHECK(!memcmp(req.request.path.data, "/static/a%20b", 13));
+    mk_http_parser(&req, r_esc, strlen(r_esc));
+    CHECK(mk_router_match(&router, &req.request, &m, scratch,
+                          sizeof(scratch)) == 7);
+    mk_http_parser(&req, r_slash, strlen(r_slash));
+    CHECK(mk_router_match(&router, &req.request, &m, scratch,
+                          sizeof(scratch)) == 3 &&
+          m.params[0].len == 5 && !memcmp(m.params[0].data, "a%2Fb", 5));
+    mk_http_parser(&req, r_bad, strlen(r_bad));
+    CHECK(mk_router_match(&router, &req.request, &m, scratch,
+                          sizeof(scratch)) == -1);
+
+    mk_route_table_destroy(mk_router_swap(&router, NULL));
+}
+
+void test_upstream()
+{
+    struct mk_http_upstream res;
+    const char *value;
+    size_t len;
+    char *s_len = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n"
+                  "Server: up\r\n\r\nhello";
+    char *s_chunked = "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, chunked\r\n\r\n"
+                      "5;x=1\r\nhello\r\nA\r\n0123456789\r\n0\r\nT: 1\r\n\r\n";
+    char *s_close = "HTTP/1.0 200\r\n\r\nabc";
+    char *s_304 = "HTTP/1.1 304 Not Modified\r\nContent-Length: 10\r\n\r\n";
+    char *s_bad = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                  "2\r\nabc\r\n";
+
+    CHECK(mk_http_response_parser(&res, s_len, strlen(s_len) - 1, 0) ==
+          MK_HTTP_PENDING && res.framing == MK_BODY_LENGTH);
+    CHECK(mk_http_response_parser(&res, s_len, strlen(s_len), 0) == MK_HTTP_OK &&
+          res.status == 200 && res.reason.len == 2 && res.info.body.len == 5 &&
+          res.info.connection == MK_CONN_KEEP_ALIVE);
+    CHECK(mk_http_request_header(&res.info, "Server", &value, &len) == 0 &&
+          len == 2 && res.info.quick_headers[MK_HEADER_CONTENT_LENGTH].value_len == 1);
+
+    CHECK(mk_http_response_parser(&res, s_chunked, strlen(s_chunked) - 2, 0) ==
+          MK_HTTP_PENDING && res.framing == MK_BODY_CHUNKED);
+    CHECK(mk_http_response_parser(&res, s_chunked, strlen(s_chunked), 0) ==
+          MK_HTTP_OK && res.content_length == 15 &&
+          res.info.body.data + res.info.body.len == s_chunked + strlen(s_chunked));
+    CHECK(mk_http_response_parser(&res, s_bad, strlen(s_bad), 0) == MK_HTTP_ERROR);
+
+    CHECK(mk_http_response_parser(&res, s_close, strlen(s_close), 0) ==
+          MK_HTTP_PENDING && res.framing == MK_BODY_CLOSE);
+    CHECK(mk_http_response_parser(&res, s_close, strlen(s_close),
+                                  MK_HTTP_RESPONSE_EOF) == MK_HTTP_OK &&
+          res.info.body.len == 3 && res.info.connection == 0);
+
+    CHECK(mk_http_response_parser(&res, s_304, strlen(s_304), 0) == MK_HTTP_OK &&
+          res.framing == MK_BODY_NONE && res.info.body.len == 0);
+    CHECK(mk_http_response_parser(&res, s_len, strlen(s_len) - 5,
+                                  MK_HTTP_RESPONSE_HEAD) == MK_HTTP_OK);
+}
+
+void test_stats()
+{
+    struct mk_request req;
+    struct mk_http_counters a, b;
+    char *r_pipe = "GET /a HTTP/1.1\r\nHost: a\r\n\r\n"
+                   "HEAD /b HTTP/1.0\r\n\r\n";
+    char *r_part = "GET / HTTP/1.1\r\nHost: a\r\n";
+    char *r_bad = "GET / HTTP/1.1\r\n\r\n";
+
+    /* Nothing is counted until enabled */
+    mk_http_stats_snapshot(&a);
+    memset(&req, 0, sizeof(req));
+    mk_http_parser(&req, r_bad, strlen(r_bad));
+    mk_http_stats_snapshot(&b);
+    CHECK(b.calls == a.calls);
+
+    mk_http_stats_enable(1);
+    mk_http_parser(&req, r_pipe, strlen(r_pipe));
+    mk_http_request_release(&req);
+    mk_http_parser(&req, r_part, strlen(r_part));
+    mk_http_parser(&req, r_bad, strlen(r_bad));
+
+    mk_http_stats_snapshot(&b);
+    CHECK(b.calls - a.calls == 3 && b.pending - a.pending == 1 &&
+          b.requests - a.requests == 2 && b.pipeline[1] - a.pipeline[1] == 1);
+    CHECK(b.methods[0] - a.methods[0] == 1 && b.methods[2] - a.methods[2] == 1 &&
+          b.protocols[1] - a.protocols[1] == 1);
+    CHECK(b.errors[MK_CLIENT_BAD_REQUEST - MK_STATS_STATUS_FIRST] -
+          a.errors[MK_CLIENT_BAD_REQUEST - MK_STATS_STATUS_FIRST] == 1);
+    CHECK(b.bytes - a.bytes == strlen(r_pipe) + strlen(r_part) + strlen(r_bad));
+    mk_http_stats_enable(0);
+}
+
+void test_timing()
+{
+    int i;
+    char out[1024];
+    static struct mk_histogram a, b;
+    static struct mk_http_timing timing;
+
+    for (i = 1; i <= 1000; i++) {
+        mk_histogram_record(&a, i);
+    }
+    mk_histogram_record(&b, 1UL << 40);
+    CHECK(mk_histogram_percentile(&a, 0) == 1 &&
+          mk_histogram_percentile(&a, 50) >= 500 * 15 / 16 &&
+          mk_histogram_percentile(&a, 50) <= 500 &&
+          mk_histogram_percentile(&a, 100) <= 1000);
+
+    mk_histogram_merge(&a, &b);
+    CHECK(a.count == 1001 && a.max == 1UL << 40 &&
+          mk_histogram_percentile(&a, 100) >= 1UL << (MK_HIST_MAX_BITS - 1));
+
+    timing.phases[MK_PHASE_HEADERS] = a;
+    CHECK(mk_http_timing_export(&timing, out, sizeof(out)) > 0 &&
+          strstr(out, "phase=headers count=1001 ") != NULL);
+    CHECK(mk_http_timing_export(&timing, out, 16) == -1);
+}
+
+void test_key()
+{
+    struct mk_request req;
+    uint64_t k1, k2, k3, k4;
+    struct mk_request_key_policy policy = {
+        .fields = MK_KEY_METHOD | MK_KEY_HOST | MK_KEY_PATH,
+        .seed = 42,
+        .vary_count = 2,
+        .vary = { { "Accept-Encoding", 15 }, { "Accept-Language", 15 } },
+    };
+    char *r1 = "GET /a?x=1 HTTP/1.1\r\nHost: a\r\nAccept-Encoding: gzip\r\n"
+               "Accept-Language: en\r\nUser-Agent: x\r\n\r\n";
+    char *r2 = "GET /a?x=2 HTTP/1.1\r\nAccept-Language:  en \r\nUser-Agent: y\r\n"
+               "Host: a\r\nAccept-Encoding: gzip\r\n\r\n";
+    char *r3 = "GET /a HTTP/1.1\r\nHost: a\r\nAccept-Encoding: br\r\n"
+               "Accept-Language: en\r\n\r\n";
+    char *r4 = "GET /a HTTP/1.1\r\nHost: b\r\nAccept-Encoding: gzip\r\n"
+               "Accept-Language: en\r\n\r\n";
+
+    memset(&req, 0, sizeof(req));
+    mk_http_parser(&req, r1, strlen(r1));
+    CHECK(req.request.key == 0);
+
+    mk_http_key_policy(&policy);
+    mk_http_parser(&req, r1, strlen(r1));
+    k1 = req.request.key;
+    mk_http_parser(&req, r2, strlen(r2));
+    k2 = req.request.key;
+    mk_http_parser(&req, r3, strlen(r3));
+    k3 = req.request.key;
+    mk_http_parser(&req, r4, strlen(r4));
+    k4 = req.request.key;
+    mk_http_key_policy(NULL);
+
+    CHECK(k1 != 0 && k1 == k2);
+    CHECK(k3 != k1 && k4 != k1 && k3 != k4);
+}
+
+void test_ring()
+{
+    int i;
+    uint32_t len;
+    uint64_t ticket;
+    size_t value_len;
+    const char *value;
+    uint32_t geometry[3];     /* slot_count, slot_size, stride */
+    struct mk_ring ring, peer;
+    struct mk_request req;
+    struct mk_request_info info;
+    struct mk_request_wire *wire;
+    const struct mk_wire_header *index;
+    char *r_post = "POST /f?a=1 HTTP/1.1\r\nHost: a\r\nX-Id: 7\r\n"
+                   "Content-Length: 4\r\n\r\nbody";
+
+    memset(&req, 0, sizeof(req));
+    mk_http_parser(&req, r_post, strlen(r_post));
+
+    CHECK(mk_ring_create(&ring, 3, 512, 0) == -1);
+    CHECK(mk_ring_create(&ring, 2, 512, 0) == 0 &&
+          mk_ring_attach(&peer, dup(ring.fd)) == 0);
+    CHECK(mk_ring_peek(&peer, &ticket, &len) == NULL);
+
+    for (i = 0; i < 3; i++) {
+        if (mk_ring_push_request(&ring, &req.request)) {
+            break;
+        }
+    }
+    CHECK(i == 2);
+
+    wire = mk_ring_peek(&peer, &ticket, &len);
+    CHECK(wire != NULL && wire->size == len && wire->header_count == 3);
+    if (wire) {
+        mk_request_wire_view(wire, &info);
+        index = mk_request_wire_headers(wire);
+        CHECK(info.path.len == 2 && !memcmp(info.path.data, "/f", 2) &&
+              info.query.len == 3 && info.body.len == 4 &&
+              !memcmp(info.body.data, "body", 4));
+        CHECK(mk_http_request_header(&info, "X-Id", &value, &value_len) == 0 &&
+              value_len == 1 && *value == '7' &&
+              mk_http_request_header(&info, "Host", &value, &value_len) == 0 &&
+              *value == 'a');
+        CHECK(index[1].value.len == 1 && wire->data[index[1].value.offset] == '7');
+        mk_ring_release(&peer, ticket);
+    }
+    CHECK(mk_ring_push_request(&ring, &req.request) == 0);
+    mk_ring_detach(&peer);
+
+    /* A shared header mk_ring_create() would not write is refused */
+    geometry[0] = 3;
+    CHECK(pwrite(ring.fd, geometry, sizeof(uint32_t), 4) == sizeof(uint32_t) &&
+          mk_ring_attach(&peer, ring.fd) == -1);
+    geometry[0] = 2;
+    geometry[1] = 512;
+    geometry[2] = 64;
+    CHECK(pwrite(ring.fd, geometry, sizeof(geometry), 4) == sizeof(geometry) &&
+          mk_ring_attach(&peer, ring.fd) == -1);
+
+    mk_ring_detach(&ring);
+}
+struct t_multipart {
+    int parts;
+    int ends;
+    int calls;
+    size_t len;
+    char names[64];
+    char data[256];
+    const char *first;
+};
+
+static int t_mp_part(void *data, const struct mk_multipart_part *part)
+{
+    struct t_multipart *t = data;
+
+    if (part->name.data) {
+        strncat(t->names, part->name.data, part->name.len);
+    }
+    if (part->filename.data) {
+        strcat(t->names, "=");
+        strncat(t->names, part->filename.data, part->filename.len);
+    }
+    strcat(t->names, ",");
+    t->parts++;
+    return 0;
+}
+
+static int t_mp_data(void *data, const char *buf, size_t len)
+{
+    struct t_multipart *t = data;
+
+    if (t->calls++ == 0) {
+        t->first = buf;
+    }
+    memcpy(t->data + t->len, buf, len);
+    t->len += len;
+    return 0;
+}
+
+static int t_mp_end(void *data)
+{
+    struct t_multipart *t = data;
+
+    t->data[t->len++] = '|';
+    t->ends++;
+    return 0;
+}
+
+void test_multipart()
+{
+    size_t i;
+    int ret;
+    mk_pointer boundary;
+    struct mk_request req;
+    struct mk_multipart mp;
+    struct t_multipart t;
+    static const struct mk_multipart_callbacks cb = {
+        .on_part = t_mp_part,
+        .on_data = t_mp_data,
+        .on_part_end = t_mp_end,
+    };
+    char *r_post = "POST /up HTTP/1.1\r\nHost: a\r\nContent-Type: "
+                   "multipart/form-data; boundary=\"xYz\"\r\n"
+                   "Content-Length: 159\r\n\r\n"
+                   "preamble\r\n--xYz\r\n"
+                   "Content-Disposition: form-data; name=\"a\"\r\n\r\n"
+                   "1\r\n--xY\r\n"
+                   "--xYz  \r\nContent-Disposition: form-data; name=f; "
+                   "filename=\"b.txt\"\r\n\r\n\r\r\n--xYz--\r\nepilogue";
+    char *expect = "1\r\n--xY|\r|";
+    char *m_bad = "--xYz\r\nBad Name: 1\r\n\r\n";
+
+    memset(&req, 0, sizeof(req));
+    mk_http_parser(&req, r_post, strlen(r_post));
+    CHECK(mk_multipart_boundary(&req.request, &boundary) == 0 &&
+          boundary.len == 3 && !memcmp(boundary.data, "xYz", 3));
+
+    /* whole body, data is handed out in place */
+    memset(&t, 0, sizeof(t));
+    mk_multipart_init(&mp, boundary, &cb, &t);
+    ret = mk_multipart_feed(&mp, req.request.body.data, req.request.body.len);
+    CHECK(ret == MK_HTTP_OK && t.parts == 2 && t.ends == 2 &&
+          !strcmp(t.names, "a,f=b.txt,"));
+    CHECK(t.len == strlen(expect) && !memcmp(t.data, expect, t.len) &&
+          t.first > req.request.body.data &&
+          t.first < req.request.body.data + req.request.body.len);
+
+    /* one byte at a time */
+    memset(&t, 0, sizeof(t));
+    mk_multipart_init(&mp, boundary, &cb, &t);
+    for (i = 0, ret = MK_HTTP_PENDING; i < req.request.body.len; i++) {
+        ret = mk_multipart_feed(&mp, req.request.body.data + i, 1);
+        if (ret != MK_HTTP_PENDING) {
+            break;
+        }
+    }
+    CHECK(ret == MK_HTTP_OK && t.parts == 2 && t.ends == 2 &&
+          !strcmp(t.names, "a,f=b.txt,"));
+    CHECK(t.len == strlen(expect) && !memcmp(t.data, expect, t.len));
+
+    mk_multipart_init(&mp, boundary, &cb, &t);
+    CHECK(mk_multipart_feed(&mp, m_bad, strlen(m_bad)) == MK_HTTP_ERROR ||
+          !MK_HTTP_STRICT);
+    boundary.len = 71;
+    CHECK(mk_multipart_init(&mp, boundary, &cb, &t) == -1);
+}
+void test_form()
+{
+    int i;
+    struct mk_request req;
+    struct mk_form form;
+    const struct mk_form_field *f;
+    char q[] = "GET /s?q=monkey+http&a=1&&flag&a=%32&t=%e2%82%ac! HTTP/1.1\r\n"
+               "Host: a\r\n\r\n";
+    char r_post[] = "POST /f HTTP/1.1\r\nHost: a\r\nContent-Type: "
+                    "application/x-www-form-urlencoded; charset=utf-8\r\n"
+                    "Content-Length: 24\r\n\r\nuser%5Bname%5D=mk&pw=a%2";
+    char many[MK_FORM_FIELDS_MAX * 2 + 2];
+    char scratch[64];
+
+    memset(&req, 0, sizeof(req));
+    mk_http_parser(&req, q, strlen(q));
+    CHECK(mk_form_query(&form, &req.request, scratch, 8) == -1);
+    CHECK(mk_form_query(&form, &req.request, scratch, sizeof(scratch)) == 5);
+    CHECK(req.request.query.len == 42 &&
+          !memcmp(req.request.query.data, "q=monkey+http&", 14));
+    f = mk_form_get(&form, "q", 1);
+    CHECK(f && f->value.len == 11 && !memcmp(f->value.data, "monkey http", 11));
+    CHECK(f->value.data == scratch);
+    f = mk_form_get(&form, "a", 1);
+    CHECK(f && f->value.data == req.request.query.data + 16 &&
+          *f->value.data == '1' && (f = mk_form_next(&form, f)) &&
+          f->value.len == 1 && *f->value.data == '2' && !mk_form_next(&form, f));
+    f = mk_form_get(&form, "t", 1);
+    CHECK(f && f->value.len == 4 && !memcmp(f->value.data, "\xe2\x82\xac!", 4));
+    f = mk_form_get(&form, "flag", 4);
+    CHECK(f && f->value.len == 0 && !mk_form_get(&form, "fla", 3));
+
+    memset(&req, 0, sizeof(req));
+    mk_http_parser(&req, r_post, strlen(r_post));
+    CHECK(mk_form_body(&form, &req.request, scratch, sizeof(scratch)) == -1);
+    f = mk_form_get(&form, "user[name]", 10);
+    CHECK(form.count == 1 && f && f->value.len == 2);
+
+    for (i = 0; i < MK_FORM_FIELDS_MAX + 1; i++) {
+        many[i * 2] = 'a' + i % 26;
+        many[i * 2 + 1] = '&';
+    }
+    CHECK(mk_form_parse(&form, many, sizeof(many) - 2, scratch, 0) ==
+          MK_FORM_FIELDS_MAX);
+    CHECK(mk_form_parse(&form, many, sizeof(many), scratch, 0) == -1);
+}
+void test_cookie()
+{
+    struct mk_request req;
+    struct mk_cookie_jar jar;
+    mk_pointer v;
+    char *r_get = "GET / HTTP/1.1\r\nHost: a\r\n"
+                  "Cookie: sid=abc123; theme = dark ;flag; =x; "
+                  "q=\"quoted\"; sid=second; e=\r\n\r\n";
+    char *r_none = "GET / HTTP/1.1\r\nHost: a\r\n\r\n";
+
+    memset(&req, 0, sizeof(req));
+    mk_http_parser(&req, r_get, strlen(r_get));
+    mk_cookie_jar_init(&jar, &req.request);
+    CHECK(jar.count == -1);
+    CHECK(mk_cookie_get(&jar, "sid", 3, &v) == 0 &&
+          v.len == 6 && !memcmp(v.data, "abc123", 6));
+    CHECK(mk_cookie_count(&jar) == 4);
+    CHECK(mk_cookie_get(&jar, "theme", 5, &v) == 0 &&
+          v.len == 4 && !memcmp(v.data, "dark", 4));
+    CHECK(mk_cookie_get(&jar, "q", 1, &v) == 0 &&
+          v.len == 6 && !memcmp(v.data, "quoted", 6));
+    CHECK(mk_cookie_get(&jar, "e", 1, &v) == 0 && v.len == 0);
+    CHECK(mk_cookie_get(&jar, "flag", 4, NULL) == -1 &&
+          mk_cookie_get(&jar, "SID", 3, NULL) == -1);
+
+    memset(&req, 0, sizeof(req));
+    mk_http_parser(&req, r_none, strlen(r_none));
+    mk_cookie_jar_init(&jar, &req.request);
+    CHECK(mk_cookie_get(&jar, "sid", 3, &v) == -1 && mk_cookie_count(&jar) == 0);
+}
+void test_websocket()
+{
+    int n;
+    char out[256];
+    unsigned char digest[20];
+    struct mk_request req;
+    mk_pointer chat = { "chat", 4 };
+    char *r_ws = "GET /chat HTTP/1.1\r\nHost: server.example.com\r\n"
+                 "Upgrade: websocket\r\nConnection: keep-alive, Upgrade\r\n"
+                 "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                 "Sec-WebSocket-Version: 13\r\n\r\n";
+    char *r_bad = "GET /chat HTTP/1.1\r\nHost: a\r\nUpgrade: websocket\r\n"
+                  "Connection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZR==\r\n"
+                  "Sec-WebSocket-Version: 13\r\n\r\n";
+    char *r_h2c = "GET / HTTP/1.1\r\nHost: a\r\nUpgrade: h2c\r\n"
+                  "Connection: Upgrade\r\n\r\n";
+    char *expect = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                   "Connection: Upgrade\r\n"
+                   "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n"
+                   "Sec-WebSocket-Protocol: chat\r\n\r\n";
+
+    mk_sha1("abc", 3, digest);
+    CHECK(!memcmp(digest, "\xa9\x99\x3e\x36\x47\x06\x81\x6a\xba\x3e"
+                          "\x25\x71\x78\x50\xc2\x6c\x9c\xd0\xd8\x9d", 20));
+    CHECK(mk_base64_encode((unsigned char *) "ab", 2, out) == 4 &&
+          !memcmp(out, "YWI=", 4));
+
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_ws, strlen(r_ws)) == MK_HTTP_OK &&
+          (req.request.connection & MK_CONN_WEBSOCKET));
+    n = mk_websocket_response(&req.request, &chat, out, sizeof(out));
+    CHECK(n == (int) strlen(expect) && !memcmp(out, expect, n));
+    CHECK(mk_websocket_response(&req.request, NULL, out, 60) == -1);
+
+    memset(&req, 0, sizeof(req));
+    mk_http_parser(&req, r_bad, strlen(r_bad));
+    CHECK(req.response.http_status == MK_CLIENT_BAD_REQUEST &&
+          req.state != MK_RESPONSE_NEW);
+
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_h2c, strlen(r_h2c)) == MK_HTTP_OK &&
+          (req.request.connection & MK_CONN_UPGRADE) &&
+          !(req.request.connection & MK_CONN_WEBSOCKET));
+}
+
+void test_target()
+{
+    int i, n;
+    size_t len = 0, host_len;
+    const char *host;
+    char out[256];
+    struct iovec iov[16];
+    struct mk_request req;
+    struct mk_proxy_view view;
+    char *r_abs = "GET http://example.com:8080/a?b=1 HTTP/1.1\r\n"
+                  "Host: other\r\n\r\n";
+    char *r_bare = "GET http://[::1]?x HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_conn = "CONNECT example.com:443 HTTP/1.1\r\n"
+                   "Host: example.com:443\r\n\r\n";
+    char *r_opt = "OPTIONS * HTTP/1.1\r\nHost: a:80\r\n\r\n";
+    char *r_star = "GET * HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_user = "GET http://u@a/ HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_noport = "CONNECT example.com HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_scheme = "GET example.com/ HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_out = "GET /?x HTTP/1.1\r\nHost: a\r\n\r\n";
+    char *r_conn6 = "CONNECT [::1]:443 HTTP/1.1\r\nHost: [::1]:443\r\n\r\n";
+    char *r_host6 = "GET / HTTP/1.1\r\nHost: [::1]\r\n\r\n";
+    char *r_port6 = "GET / HTTP/1.1\r\nHost: [::1]:8080\r\n\r\n";
+    char *r_open6 = "GET / HTTP/1.1\r\nHost: [::1\r\n\r\n";
+    char *r_range = "GET http://a:99999/ HTTP/1.1\r\nHost: a\r\n\r\n";
+
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_abs, strlen(r_abs)) == MK_HTTP_OK &&
+          req.request.target == MK_TARGET_ABSOLUTE);
+    CHECK(!strncmp(req.request.scheme.data, "http", req.request.scheme.len) &&
+          !strncmp(req.request.host.data, "example.com", req.request.host.len) &&
+          !strncmp(req.request.port.data, "8080", req.request.port.len) &&
+          !strncmp(req.request.path.data, "/a", req.request.path.len) &&
+          !strncmp(req.request.query.data, "b=1", req.request.query.len));
+    CHECK(mk_http_request_host(&req.request, &host, &host_len) == 0 &&
+          host_len == 11 && !memcmp(host, "example.com", 11));
+
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_bare, strlen(r_bare)) == MK_HTTP_OK &&
+          req.request.host.len == 5 && req.request.path.len == 0 &&
+          req.request.port.data == NULL);
+    n = mk_proxy_view_build(&view, &req.request, iov, 16, 0);
+    for (i = 0; i < n; i++) {
+        memcpy(out + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+    CHECK(n > 0 && len == strlen(r_out) && !memcmp(out, r_out, len));
+
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_conn, strlen(r_conn)) == MK_HTTP_OK &&
+          req.request.target == MK_TARGET_AUTHORITY &&
+          req.request.host.len == 11 && req.request.port.len == 3 &&
+          req.request.path.len == 0 && req.request.query.len == 0);
+
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_opt, strlen(r_opt)) == MK_HTTP_OK &&
+          req.request.target == MK_TARGET_ASTERISK);
+    CHECK(mk_http_request_host(&req.request, &host, &host_len) == 0 &&
+          host_len == 1 && host[0] == 'a');
+
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_star, strlen(r_star)) == MK_HTTP_ERROR);
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_user, strlen(r_user)) == MK_HTTP_ERROR);
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_noport, strlen(r_noport)) == MK_HTTP_ERROR);
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_scheme, strlen(r_scheme)) == MK_HTTP_ERROR);
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_range, strlen(r_range)) == MK_HTTP_ERROR);
+
+    /* The colons of an IP literal in Host are not a port */
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_conn6, strlen(r_conn6)) == MK_HTTP_OK &&
+          req.response.http_status == 0 && req.request.host.len == 5 &&
+          req.request.port.len == 3);
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_host6, strlen(r_host6)) == MK_HTTP_OK &&
+          req.response.http_status == 0);
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_port6, strlen(r_port6)) == MK_HTTP_OK &&
+          req.response.http_status == 0);
+    memset(&req, 0, sizeof(req));
+    mk_http_parser(&req, r_open6, strlen(r_open6));
+    CHECK(req.response.http_status == MK_CLIENT_BAD_REQUEST);
+}
+
+static void buffer_put(struct mk_buffer *buf, const char *s,
+        struct mk_request *pending)
+{
+    size_t avail;
+    char *p;
+
+    p = mk_buffer_reserve(buf, strlen(s), &avail, pending);
+    if (p != NULL) {
+        memcpy(p, s, strlen(s));
+        mk_buffer_commit(buf, strlen(s));
+    }
+}
+
+void test_buffer()
+{
+    size_t avail;
+    char *slab;
+    struct mk_request req;
+    struct mk_buffer buf, other;
+    struct mk_buffer_pool pool;
+    char *r_a = "GET /a HTTP/1.1\r\nHost: a\r\n\r\nGET /b HTTP/1.1\r\nHost: b\r";
+    char *r_b = "\n\r\n";
+
+    mk_buffer_pool_init(&pool, 2);
+    mk_buffer_init(&buf, &pool);
+
+    buffer_put(&buf, r_a, NULL);
+    CHECK(buf.size == MK_BUFFER_MIN && mk_buffer_head_ready(&buf) == 1);
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, mk_buffer_data(&buf), mk_buffer_len(&buf)) == 0 &&
+          req.state == MK_RESPONSE_NEW && req.next == NULL);
+    mk_buffer_consume(&buf, mk_http_request_end(&req.request) -
+                      mk_buffer_data(&buf));
+    CHECK(mk_buffer_len(&buf) == strlen(r_a) - 28 &&
+          mk_buffer_head_ready(&buf) == 0 && buf.scanned == buf.end);
+    buffer_put(&buf, r_b, NULL);
+    CHECK(mk_buffer_head_ready(&buf) == 1);
+
+    /* Room runs out, the tail moves and the pending request follows it */
+    mk_http_parser(&req, mk_buffer_data(&buf), mk_buffer_len(&buf));
+    slab = buf.data;
+    CHECK(mk_buffer_reserve(&buf, MK_BUFFER_MIN - 40, &avail, &req) == buf.data + 28 &&
+          buf.data == slab && buf.start == 0 &&
+          req.request.path.data == buf.data + 4 &&
+          !strncmp(req.request.path.data, "/b", req.request.path.len));
+
+    /* Does not fit, moves to a 16 KB slab, the 4 KB one goes to the pool */
+    CHECK(mk_buffer_reserve(&buf, MK_BUFFER_MIN, &avail, &req) != NULL &&
+          buf.size == MK_BUFFER_MIN * 4 && pool.count[0] == 1 &&
+          !strncmp(req.request.headers.data, "Host: b", 7) &&
+          !strncmp(req.request.path.data, "/b", req.request.path.len));
+    CHECK(mk_buffer_reserve(&buf, MK_BUFFER_MAX + 1, &avail, &req) == NULL);
+
+    mk_buffer_consume(&buf, mk_http_request_end(&req.request) -
+                      mk_buffer_data(&buf));
+    /* Emptied, the slab goes back to the pool */
+    CHECK(mk_buffer_len(&buf) == 0 && buf.start == 0 && buf.scanned == 0 &&
+          buf.data == NULL && pool.count[1] == 1);
+
+    /* Slabs are reused between connections */
+    mk_buffer_init(&other, &pool);
+    CHECK(mk_buffer_reserve(&other, 1, &avail, NULL) == slab &&
+          avail == MK_BUFFER_MIN && pool.count[0] == 0);
+    mk_buffer_release(&other);
+    mk_buffer_pool_destroy(&pool);
+    CHECK(pool.count[0] == 0 && pool.free[0] == NULL);
+}
+
+void test_sink()
+{
+    int sv[2];
+    char path[] = "/tmp/mk_sink_XXXXXX";
+    char body[8192], got[8192];
+    char head[256];
+    int fd, n;
+    struct mk_request req;
+    struct mk_request_info info;
+    struct mk_body_sink sink;
+
+    memset(body, 'x', sizeof(body));
+    body[sizeof(body) - 1] = '!';
+    n = snprintf(head, sizeof(head), "POST /up HTTP/1.1\r\nHost: a\r\n"
+                 "Content-Length: %zu\r\n\r\n", sizeof(body));
+    memcpy(head + n, body, 100);
+
+    /* Without a sink the body does not fit */
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, head, n + 100) == MK_HTTP_ERROR &&
+          req.response.http_status == MK_CLIENT_REQUEST_ENTITY_TOO_LARGE);
+
+    mk_http_body_sink_max(1 << 20);
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, head, n + 100) == 0 &&
+          req.state == MK_RESPONSE_STREAM &&
+          req.request.content_length == sizeof(body) &&
+          req.request.body.len == 100);
+
+    fd = mkstemp(path);
+    CHECK(fd != -1 && socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    unlink(path);
+    CHECK(mk_body_sink_init(&sink, &req.request, fd) == 0 &&
+          sink.remaining == sizeof(body) - 100);
+
+    /* Half the rest arrives, then the rest and a pipelined request */
+    CHECK(write(sv[1], body + 100, 4000) == 4000);
+    CHECK(mk_body_sink_feed(&sink, sv[0]) == MK_HTTP_PENDING &&
+          sink.remaining == sizeof(body) - 4100);
+    CHECK(write(sv[1], body + 4100, sizeof(body) - 4100) ==
+          (ssize_t) sizeof(body) - 4100 && write(sv[1], "GET", 3) == 3);
+    CHECK(mk_body_sink_feed(&sink, sv[0]) == MK_HTTP_OK);
+    CHECK(pread(fd, got, sizeof(got), 0) == sizeof(got) &&
+          !memcmp(got, body, sizeof(body)));
+    CHECK(read(sv[0], got, sizeof(got)) == 3 && !memcmp(got, "GET", 3));
+    mk_body_sink_release(&sink);
+
+    /* Over the sink limit, still refused */
+    mk_http_body_sink_max(4097);
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, head, n + 100) == MK_HTTP_ERROR &&
+          req.response.http_status == MK_CLIENT_REQUEST_ENTITY_TOO_LARGE);
+    mk_http_body_sink_max(0);
+
+    /* The peer goes away before the end of the body */
+    memset(&info, 0, sizeof(info));
+    info.content_length = 10;
+    CHECK(mk_body_sink_init(&sink, &info, fd) == 0);
+    close(sv[1]);
+    CHECK(mk_body_sink_feed(&sink, sv[0]) == MK_HTTP_ERROR);
+    mk_body_sink_release(&sink);
+    close(sv[0]);
+    close(fd);
+}
+
+void test_log()
+{
+    int fds[2];
+    char out[512];
+    ssize_t n;
+    struct mk_request req;
+    struct mk_log_format fmt;
+    struct mk_log_entry entry;
+    static struct mk_log log;
+    char r_get[] = "GET /a/b?x=1 HTTP/1.1\r\nHost: a\r\n"
+        "User-Agent: say \"hi\"\r\nX-Id: 42\r\n\r\n";
+    char *l_expect =
+        "10.0.0.1 - - \"GET /a/b?x=1 HTTP/1.1\" 200 - \"-\" "
+        "\"say \\x22hi\\x22\"\n"
+        "GET /a/b ?x=1 HTTP/1.1 a 42 404 0 100%\n";
+
+    CHECK(mk_log_compile(&fmt, "%h %l %u \"%r\" %>s %b \"%{Referer}i\" "
+                         "\"%{User-Agent}i\"") == 0);
+    memset(&req, 0, sizeof(req));
+    CHECK(mk_http_parser(&req, r_get, strlen(r_get)) == MK_HTTP_OK);
+    CHECK(pipe(fds) == 0);
+    mk_log_init(&log, fds[1], 60);
+
+    entry.info = &req.request;
+    entry.status = 200;
+    entry.bytes = 0;
+    entry.remote.data = "10.0.0.1";
+    entry.remote.len = 8;
+    CHECK(mk_log_append(&log, &fmt, &entry) == 0);
+
+    /* Header outside the quick index, %% and %B */
+    CHECK(mk_log_compile(&fmt, "%m %U %q %H %{host}i %{X-Id}i %s %B 100%%") == 0);
+    entry.status = 404;
+    CHECK(mk_log_append(&log, &fmt, &entry) == 0 &&
+          log.len == strlen(l_expect));
+    CHECK(mk_log_flush(&log) == 0 && log.len == 0);
+    n = read(fds[0], out, sizeof(out));
+    CHECK(n == (ssize_t) strlen(l_expect) && !memcmp(out, l_expect, n));
+
+    /* The whole batch leaves once the oldest line is old enough */
+    CHECK(mk_log_compile(&fmt, MK_LOG_COMBINED) == 0);
+    mk_log_init(&log, fds[1], 0);
+    CHECK(mk_log_append(&log, &fmt, &entry) == 0 && log.len == 0);
+    n = read(fds[0], out, sizeof(out));
+    CHECK(n > 0 && out[13] == '[' && out[13 + 27] == ']' && out[n - 1] == '\n');
+
+    /* An idle log is flushed by the timer tick */
+    mk_log_init(&log, fds[1], 5);
+    CHECK(mk_log_tick(&log) == 0 && mk_log_append(&log, &fmt, &entry) == 0 &&
+          mk_log_tick(&log) == 0 && log.len > 0);
+    log.first -= 5;
+    n = log.len;
+    CHECK(mk_log_tick(&log) == 0 && log.len == 0 &&
+          read(fds[0], out, sizeof(out)) == n);
+
+    CHECK(mk_log_compile(&fmt, "%x") == -1);
+    CHECK(mk_log_compile(&fmt, "%{Host}") == -1);
+    CHECK(mk_log_compile(&fmt, "100%") == -1);
+    close(fds[0]);
+    close(fds[1]);
+}
+#endif
+
 int main()
 {
     /* first line */
@@ -188,6 +1381,44 @@ int main()
     TEST(r55, MK_HTTP_ERROR);
     TEST(r56, MK_HTTP_ERROR);
 
+#if MK_HTTP_STRICT
+    /* grammar validation */
+    char *r60 = "GET / HTTP/1.0\r\nA B: C\r\n\r\n";
+    char *r61 = "GET / HTTP/1.0\r\nA: B\001C\r\n\r\n";
+    char *r62 = "GET / HTTP/1.0\r\nA\177: B\r\n\r\n";
+    char *r63 = "GET / HTTP/1.0\r\nUser-Agent: x\tabcdefghijklmnop\200\r\n\r\n";
+
+    TEST(r60, MK_HTTP_ERROR);
+    TEST(r61, MK_HTTP_ERROR);
+    TEST(r62, MK_HTTP_ERROR);
+    TEST(r63, MK_HTTP_OK);
+#endif
+
+#ifdef TEST2
+    test_response();
+    test_pipeline();
+    test_expect();
+    test_events();
+    test_proxy();
+    test_edit();
+    test_router();
+    test_upstream();
+#if MK_HTTP_STATS
+    test_stats();
+#endif
+    test_timing();
+    test_key();
+    test_ring();
+    test_multipart();
+    test_form();
+    test_cookie();
+    test_websocket();
+    test_target();
+    test_buffer();
+    test_sink();
+    test_log();
+#endif
+
     printf("%s===> Tests Passed:%s %s%s%i/%i%s\n\n",
            ANSI_BOLD, ANSI_RESET,
            ANSI_BOLD,